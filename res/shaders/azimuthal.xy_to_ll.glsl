@@ -2,6 +2,7 @@ bool xy_to_ll(inout vec2 zoomed) {
     float l = length(zoomed);
     zoomed = vec2(atan(zoomed.x, -zoomed.y), (0.5f - l) * PI);
     if (l >= 1) {
+        COST_INVALID();
         return false;
     }
     return true;
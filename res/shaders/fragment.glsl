@@ -6,42 +6,124 @@ in vec2 UV;
 
 out vec3 color;
 
-uniform vec2 scale;
-uniform vec2 uv_scale;
-uniform float zoom;
+// Everything about the view, uploaded by the renderer only when it changes, see ViewUniforms
+layout(std140) uniform View {
+    mat3 rotation;
+    vec2 scale;
+    vec2 offset;
+    vec2 uv_scale;
+    float zoom;
+    bool infinite_mode;
+    // Layers of the frames around the position of a time series, and how far it is from the first to the second
+    vec2 frame_layers;
+    float frame_blend;
+};
+#ifdef TIME_SERIES
+uniform sampler2DArray texture_sampler;
+#else
 uniform sampler2D texture_sampler;
-uniform mat3 rotation;
-uniform bool infinite_mode;
+#endif
+
+// With several views, the renderer generates an xy_to_ll that picks the projection of the view, and each view is
+// scaled to fit its own projection, see set_views
+#ifdef MULTI_VIEW
+flat in int view;
+uniform vec2 view_scales[VIEW_COUNT];
+#define FRAME_SCALE view_scales[view]
+#else
+#define FRAME_SCALE scale
+#endif
+
+// Counters for the cost heatmap, which the renderer builds by defining COST_HEATMAP. Branches taken cost 1, lookup
+// table and texture fetches 4, and pixels with invalid results are tinted magenta.
+#ifdef COST_HEATMAP
+int cost_branches = 0;
+int cost_fetches = 0;
+int cost_invalid = 0;
+#define COST_BRANCH() cost_branches++
+#define COST_FETCH(n) cost_fetches += n
+#define COST_INVALID() cost_invalid++
+#define COST_CHECK(v) if (any(isnan(v)) || any(isinf(v))) cost_invalid++
+#define COST_MAX 32.0f
+
+// The same ramp from blue through cyan, green and yellow to red as cost_to_color on the CPU
+vec3 cost_color() {
+    float t = clamp((cost_branches + 4 * cost_fetches) / COST_MAX, 0, 1) * 4;
+    vec3 heat = clamp(vec3(t - 2, min(t, 4 - t), 2 - t), 0, 1);
+    return cost_invalid > 0 ? mix(heat, vec3(1, 0, 1), 0.5f) : heat;
+}
+#else
+#define COST_BRANCH()
+#define COST_FETCH(n)
+#define COST_INVALID()
+#define COST_CHECK(v)
+#endif
 
 bool xy_to_ll(inout vec2 zoomed);
 void ll_to_xy(inout vec2 uv);
 
+// With overlays, the renderer generates this to draw every one of them over color in order, each sampled through
+// the ll_to_xy of its own source projection, see get_layer_code
+#ifdef LAYER_COUNT
+void composite_layers(vec2 lonlat, inout vec3 color);
+#endif
+
+// The point of a texture for a point uv of its source projection
+vec2 get_texture_uv(vec2 uv) {
+    uv = (uv + vec2(1, 1)) / 2;
+    uv -= floor(uv);
+    uv.y = 1 - uv.y;
+    return uv;
+}
+
 bool is_outside(vec2 uv, vec2 a, vec2 b) {
     vec2 test = step(a, uv) - step(b, uv);
     return (test.x * test.y) == 0;
 }
 
 void main() {
-    vec2 zoomed = (UV * 2 - vec2(1, 1)) / scale / zoom;
+    vec2 zoomed = (UV * 2 - vec2(1, 1) + offset) / FRAME_SCALE / zoom;
 
     if (infinite_mode) {
+        COST_BRANCH();
         xy_to_ll(zoomed);
     } else if (is_outside(zoomed, vec2(-1, -1), vec2(1, 1)) || !xy_to_ll(zoomed)) {
+        COST_INVALID();
+#ifdef COST_HEATMAP
+        color = cost_color();
+#else
         color = vec3(0, 0, 0);
+#endif
         return;
     }
+    COST_CHECK(zoomed);
 
     vec3 origin = vec3(sin(zoomed.x) * cos(zoomed.y), sin(zoomed.y), -cos(zoomed.x) * cos(zoomed.y));
     vec3 dest = rotation * origin;
 
     vec2 uv = vec2(atan(dest.x, -dest.z), asin(dest.y));
+#ifdef LAYER_COUNT
+    vec2 lonlat = uv;
+#endif
 
     ll_to_xy(uv);
+    COST_CHECK(uv);
 
-    uv = (uv + vec2(1, 1)) / 2;
-    uv -= floor(uv);
-
-    uv.y = 1 - uv.y;
+    uv = get_texture_uv(uv);
 
+#ifdef TIME_SERIES
+    vec3 first = texture(texture_sampler, vec3(uv * uv_scale, frame_layers.x)).rgb;
+    vec3 second = texture(texture_sampler, vec3(uv * uv_scale, frame_layers.y)).rgb;
+    color = mix(first, second, frame_blend);
+    COST_FETCH(2);
+#else
     color = texture(texture_sampler, uv * uv_scale).rgb;
+    COST_FETCH(1);
+#endif
+#ifdef LAYER_COUNT
+    composite_layers(lonlat, color);
+#endif
+#ifdef COST_HEATMAP
+    color = cost_color();
+#endif
 }
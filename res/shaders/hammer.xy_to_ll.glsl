@@ -7,6 +7,7 @@ bool xy_to_ll(inout vec2 zoomed) {
     zoomed = vec2(2 * atan(z * nx * 2 / (2 * z * z - 1)), asin(z * ny * 2));
     
     if (z_p1 > 0.5) {
+        COST_INVALID();
         return false;
     }
 
@@ -0,0 +1,5 @@
+void ll_to_xy(inout vec2 uv) {
+    // Clamped to where the map becomes square, the poles are infinitely far away
+    float v = clamp(uv.y, -1.4844222f, 1.4844222f);
+    uv = vec2(uv.x, log(tan(PI / 4 + v / 2))) / PI;
+}
@@ -0,0 +1,4 @@
+bool xy_to_ll(inout vec2 zoomed) {
+    zoomed = vec2(zoomed.x * PI, 2 * atan(exp(zoomed.y * PI)) - PI / 2);
+    return true;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+uniform vec2 uv_scale;
+uniform sampler2D texture_sampler;
+
+void main() {
+    color = texture(texture_sampler, UV * uv_scale).rgb;
+}
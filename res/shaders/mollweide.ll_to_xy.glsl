@@ -8,15 +8,22 @@ uniform float t314_offset;
 void ll_to_xy(inout vec2 uv) {
     float mul = 1;
     if (uv.y < 0) {
+        COST_BRANCH();
         mul = -1;
         uv.y *= -1;
     }
     uv.y = PI * sin(uv.y);
     if (uv.y <= 3) {
+        COST_BRANCH();
+        COST_FETCH(1);
         uv.y = texture(texture_000_300, t000_offset + (1 - 2 * t000_offset) * (uv.y / 3)).r;
     } else if (uv.y <= 3.14) {
+        COST_BRANCH();
+        COST_FETCH(1);
         uv.y = texture(texture_300_314, t300_offset + (1 - 2 * t300_offset) * ((uv.y - 3) / 0.14f)).r;
     } else if (uv.y <= PI) {
+        COST_BRANCH();
+        COST_FETCH(1);
         uv.y = texture(texture_314_pi, t314_offset + (1 - 2 * t314_offset) * ((uv.y - 3.14f) / (PI - 3.14f))).r;
     }
     uv.y *= mul;
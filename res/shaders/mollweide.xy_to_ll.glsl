@@ -6,6 +6,7 @@ bool xy_to_ll(inout vec2 zoomed) {
     zoomed.y = asin((2 * zoomed.y + sin(2 * zoomed.y)) / PI);
     
     if (zoomed.x < -PI || zoomed.x > PI) {
+        COST_INVALID();
         return false;
     }
     
@@ -4,19 +4,23 @@ uniform float xy_offset;
 
 bool xy_to_ll(inout vec2 zoomed) {
     if (zoomed.y > 1 || zoomed.y < -1) {
+        COST_INVALID();
         return false;
     }
 
     float mul = 1;
     if (zoomed.y < 0) {
+        COST_BRANCH();
         mul = -1;
     }
 
+    COST_FETCH(2);
     float l = texture(y_to_l, xy_offset + mul * zoomed.y * (1 - 2 * xy_offset)).r;
     zoomed.y = mul * l * PI / 2;
     zoomed.x /= texture(yl_to_x, xy_offset + l * (1 - 2 * xy_offset)).r;
 
     if (zoomed.x < -1 || zoomed.x > 1) {
+        COST_INVALID();
         return false;
     }
 
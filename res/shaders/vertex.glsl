@@ -5,8 +5,24 @@ layout(location = 1) in vec2 vertexUV;
 
 out vec2 UV;
 
+#ifdef MULTI_VIEW
+// Every instance is one view, placed in a grid of columns by rows from the top left. The grid is drawn as if the
+// viewport covered the part of the frame with center view_tile.xy and half size view_tile.zw.
+uniform ivec2 view_grid;
+uniform vec4 view_tile;
+flat out int view;
+#endif
+
 void main() {
+#ifdef MULTI_VIEW
+    view = gl_InstanceID;
+    vec2 cell = vec2(view % view_grid.x, view / view_grid.x);
+    vec2 frame = vec2(-1, 1) + vec2(2, -2) * (cell + vec2(vertPos.x + 1, 1 - vertPos.y) / 2) / vec2(view_grid);
+    gl_Position.xy = (frame - view_tile.xy) / view_tile.zw;
+    gl_Position.z = vertPos.z;
+#else
     gl_Position.xyz = vertPos;
+#endif
     gl_Position.w = 1.0;
     UV = vertexUV;
 }
\ No newline at end of file
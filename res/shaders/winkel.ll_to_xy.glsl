@@ -0,0 +1,10 @@
+void ll_to_xy(inout vec2 uv) {
+    float cos_a = cos(uv.y) * cos(uv.x / 2);
+    float sin_a = sqrt(1 - cos_a * cos_a);
+    float sinc_a = 1;
+    if (sin_a > 0) {
+        COST_BRANCH();
+        sinc_a = sin_a / atan(sin_a, cos_a);
+    }
+    uv = vec2((uv.x * 2 / PI + 2 * cos(uv.y) * sin(uv.x / 2) / sinc_a) / (2 + PI), (uv.y + sin(uv.y) / sinc_a) / PI);
+}
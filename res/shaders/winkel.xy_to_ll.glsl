@@ -0,0 +1,70 @@
+uniform sampler2D winkel_guess;
+
+// Bilinear interpolation of the guess grid, done by hand since texture filtering has too few bits of precision
+vec2 winkel_initial_guess(vec2 xy) {
+    ivec2 size = textureSize(winkel_guess, 0);
+    vec2 g = abs(xy) * vec2(size - ivec2(1, 1));
+    ivec2 i = min(ivec2(g), size - ivec2(2, 2));
+    vec2 t = g - vec2(i);
+    COST_FETCH(4);
+
+    vec2 g0 = mix(texelFetch(winkel_guess, i, 0).rg, texelFetch(winkel_guess, i + ivec2(1, 0), 0).rg, t.x);
+    vec2 g1 = mix(texelFetch(winkel_guess, i + ivec2(0, 1), 0).rg, texelFetch(winkel_guess, i + ivec2(1, 1), 0).rg, t.x);
+
+    // The grid only stores the positive quadrant
+    return sign(xy) * mix(g0, g1, t.y);
+}
+
+// One step of Newton's method for solving the forward projection for the target coordinates, returns the error before the step
+float winkel_newton_step(vec2 target, inout vec2 ll) {
+    float cos_p = cos(ll.y);
+    float sin_p = sin(ll.y);
+    float sin_2p = sin(2 * ll.y);
+    float sin2_p = sin_p * sin_p;
+    float cos2_p = cos_p * cos_p;
+    float sin_l = sin(ll.x);
+    float cos_l2 = cos(ll.x / 2);
+    float sin_l2 = sin(ll.x / 2);
+    float sin2_l2 = sin_l2 * sin_l2;
+
+    float c = 1 - cos2_p * cos_l2 * cos_l2;
+    float f = 0;
+    float e = 0;
+    if (c > 0) {
+        COST_BRANCH();
+        f = 1 / c;
+        e = atan(sqrt(c), cos_p * cos_l2) * sqrt(f);
+    }
+
+    vec2 fxy = vec2(0.5 * (2 * e * cos_p * sin_l2 + ll.x * 2 / PI), 0.5 * (e * sin_p + ll.y)) - target;
+
+    float dx_dl = 0.5 * f * (cos2_p * sin2_l2 + e * cos_p * cos_l2 * sin2_p) + 1 / PI;
+    float dx_dp = f * (sin_l * sin_2p / 4 - e * sin_p * sin_l2);
+    float dy_dl = 0.125 * f * (sin_2p * sin_l2 - e * sin_p * cos2_p * sin_l);
+    float dy_dp = 0.5 * f * (sin2_p * cos_l2 + e * sin2_l2 * cos_p) + 0.5;
+
+    float det = dx_dp * dy_dl - dy_dp * dx_dl;
+
+    ll -= vec2(fxy.y * dx_dp - fxy.x * dy_dp, fxy.x * dy_dl - fxy.y * dx_dl) / det;
+
+    return abs(fxy.x) + abs(fxy.y);
+}
+
+bool xy_to_ll(inout vec2 zoomed) {
+    vec2 target = zoomed * vec2(1 + PI / 2, PI / 2);
+
+    vec2 ll = winkel_initial_guess(zoomed);
+
+    winkel_newton_step(target, ll);
+    float error = winkel_newton_step(target, ll);
+
+    zoomed = ll;
+
+    // Points that are not converging are outside of the map, this is written so that NaN also fails the test
+    if (!(error <= 0.01 && abs(ll.x) <= PI && abs(ll.y) <= PI / 2)) {
+        COST_INVALID();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,400 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "images.h"
+#include "mapper.h"
+#include "pipeline.h"
+#include "renderer.h"
+
+// Magic constant
+const double PI = 3.141592653589793238462;
+
+/**
+ * Frames are read back through a ring of pixel buffers, so a frame is only waited for
+ * after the following ones have already been queued on the GPU.
+ */
+static const int readback_depth = 3;
+
+struct Frame {
+    unsigned int index;
+    std::vector<unsigned char> rgb;
+    std::vector<unsigned char> yuv;
+};
+
+/**
+ * Time spent working by each stage, to find out which one limits the frame rate.
+ */
+struct StageTimes {
+    double render;
+    double readback;
+    std::atomic<long long> encode_ns;
+    std::atomic<long long> write_ns;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool load_keyframes(const std::string &filename, std::vector<Keyframe> &keyframes) {
+    std::ifstream file(filename);
+    if (file.fail()) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        std::size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+
+        std::istringstream stream(line);
+        Keyframe keyframe;
+        if (!(stream >> keyframe.frame >> keyframe.longitude >> keyframe.latitude >> keyframe.roll)) {
+            std::cerr << filename << ":" << line_number << ": expected \"frame longitude latitude roll\"" << std::endl;
+            return false;
+        }
+        keyframes.push_back(keyframe);
+    }
+
+    if (keyframes.empty()) {
+        std::cerr << filename << " has no keyframes" << std::endl;
+        return false;
+    }
+
+    std::stable_sort(keyframes.begin(), keyframes.end(), [](const Keyframe &a, const Keyframe &b) { return a.frame < b.frame; });
+    return true;
+}
+
+/**
+ * Linearly interpolate between the keyframes around the given frame, holding the first and last ones.
+ */
+static Keyframe interpolate(const std::vector<Keyframe> &keyframes, double frame) {
+    if (frame <= keyframes.front().frame) {
+        return keyframes.front();
+    }
+    for (std::size_t i = 1; i < keyframes.size(); i++) {
+        const Keyframe &a = keyframes[i - 1];
+        const Keyframe &b = keyframes[i];
+        if (frame <= b.frame) {
+            double t = b.frame > a.frame ? (frame - a.frame) / (b.frame - a.frame) : 1;
+            return {
+                frame,
+                a.longitude + (b.longitude - a.longitude) * t,
+                a.latitude + (b.latitude - a.latitude) * t,
+                a.roll + (b.roll - a.roll) * t
+            };
+        }
+    }
+    return keyframes.back();
+}
+
+static inline unsigned char clamp_byte(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/**
+ * Convert to planar 4:2:0 YUV with BT.601 limited range coefficients, averaging chroma over 2x2 blocks.
+ */
+static void rgb_to_i420(const unsigned char *rgb, unsigned char *yuv, unsigned int width, unsigned int height) {
+    unsigned char *y_plane = yuv;
+    unsigned char *u_plane = y_plane + width * height;
+    unsigned char *v_plane = u_plane + (width / 2) * (height / 2);
+
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            const unsigned char *p = rgb + (y * width + x) * 3;
+            y_plane[y * width + x] = clamp_byte(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+        }
+    }
+
+    for (unsigned int y = 0; y < height / 2; y++) {
+        for (unsigned int x = 0; x < width / 2; x++) {
+            int r = 0, g = 0, b = 0;
+            for (unsigned int i = 0; i < 4; i++) {
+                const unsigned char *p = rgb + ((y * 2 + i / 2) * width + x * 2 + i % 2) * 3;
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            r /= 4;
+            g /= 4;
+            b /= 4;
+            u_plane[y * (width / 2) + x] = clamp_byte(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v_plane[y * (width / 2) + x] = clamp_byte(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+struct EncodeContext {
+    const Options *options;
+    bool yuv;
+    BoundedQueue<Frame *> *rendered;
+    BoundedQueue<Frame *> *encoded;
+    BoundedQueue<Frame *> *free_frames;
+    StageTimes *times;
+    std::atomic<bool> *failed;
+};
+
+static void encode_frames(EncodeContext context) {
+    const Options &options = *context.options;
+    Frame *frame;
+    while (context.rendered->pop(frame)) {
+        Clock::time_point start = Clock::now();
+        if (context.yuv) {
+            rgb_to_i420(frame->rgb.data(), frame->yuv.data(), options.frame_width, options.frame_height);
+        } else if (!*context.failed) {
+            char filename[4096];
+            std::snprintf(filename, sizeof(filename), options.animation_output.c_str(), frame->index);
+
+            Image image;
+            image.width = options.frame_width;
+            image.height = options.frame_height;
+            image.channels = 3;
+            image.data = frame->rgb.data();
+            if (!save_image(filename, image)) {
+                *context.failed = true;
+            }
+        }
+        context.times->encode_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+        if (context.yuv) {
+            context.encoded->push(frame);
+        } else {
+            context.free_frames->push(frame);
+        }
+    }
+}
+
+/**
+ * Raw video has to be written in order, while the encoders can finish frames in any order.
+ */
+static void write_yuv(FILE *file, std::size_t frame_size, BoundedQueue<Frame *> *encoded, BoundedQueue<Frame *> *free_frames, StageTimes *times, std::atomic<bool> *failed) {
+    std::vector<Frame *> waiting;
+    unsigned int next = 0;
+    Frame *frame;
+    while (encoded->pop(frame)) {
+        waiting.push_back(frame);
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (std::size_t i = 0; i < waiting.size(); i++) {
+                if (waiting[i]->index != next) {
+                    continue;
+                }
+                Clock::time_point start = Clock::now();
+                if (!*failed && std::fwrite(waiting[i]->yuv.data(), 1, frame_size, file) != frame_size) {
+                    std::cerr << "Failed to write frame " << next << std::endl;
+                    *failed = true;
+                }
+                times->write_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+                free_frames->push(waiting[i]);
+                waiting.erase(waiting.begin() + i);
+                next++;
+                progress = true;
+                break;
+            }
+        }
+    }
+}
+
+bool render_animation(const Options &options) {
+    std::vector<Keyframe> keyframes;
+    if (!load_keyframes(options.animation_file, keyframes)) {
+        return false;
+    }
+
+    unsigned int width = options.frame_width;
+    unsigned int height = options.frame_height;
+    unsigned int frames = options.frames;
+    if (frames == 0) {
+        frames = (unsigned int) keyframes.back().frame + 1;
+    }
+
+    const std::string &output = options.animation_output;
+    bool yuv = output.size() > 4 && output.compare(output.size() - 4, 4, ".yuv") == 0;
+    if (yuv && (width % 2 != 0 || height % 2 != 0)) {
+        std::cerr << "Raw I420 video needs an even frame size" << std::endl;
+        return false;
+    }
+    if (!yuv && output.find('%') == std::string::npos) {
+        std::cerr << "The animation output must be a .yuv file or contain a frame number pattern like %05d" << std::endl;
+        return false;
+    }
+
+    FILE *yuv_file = NULL;
+    if (yuv) {
+        yuv_file = std::fopen(output.c_str(), "wb");
+        if (!yuv_file) {
+            std::cerr << "Failed to open " << output << " for writing!" << std::endl;
+            return false;
+        }
+    }
+
+    unsigned int threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::cout << "Rendering " << frames << " " << width << "x" << height << " frames to " << output << " with " << threads << " encoding threads" << std::endl;
+
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+    bool result = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!result) {
+        std::cerr << "Failed to create the framebuffer for animation frames!" << std::endl;
+    }
+
+    std::size_t rgb_size = width * height * 3;
+    std::size_t yuv_size = width * height + 2 * (width / 2) * (height / 2);
+
+    GLuint pbos[readback_depth];
+    glGenBuffers(readback_depth, pbos);
+    for (int i = 0; i < readback_depth; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, rgb_size, NULL, GL_STREAM_READ);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Enough frames for every encoder to work on one and one more to wait in each queue
+    unsigned int frame_count = threads * 2 + 2;
+    std::vector<Frame> frame_pool(frame_count);
+    BoundedQueue<Frame *> free_frames(frame_count);
+    BoundedQueue<Frame *> rendered(frame_count);
+    BoundedQueue<Frame *> encoded(frame_count);
+    for (Frame &frame : frame_pool) {
+        frame.rgb.resize(rgb_size);
+        if (yuv) {
+            frame.yuv.resize(yuv_size);
+        }
+        free_frames.push(&frame);
+    }
+
+    StageTimes times;
+    times.render = 0;
+    times.readback = 0;
+    times.encode_ns = 0;
+    times.write_ns = 0;
+    std::atomic<bool> failed(false);
+
+    std::vector<std::thread> encoders;
+    EncodeContext context = {&options, yuv, &rendered, &encoded, &free_frames, &times, &failed};
+    for (unsigned int i = 0; i < threads; i++) {
+        encoders.emplace_back(encode_frames, context);
+    }
+    std::thread writer;
+    if (yuv) {
+        writer = std::thread(write_yuv, yuv_file, yuv_size, &encoded, &free_frames, &times, &failed);
+    }
+
+    Clock::time_point start = Clock::now();
+
+    auto finish_frame = [&](unsigned int index) {
+        Frame *frame;
+        free_frames.pop(frame);
+        frame->index = index;
+
+        Clock::time_point readback_start = Clock::now();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[index % readback_depth]);
+        const unsigned char *pixels = (const unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rgb_size, GL_MAP_READ_BIT);
+        if (pixels) {
+            // Flip, since OpenGL reads rows bottom up
+            for (unsigned int i = 0; i < height; i++) {
+                std::memcpy(frame->rgb.data() + (height - 1 - i) * width * 3, pixels + i * width * 3, width * 3);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            std::cerr << "Failed to map pixel buffer for frame " << index << std::endl;
+            failed = true;
+        }
+        times.readback += seconds_since(readback_start);
+
+        rendered.push(frame);
+    };
+
+    for (unsigned int i = 0; result && i < frames && !failed; i++) {
+        Clock::time_point render_start = Clock::now();
+
+        Keyframe key = interpolate(keyframes, i);
+        set_rotation(key.longitude * PI / 180, key.latitude * PI / 180, key.roll * PI / 180);
+        render_map(width, height);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i % readback_depth]);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        times.render += seconds_since(render_start);
+
+        if (i + 1 >= readback_depth) {
+            finish_frame(i + 1 - readback_depth);
+        }
+    }
+    for (unsigned int i = frames > readback_depth - 1 ? frames - (readback_depth - 1) : 0; result && !failed && i < frames; i++) {
+        finish_frame(i);
+    }
+
+    rendered.close();
+    for (std::thread &encoder : encoders) {
+        encoder.join();
+    }
+    encoded.close();
+    if (yuv) {
+        writer.join();
+        std::fclose(yuv_file);
+    }
+
+    double total = seconds_since(start);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(readback_depth, pbos);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    result = result && !failed;
+    if (!result) {
+        std::cerr << "Failed to render animation to " << output << std::endl;
+        return false;
+    }
+
+    // Each stage's frame rate is how fast it would go if the others took no time, the encode rate counts all threads together
+    double encode = times.encode_ns / 1e9;
+    double write = times.write_ns / 1e9;
+    std::cout << "Rendered " << frames << " frames in " << total << "s, " << frames / total << " fps" << std::endl;
+    std::cout << "  render (submit only):      " << times.render << "s, " << frames / times.render << " fps" << std::endl;
+    std::cout << "  readback (with GPU wait):  " << times.readback << "s, " << frames / times.readback << " fps" << std::endl;
+    std::cout << "  encode:                    " << encode << "s over " << threads << " threads, " << frames * threads / encode << " fps" << std::endl;
+    if (yuv) {
+        std::cout << "  write:                     " << write << "s, " << frames / write << " fps" << std::endl;
+        std::cout << "Play with: ffplay -f rawvideo -pixel_format yuv420p -video_size " << width << "x" << height << " " << output << std::endl;
+    }
+
+    return true;
+}
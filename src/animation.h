@@ -0,0 +1,30 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <string>
+#include <vector>
+
+#include "options.h"
+
+/**
+ * A point on a rotation path, with angles in degrees. See set_rotation for what they mean.
+ */
+struct Keyframe {
+    double frame;
+    double longitude;
+    double latitude;
+    double roll;
+};
+
+/**
+ * Read keyframes from a text file with one "frame longitude latitude roll" line per keyframe.
+ * Empty lines and lines starting with # are skipped.
+ */
+bool load_keyframes(const std::string &filename, std::vector<Keyframe> &keyframes);
+
+/**
+ * Render every frame of a rotation path with the current map and output projection and write them out.
+ */
+bool render_animation(const Options &options);
+
+#endif
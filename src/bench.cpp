@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "images.h"
+#include "options.h"
+#include "points.h"
+#include "projection.h"
+#include "projections/mollweide.h"
+#include "projections/robinson.h"
+#include "projections/winkel.h"
+
+/**
+ * Benchmarks of the CPU side: the projection conversions, the lookup table generators, padding textures and decoding
+ * the bundled images. This is built without OpenGL, so it runs on any machine.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static const double PI = 3.141592653589793238462;
+
+/**
+ * Every projection, in the same order as in the viewer.
+ */
+static Projection *projections[] = {&equirectangular, &mollweide, &hammer, &azimuthal, &robinson, &winkel, &mercator};
+
+struct Benchmark;
+
+/**
+ * An image size and crop for the pad_image benchmarks, see pad_image.
+ */
+struct PadCase {
+    unsigned int width;
+    unsigned int height;
+    unsigned int x;
+    unsigned int y;
+    int w;
+    int h;
+};
+
+// The size of earth2.jpg, which is not a power of two, and earth6.jpg with its crop from res/maps.txt
+static const PadCase pad_whole = {4424, 2214, 0, 0, 0, 0};
+static const PadCase pad_cropped = {2058, 1036, 6, 7, -6, -7};
+
+/**
+ * Run iterations operations and return the nanoseconds they took, leaving out any setup.
+ * items is set to the number of points, pixels or entries that one operation handles.
+ */
+typedef double (*BenchmarkFunction)(const Benchmark &benchmark, unsigned long long iterations, double &items);
+
+struct Benchmark {
+    std::string name;
+    BenchmarkFunction run;
+    Projection *projection;
+    // Table generator of the tables benchmarks
+    bool (*generate)();
+    std::string filename;
+    const PadCase *pad;
+};
+
+struct BenchmarkResult {
+    unsigned long long iterations;
+    double items;
+    // Nanoseconds per operation of every sample, sorted
+    std::vector<double> samples;
+};
+
+// Results are added up here so that the compiler cannot leave out the work
+static volatile double sink;
+
+// The same points on every run, so that runs can be compared
+static const std::size_t point_count = point_chunk_size;
+static std::vector<double> map_points;
+static std::vector<double> lonlat_points;
+
+static double elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static void prepare_points() {
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> unit(-1, 1);
+    map_points.resize(2 * point_count);
+    lonlat_points.resize(2 * point_count);
+    for (std::size_t i = 0; i < point_count; i++) {
+        map_points[2 * i] = unit(random);
+        map_points[2 * i + 1] = unit(random);
+        lonlat_points[2 * i] = unit(random) * PI;
+        // Uniform on the sphere, rather than bunched up at the poles
+        lonlat_points[2 * i + 1] = std::asin(unit(random));
+    }
+}
+
+static double run_xy_to_uv(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    items = 1;
+    double sum = 0;
+    Clock::time_point start = Clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        std::size_t j = i % point_count;
+        double u, v;
+        if (benchmark.projection->xy_to_uv(map_points[2 * j], map_points[2 * j + 1], u, v)) {
+            sum += u + v;
+        }
+    }
+    double ns = elapsed_ns(start);
+    sink = sink + sum;
+    return ns;
+}
+
+static double run_uv_to_xy(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    items = 1;
+    double sum = 0;
+    Clock::time_point start = Clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        std::size_t j = i % point_count;
+        double x, y;
+        if (benchmark.projection->uv_to_xy(lonlat_points[2 * j], lonlat_points[2 * j + 1], x, y)) {
+            sum += x + y;
+        }
+    }
+    double ns = elapsed_ns(start);
+    sink = sink + sum;
+    return ns;
+}
+
+/**
+ * A rotation that moves every point, so that the batched conversions do the same work as with a rotated view.
+ */
+static PointTransform get_point_transform(Projection *projection) {
+    PointTransform transform = {projection, true, {}, false};
+    double a = 0.5, b = 0.3;
+    double rotation[9] = {
+        std::cos(a), 0, std::sin(a),
+        std::sin(a) * std::sin(b), std::cos(b), -std::cos(a) * std::sin(b),
+        -std::sin(a) * std::cos(b), std::sin(b), std::cos(a) * std::cos(b)
+    };
+    std::copy(rotation, rotation + 9, transform.rotation);
+    return transform;
+}
+
+static double run_lonlat_to_map(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    items = point_count;
+    PointTransform transform = get_point_transform(benchmark.projection);
+    std::vector<double> output(2 * point_count);
+    std::size_t failed = 0;
+    Clock::time_point start = Clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        failed += lonlat_to_map(transform, lonlat_points.data(), output.data(), point_count);
+    }
+    double ns = elapsed_ns(start);
+    sink = sink + failed + output[0];
+    return ns;
+}
+
+static double run_map_to_lonlat(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    items = point_count;
+    PointTransform transform = get_point_transform(benchmark.projection);
+    std::vector<double> output(2 * point_count);
+    std::size_t failed = 0;
+    Clock::time_point start = Clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        failed += map_to_lonlat(transform, map_points.data(), output.data(), point_count);
+    }
+    double ns = elapsed_ns(start);
+    sink = sink + failed + output[0];
+    return ns;
+}
+
+static double run_table(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    items = 1;
+    bool ok = true;
+    Clock::time_point start = Clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        ok = benchmark.generate() && ok;
+    }
+    double ns = elapsed_ns(start);
+    sink = sink + ok;
+    return ns;
+}
+
+/**
+ * Crop and pad an image of the benchmark's size the way load_texture does.
+ * Only pad_image is timed, not making the copy of the image that it replaces.
+ */
+static double run_pad_image(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    const PadCase &pad = *benchmark.pad;
+    const unsigned int width = pad.width;
+    const unsigned int height = pad.height;
+    std::vector<unsigned char> source((std::size_t) width * height * 3);
+    for (std::size_t i = 0; i < source.size(); i++) {
+        source[i] = i * 2654435761u >> 24;
+    }
+    items = (double) width * height;
+
+    double ns = 0;
+    for (unsigned long long i = 0; i < iterations; i++) {
+        Image image = {width, height, 3, new unsigned char[source.size()]};
+        std::memcpy(image.data, source.data(), source.size());
+        float sx, sy;
+        Clock::time_point start = Clock::now();
+        pad_image(image, pad.x, pad.y, pad.w, pad.h, sx, sy);
+        ns += elapsed_ns(start);
+        sink = sink + image.data[image.width * image.height * 3 - 1] + sx + sy;
+        free_image(image);
+    }
+    return ns;
+}
+
+static double run_decode(const Benchmark &benchmark, unsigned long long iterations, double &items) {
+    items = 0;
+    double ns = 0;
+    for (unsigned long long i = 0; i < iterations; i++) {
+        Image image;
+        Clock::time_point start = Clock::now();
+        bool ok = load_image(benchmark.filename, image);
+        ns += elapsed_ns(start);
+        if (!ok) {
+            return -1;
+        }
+        items = (double) image.width * image.height;
+        sink = sink + image.data[0];
+        free_image(image);
+    }
+    return ns;
+}
+
+/**
+ * The directory of the decoding benchmarks: --images, or else res/images in the current directory, or next to the
+ * executable, where the build copies res.
+ */
+static std::filesystem::path find_images(const BenchOptions &options, const char *argv0) {
+    if (!options.images.empty()) {
+        return options.images;
+    }
+    std::error_code error;
+    if (std::filesystem::is_directory("res/images", error)) {
+        return "res/images";
+    }
+    std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", error);
+    if (error) {
+        executable = std::filesystem::absolute(argv0, error);
+    }
+    return executable.parent_path() / "res" / "images";
+}
+
+static void add_benchmarks(std::vector<Benchmark> &benchmarks, const std::filesystem::path &images) {
+    for (Projection *projection : projections) {
+        benchmarks.push_back({"xy_to_uv/" + projection->shader, run_xy_to_uv, projection, nullptr, "", nullptr});
+        benchmarks.push_back({"uv_to_xy/" + projection->shader, run_uv_to_xy, projection, nullptr, "", nullptr});
+    }
+    for (Projection *projection : projections) {
+        benchmarks.push_back({"map_to_lonlat/" + projection->shader, run_map_to_lonlat, projection, nullptr, "", nullptr});
+        benchmarks.push_back({"lonlat_to_map/" + projection->shader, run_lonlat_to_map, projection, nullptr, "", nullptr});
+    }
+    benchmarks.push_back({"tables/mollweide", run_table, nullptr, mollweide_generate_values, "", nullptr});
+    benchmarks.push_back({"tables/robinson", run_table, nullptr, robinson_generate_values, "", nullptr});
+    benchmarks.push_back({"tables/winkel", run_table, nullptr, winkel_generate_values, "", nullptr});
+    benchmarks.push_back({"pad_image", run_pad_image, nullptr, nullptr, "", &pad_whole});
+    benchmarks.push_back({"pad_image/crop", run_pad_image, nullptr, nullptr, "", &pad_cropped});
+
+    // Sorted, so that the names stay the same from run to run
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator(images, error)) {
+        std::string extension = entry.path().extension().string();
+        if (extension == ".jpg" || extension == ".jpeg" || extension == ".png") {
+            files.push_back(entry.path());
+        }
+    }
+    if (error) {
+        std::cerr << "Failed to list " << images.string() << ", skipping the decoding benchmarks: " << error.message() << std::endl;
+    }
+    std::sort(files.begin(), files.end());
+    for (const std::filesystem::path &file : files) {
+        benchmarks.push_back({"decode/" + file.filename().string(), run_decode, nullptr, nullptr, file.string(), nullptr});
+    }
+}
+
+/**
+ * Find the number of iterations that takes at least min_time, which also warms up the caches and the lookup tables,
+ * then time every sample with that number of iterations.
+ */
+static bool run_benchmark(const Benchmark &benchmark, const BenchOptions &options, BenchmarkResult &result) {
+    double min_ns = options.min_time * 1e6;
+    unsigned long long iterations = 1;
+    while (true) {
+        double ns = benchmark.run(benchmark, iterations, result.items);
+        if (ns < 0) {
+            return false;
+        }
+        if (ns >= min_ns) {
+            break;
+        }
+        // Aim a bit over the minimum, but never grow by more than 10x at once
+        double factor = ns > 0 ? min_ns * 1.2 / ns : 10;
+        iterations = std::max(iterations + 1, (unsigned long long) (iterations * std::min(factor, 10.0)));
+    }
+
+    result.iterations = iterations;
+    result.samples.clear();
+    for (unsigned int i = 0; i < options.samples; i++) {
+        double ns = benchmark.run(benchmark, iterations, result.items);
+        if (ns < 0) {
+            return false;
+        }
+        result.samples.push_back(ns / iterations);
+    }
+    std::sort(result.samples.begin(), result.samples.end());
+    return true;
+}
+
+static double get_median(const std::vector<double> &sorted) {
+    std::size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/**
+ * The median absolute deviation, which unlike the standard deviation is not thrown off by a single preempted sample.
+ */
+static double get_mad(const std::vector<double> &sorted, double median) {
+    std::vector<double> deviations;
+    for (double sample : sorted) {
+        deviations.push_back(std::abs(sample - median));
+    }
+    std::sort(deviations.begin(), deviations.end());
+    return get_median(deviations);
+}
+
+static void write_result(std::ostream &out, const Benchmark &benchmark, const BenchmarkResult &result, bool first) {
+    double median = get_median(result.samples);
+    out << (first ? "" : ",\n") << "    {\"name\": \"" << benchmark.name << "\""
+        << ", \"iterations\": " << result.iterations
+        << ", \"samples\": " << result.samples.size()
+        << ", \"median_ns\": " << median
+        << ", \"min_ns\": " << result.samples.front()
+        << ", \"max_ns\": " << result.samples.back()
+        << ", \"mad_ns\": " << get_mad(result.samples, median)
+        << ", \"items_per_op\": " << result.items
+        << ", \"ns_per_item\": " << (result.items > 0 ? median / result.items : 0)
+        << "}";
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    if (!parse_bench_options(argc, argv, options)) {
+        print_bench_usage();
+        return 1;
+    }
+
+    std::vector<Benchmark> all;
+    add_benchmarks(all, find_images(options, argv[0]));
+    std::vector<Benchmark> benchmarks;
+    for (const Benchmark &benchmark : all) {
+        if (benchmark.name.find(options.filter) != std::string::npos) {
+            benchmarks.push_back(benchmark);
+        }
+    }
+
+    if (options.list) {
+        for (const Benchmark &benchmark : benchmarks) {
+            std::cout << benchmark.name << std::endl;
+        }
+        return 0;
+    }
+
+    prepare_points();
+    if (!prepare_cpu_conversions()) {
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (file.fail()) {
+            std::cerr << "Failed to open " << options.output << " for writing" << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = options.output.empty() ? std::cout : file;
+    out.precision(6);
+
+    int exit_code = 0;
+    bool first = true;
+    out << "{\n  \"samples\": " << options.samples << ",\n  \"min_time_ms\": " << options.min_time << ",\n  \"benchmarks\": [\n";
+    for (const Benchmark &benchmark : benchmarks) {
+        BenchmarkResult result;
+        if (!run_benchmark(benchmark, options, result)) {
+            std::cerr << "Failed to run " << benchmark.name << std::endl;
+            exit_code = 1;
+            continue;
+        }
+        write_result(out, benchmark, result, first);
+        first = false;
+        std::cerr << benchmark.name << ": " << get_median(result.samples) << " ns" << std::endl;
+    }
+    out << "\n  ]\n}\n";
+
+    return exit_code;
+}
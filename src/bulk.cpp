@@ -0,0 +1,334 @@
+#include "bulk.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "images.h"
+#include "mapper.h"
+#include "options.h"
+#include "pipeline.h"
+#include "projection.h"
+#include "reproject.h"
+#include "stream.h"
+
+// Magic constant
+const double PI = 3.141592653589793238462;
+
+/**
+ * Output images are reprojected in bands of this many rows, so that even a single image is spread over all threads.
+ */
+static const unsigned int band_rows = 32;
+
+struct BulkInput {
+    ReprojectInput input;
+    Projection *source;
+    std::string output_filename;
+};
+
+/**
+ * An image that is moving through the pipeline. The last thread to finish a band passes it on to encoding.
+ */
+struct BulkImage {
+    const BulkInput *input;
+    Reprojection reprojection;
+    Image source;
+    Image output;
+    // Per pixel, only for --cost-heatmap
+    std::vector<uint32_t> costs;
+    std::atomic<unsigned int> bands_left;
+};
+
+struct Band {
+    std::shared_ptr<BulkImage> image;
+    unsigned int first_row;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool is_image_file(const std::filesystem::path &path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png";
+}
+
+static std::string get_normal_path(const std::string &filename) {
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::absolute(filename, error);
+    return (error ? std::filesystem::path(filename) : path).lexically_normal().string();
+}
+
+/**
+ * Outputs are named after their inputs without the directory and extension, so refuse inputs that would end up in the
+ * same output file, like a.jpg next to a.png or two directories with the same names in them, or overwrite an input.
+ */
+static bool check_output_names(const std::vector<BulkInput> &inputs) {
+    std::map<std::string, const BulkInput *> outputs;
+    std::map<std::string, const BulkInput *> sources;
+    for (const BulkInput &input : inputs) {
+        sources[get_normal_path(input.input.filename)] = &input;
+    }
+    for (const BulkInput &input : inputs) {
+        std::string output = get_normal_path(input.output_filename);
+        auto source = sources.find(output);
+        if (source != sources.end()) {
+            std::cerr << "The output of " << input.input.filename << " would overwrite the input " << source->second->input.filename << std::endl;
+            return false;
+        }
+        auto other = outputs.emplace(output, &input);
+        if (!other.second) {
+            std::cerr << "Both " << other.first->second->input.filename << " and " << input.input.filename << " would be written to " << input.output_filename << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Resolve the projections and expand directories into the images inside them, sorted by name.
+ */
+static bool collect_inputs(const ReprojectOptions &options, std::vector<BulkInput> &inputs) {
+    for (const ReprojectInput &input : options.inputs) {
+        Projection *source = find_projection(input.source);
+        if (!source) {
+            std::cerr << "Unknown projection: " << input.source << std::endl;
+            return false;
+        }
+
+        std::vector<std::filesystem::path> files;
+        std::error_code error;
+        if (std::filesystem::is_directory(input.filename, error)) {
+            for (const auto &entry : std::filesystem::directory_iterator(input.filename, error)) {
+                if (entry.is_regular_file() && is_image_file(entry.path())) {
+                    files.push_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+        } else {
+            files.push_back(input.filename);
+        }
+        if (error) {
+            std::cerr << "Failed to read " << input.filename << ": " << error.message() << std::endl;
+            return false;
+        }
+
+        for (const std::filesystem::path &file : files) {
+            BulkInput bulk_input = {input, source, ""};
+            bulk_input.input.filename = file.string();
+            bulk_input.output_filename = (std::filesystem::path(options.out_dir) / file.stem()).string() + "." + options.format;
+            inputs.push_back(bulk_input);
+        }
+    }
+
+    if (inputs.empty()) {
+        std::cerr << "No images found in the inputs" << std::endl;
+        return false;
+    }
+
+    return check_output_names(inputs);
+}
+
+int run_reproject_command(int argc, char **argv) {
+    ReprojectOptions options;
+    if (!parse_reproject_options(argc, argv, options)) {
+        print_reproject_usage();
+        return 1;
+    }
+
+    Projection *output = find_projection(options.projection);
+    if (!output) {
+        std::cerr << "Unknown projection: " << options.projection << std::endl;
+        return 1;
+    }
+
+    std::vector<BulkInput> inputs;
+    if (!collect_inputs(options, inputs)) {
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.out_dir, error);
+    if (error) {
+        std::cerr << "Failed to create " << options.out_dir << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    unsigned int width = options.width;
+    unsigned int height = options.height;
+    if (height == 0) {
+        height = std::max(1.0, width * output->height / output->width + 0.5);
+    }
+
+    Reprojection base = {
+        .source = nullptr,
+        .output = output,
+        .rotation = {},
+        .zoom = options.zoom,
+        .bilinear = options.bilinear
+    };
+    set_rotation(options.longitude * PI / 180, options.latitude * PI / 180, options.roll * PI / 180);
+    get_rotation(base.rotation);
+
+    // The lookup tables are generated lazily, so generate them before any thread can race on them
+    if (!prepare_cpu_conversions()) {
+        return 1;
+    }
+
+    unsigned int threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (options.stream) {
+        unsigned int failed = 0;
+        for (const BulkInput &input : inputs) {
+            base.source = input.source;
+            if (!reproject_stream(base, input.input, input.output_filename, width, height, options.band_rows, options.cache_rows, threads)) {
+                failed++;
+            }
+        }
+        return failed == 0 ? 0 : 1;
+    }
+
+    // Decoding and encoding are single threaded per image, so they get their own pools
+    unsigned int coders = std::max(1u, threads / 2);
+
+    // Every queue is bounded, so a slow stage stops the ones before it instead of piling up images in memory
+    BoundedQueue<std::shared_ptr<BulkImage>> decoded(2);
+    BoundedQueue<Band> bands(threads * 2);
+    BoundedQueue<std::shared_ptr<BulkImage>> reprojected(2);
+
+    std::atomic<unsigned int> next_input(0);
+    std::atomic<unsigned int> failures(0);
+    std::atomic<unsigned int> written(0);
+    std::atomic<long long> input_pixels(0);
+
+    Clock::time_point start = Clock::now();
+
+    std::vector<std::thread> decoders;
+    for (unsigned int i = 0; i < coders; i++) {
+        decoders.emplace_back([&]() {
+            unsigned int index;
+            while ((index = next_input++) < inputs.size()) {
+                const BulkInput &input = inputs[index];
+                std::shared_ptr<BulkImage> image = std::make_shared<BulkImage>();
+                image->input = &input;
+                image->reprojection = base;
+                image->reprojection.source = input.source;
+
+                if (!load_image(input.input.filename, image->source)) {
+                    failures++;
+                    continue;
+                }
+                if (!crop_image(image->source, input.input.x, input.input.y, input.input.w, input.input.h)) {
+                    std::cerr << "Failed to crop " << input.input.filename << std::endl;
+                    free_image(image->source);
+                    failures++;
+                    continue;
+                }
+                input_pixels += (long long) image->source.width * image->source.height;
+
+                if (!decoded.push(image)) {
+                    free_image(image->source);
+                    break;
+                }
+            }
+        });
+    }
+
+    // Splits decoded images into bands, more than one image can be in flight at a time
+    std::thread splitter([&]() {
+        std::shared_ptr<BulkImage> image;
+        while (decoded.pop(image)) {
+            image->output.width = width;
+            image->output.height = height;
+            image->output.channels = image->source.channels == 1 && !options.cost_heatmap ? 1 : 3;
+            if (options.cost_heatmap) {
+                image->costs.resize((std::size_t) width * height);
+            }
+            image->output.data = new unsigned char[(std::size_t) width * height * image->output.channels];
+            image->bands_left = (height + band_rows - 1) / band_rows;
+
+            for (unsigned int row = 0; row < height; row += band_rows) {
+                bands.push({image, row});
+            }
+        }
+        bands.close();
+    });
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            Band band;
+            while (bands.pop(band)) {
+                BulkImage &image = *band.image;
+                if (options.cost_heatmap) {
+                    reproject_cost_rows(image.reprojection, image.source, image.output, image.costs.data(), band.first_row, band_rows);
+                } else {
+                    reproject_rows(image.reprojection, image.source, image.output, band.first_row, band_rows);
+                }
+                if (--image.bands_left == 0) {
+                    free_image(image.source);
+                    image.source.data = nullptr;
+                    if (options.cost_heatmap) {
+                        uint32_t red = paint_cost_heatmap(image.costs.data(), image.output);
+                        std::cout << image.input->output_filename << ": red is " << red << " " << get_cost_unit() << " per pixel" << std::endl;
+                        image.costs = std::vector<uint32_t>();
+                    }
+                    reprojected.push(band.image);
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> encoders;
+    for (unsigned int i = 0; i < coders; i++) {
+        encoders.emplace_back([&]() {
+            std::shared_ptr<BulkImage> image;
+            while (reprojected.pop(image)) {
+                if (save_image(image->input->output_filename, image->output)) {
+                    written++;
+                } else {
+                    failures++;
+                }
+                free_image(image->output);
+                image->output.data = nullptr;
+            }
+        });
+    }
+
+    for (std::thread &thread : decoders) {
+        thread.join();
+    }
+    decoded.close();
+    splitter.join();
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    reprojected.close();
+    for (std::thread &thread : encoders) {
+        thread.join();
+    }
+
+    double elapsed = seconds_since(start);
+    double input_mp = input_pixels / 1e6;
+    double output_mp = written * (double) width * height / 1e6;
+    std::cout << "Reprojected " << written << " of " << inputs.size() << " images to " << width << "x" << height
+              << " in " << elapsed << " s with " << threads << " threads" << std::endl;
+    std::cout << "  " << written / elapsed << " images/s, " << input_mp / elapsed << " MP/s read, "
+              << output_mp / elapsed << " MP/s written" << std::endl;
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#ifndef BULK_H
+#define BULK_H
+
+/**
+ * Run the reproject command, given the arguments starting from "reproject".
+ * Images are decoded, reprojected on the CPU and encoded in a pipeline, so no OpenGL context is needed.
+ * Returns the exit code.
+ */
+int run_reproject_command(int argc, char **argv);
+
+#endif
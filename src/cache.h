@@ -0,0 +1,110 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstddef>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+enum CacheResult {
+    CACHE_HIT,
+    CACHE_MISS,
+    // Missed, but another thread was already creating the value and it was waited for
+    CACHE_COALESCED
+};
+
+/**
+ * A thread safe cache that drops the least recently used values once their total cost is over the capacity.
+ * Values are shared pointers, so a value that is dropped stays valid for whoever is still using it.
+ */
+template <typename V>
+class LruCache {
+public:
+    explicit LruCache(std::size_t capacity) : capacity(capacity), used(0) {}
+
+    /**
+     * Return the value for the key, creating it with create if it is not in the cache.
+     * create is called as create(cost) and returns the value, or nullptr on failure, and sets its cost.
+     * If several threads miss the same key at the same time, only the first one creates the value and the others wait for it.
+     * Failures are not cached, so the next request tries again.
+     */
+    template <typename F>
+    std::shared_ptr<const V> get_or_create(const std::string &key, F create, CacheResult &result) {
+        std::promise<std::shared_ptr<const V>> promise;
+        std::shared_future<std::shared_ptr<const V>> other;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = entries.find(key);
+            if (found != entries.end()) {
+                order.splice(order.begin(), order, found->second);
+                result = CACHE_HIT;
+                return found->second->value;
+            }
+
+            auto pending_found = pending.find(key);
+            if (pending_found != pending.end()) {
+                other = pending_found->second;
+            } else {
+                pending[key] = promise.get_future().share();
+            }
+        }
+
+        if (other.valid()) {
+            result = CACHE_COALESCED;
+            return other.get();
+        }
+
+        result = CACHE_MISS;
+        std::size_t cost = 0;
+        std::shared_ptr<const V> value = create(cost);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.erase(key);
+            if (value) {
+                insert(key, value, cost);
+            }
+        }
+        promise.set_value(value);
+        return value;
+    }
+
+    void get_usage(std::size_t &count, std::size_t &cost) {
+        std::lock_guard<std::mutex> lock(mutex);
+        count = entries.size();
+        cost = used;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const V> value;
+        std::size_t cost;
+    };
+
+    void insert(const std::string &key, std::shared_ptr<const V> value, std::size_t cost) {
+        order.push_front({key, value, cost});
+        entries[key] = order.begin();
+        used += cost;
+        // The newest value is always kept, even if it alone is over the capacity
+        while (used > capacity && order.size() > 1) {
+            used -= order.back().cost;
+            entries.erase(order.back().key);
+            order.pop_back();
+        }
+    }
+
+    std::size_t capacity;
+    std::size_t used;
+    // Most recently used first
+    std::list<Entry> order;
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> entries;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<const V>>> pending;
+    std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "export.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "images.h"
+#include "pipeline.h"
+#include "renderer.h"
+
+/**
+ * The poster is rendered in bands of rows, each split into tiles no wider than max_tile_width.
+ * Only band_count bands exist at once, so memory stays at a few bands no matter the poster size.
+ */
+static const int tile_height = 256;
+static const int max_tile_width = 4096;
+static const int band_count = 3;
+
+struct Band {
+    unsigned int y;
+    unsigned int rows;
+    std::vector<unsigned char> data;
+};
+
+/**
+ * A tile that has been read into a pixel buffer but not yet copied out of it.
+ */
+struct PendingTile {
+    GLuint pbo;
+    Band *band;
+    int x, w, h;
+    bool last_in_band;
+};
+
+static void write_bands(ImageWriter &writer, BoundedQueue<Band *> &full_bands, BoundedQueue<Band *> &free_bands, std::atomic<bool> &failed) {
+    Band *band;
+    while (full_bands.pop(band)) {
+        if (!failed && !write_image_rows(writer, band->data.data(), band->rows)) {
+            failed = true;
+        }
+        free_bands.push(band);
+    }
+}
+
+/**
+ * Copy a tile out of its pixel buffer into its band, flipping it since OpenGL reads rows bottom up.
+ */
+static void finish_tile(const PendingTile &tile, unsigned int width, BoundedQueue<Band *> &full_bands) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tile.pbo);
+    const unsigned char *pixels = (const unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, tile.w * tile.h * 3, GL_MAP_READ_BIT);
+    if (pixels) {
+        for (int i = 0; i < tile.h; i++) {
+            std::memcpy(tile.band->data.data() + ((tile.h - 1 - i) * width + tile.x) * 3, pixels + i * tile.w * 3, tile.w * 3);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        std::cerr << "Failed to map pixel buffer for tile at " << tile.x << ", " << tile.band->y << std::endl;
+    }
+
+    if (tile.last_in_band) {
+        full_bands.push(tile.band);
+    }
+}
+
+bool export_poster(const std::string &filename, unsigned int width, unsigned int height) {
+    if (height == 0) {
+        height = (unsigned int) (width * get_frame_aspect_ratio());
+    }
+
+    GLint max_size;
+    GLint max_viewport[2];
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_size);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+    int tile_width = std::min({(int) width, max_tile_width, (int) max_size, (int) max_viewport[0]});
+    int tile_rows = std::min({(int) height, tile_height, (int) max_size, (int) max_viewport[1]});
+
+    ImageWriter writer;
+    if (!open_image_writer(filename, width, height, 3, writer)) {
+        std::cerr << "Failed to open " << filename << " for the poster!" << std::endl;
+        return false;
+    }
+
+    std::cout << "Exporting " << width << "x" << height << " poster to " << filename << std::endl;
+    auto start = std::chrono::steady_clock::now();
+
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, tile_width, tile_rows);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+    GLuint pbos[2];
+    glGenBuffers(2, pbos);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, tile_width * tile_rows * 3, NULL, GL_STREAM_READ);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    bool result = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!result) {
+        std::cerr << "Failed to create the framebuffer for poster tiles!" << std::endl;
+    }
+
+    std::vector<Band> bands(band_count);
+    BoundedQueue<Band *> free_bands(band_count);
+    BoundedQueue<Band *> full_bands(band_count);
+    for (Band &band : bands) {
+        band.data.resize(width * tile_rows * 3);
+        free_bands.push(&band);
+    }
+
+    std::atomic<bool> failed(false);
+    std::thread writer_thread(write_bands, std::ref(writer), std::ref(full_bands), std::ref(free_bands), std::ref(failed));
+
+    // The read of one tile is only waited for after the next tile has been queued, so the GPU never sits idle
+    PendingTile pending;
+    bool has_pending = false;
+    int next_pbo = 0;
+    unsigned int last_progress = 0;
+
+    for (unsigned int y = 0; result && y < height && !failed; y += tile_rows) {
+        Band *band;
+        free_bands.pop(band);
+        band->y = y;
+        band->rows = std::min((unsigned int) tile_rows, height - y);
+
+        for (unsigned int x = 0; x < width; x += tile_width) {
+            int w = std::min((unsigned int) tile_width, width - x);
+
+            render_map_tile(width, height, x, y, w, band->rows);
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next_pbo]);
+            glReadPixels(0, 0, w, band->rows, GL_RGB, GL_UNSIGNED_BYTE, 0);
+
+            if (has_pending) {
+                finish_tile(pending, width, full_bands);
+            }
+            pending = {pbos[next_pbo], band, (int) x, w, (int) band->rows, x + w >= width};
+            has_pending = true;
+            next_pbo ^= 1;
+        }
+
+        unsigned int progress = (y + band->rows) * 10 / height;
+        if (progress != last_progress) {
+            std::cout << "Poster " << progress * 10 << "% done" << std::endl;
+            last_progress = progress;
+        }
+    }
+    if (has_pending) {
+        finish_tile(pending, width, full_bands);
+    }
+
+    full_bands.close();
+    writer_thread.join();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(2, pbos);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    result = close_image_writer(writer) && result && !failed;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (result) {
+        std::cout << "Exported poster to " << filename << " in " << elapsed.count() << "s" << std::endl;
+    } else {
+        std::cerr << "Failed to export poster to " << filename << std::endl;
+    }
+    return result;
+}
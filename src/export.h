@@ -0,0 +1,12 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <string>
+
+/**
+ * Render the current view into an image of any size, one tile at a time.
+ * If height is 0, it is picked to fit the output projection.
+ */
+bool export_poster(const std::string &filename, unsigned int width, unsigned int height);
+
+#endif
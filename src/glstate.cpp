@@ -0,0 +1,135 @@
+#include "glstate.h"
+
+#include <iostream>
+
+#include <GL/glew.h>
+#include "GL/glext.h"
+#include "GL/gl.h"
+
+struct TextureUnit {
+    GLuint texture_1d;
+    GLuint texture_2d;
+    GLuint texture_2d_array;
+};
+
+static const unsigned int unit_count = 16;
+static const unsigned int uniform_binding_count = 8;
+
+// A fresh context has nothing bound, except for the viewport, which starts out at the size of the window
+static GLuint current_program = 0;
+static unsigned int active_unit = 0;
+static TextureUnit units[unit_count] = {};
+static GLuint current_vertex_array = 0;
+static GLuint uniform_buffers[uniform_binding_count] = {};
+static GLint viewport[4];
+static bool viewport_known = false;
+
+void use_program(GLuint program) {
+    if (program != current_program) {
+        glUseProgram(program);
+        current_program = program;
+    }
+}
+
+void forget_program(GLuint program) {
+    if (program == current_program) {
+        glUseProgram(0);
+        current_program = 0;
+    }
+}
+
+static GLuint *get_texture_binding(unsigned int unit, GLenum target) {
+    if (unit >= unit_count) {
+        return nullptr;
+    }
+    switch (target) {
+        case GL_TEXTURE_1D:
+            return &units[unit].texture_1d;
+        case GL_TEXTURE_2D:
+            return &units[unit].texture_2d;
+        case GL_TEXTURE_2D_ARRAY:
+            return &units[unit].texture_2d_array;
+        default:
+            return nullptr;
+    }
+}
+
+void bind_texture(unsigned int unit, GLenum target, GLuint texture) {
+    GLuint *binding = get_texture_binding(unit, target);
+    if (binding && *binding == texture) {
+        return;
+    }
+    if (unit != active_unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+    }
+    glBindTexture(target, texture);
+    if (binding) {
+        *binding = texture;
+    }
+}
+
+void forget_texture(GLuint texture) {
+    for (TextureUnit &unit : units) {
+        if (unit.texture_1d == texture) {
+            unit.texture_1d = 0;
+        }
+        if (unit.texture_2d == texture) {
+            unit.texture_2d = 0;
+        }
+        if (unit.texture_2d_array == texture) {
+            unit.texture_2d_array = 0;
+        }
+    }
+}
+
+void bind_vertex_array(GLuint vertex_array) {
+    if (vertex_array != current_vertex_array) {
+        glBindVertexArray(vertex_array);
+        current_vertex_array = vertex_array;
+    }
+}
+
+void bind_uniform_buffer(GLuint binding, GLuint buffer) {
+    if (binding < uniform_binding_count && uniform_buffers[binding] == buffer) {
+        return;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    if (binding < uniform_binding_count) {
+        uniform_buffers[binding] = buffer;
+    }
+}
+
+void set_viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if (viewport_known && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+        return;
+    }
+    glViewport(x, y, width, height);
+    viewport[0] = x;
+    viewport[1] = y;
+    viewport[2] = width;
+    viewport[3] = height;
+    viewport_known = true;
+}
+
+#ifdef GL_DEBUG
+static void GLAPIENTRY print_debug_message(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *user) {
+    if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) {
+        return;
+    }
+    std::cerr << "OpenGL " << (type == GL_DEBUG_TYPE_ERROR ? "error" : "warning") << " " << id << ": " << message << std::endl;
+}
+#endif
+
+void enable_gl_debug_output() {
+#ifdef GL_DEBUG
+    if (!GLEW_KHR_debug) {
+        std::cerr << "KHR_debug is not supported, only checking glGetError" << std::endl;
+        return;
+    }
+    glEnable(GL_DEBUG_OUTPUT);
+    // Report errors from inside the call that caused them, so that they show up in a debugger's stack trace
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(print_debug_message, nullptr);
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+/**
+ * Cache of the OpenGL bindings that change from frame to frame, so that calls which would not change anything never
+ * reach the driver. The cache assumes a single context whose programs, texture bindings, vertex arrays, uniform
+ * buffer bindings and viewport are only ever changed through these functions.
+ */
+
+void use_program(GLuint program);
+
+/**
+ * Forget program if it is in use, before deleting it, as its name can be reused by the next program created.
+ */
+void forget_program(GLuint program);
+
+/**
+ * Bind texture to target of texture unit, which only makes the unit active if the binding changes.
+ * Only 1D, 2D and 2D array textures on the first 16 units are cached.
+ */
+void bind_texture(unsigned int unit, GLenum target, GLuint texture);
+
+/**
+ * Forget every binding of texture, before deleting it, as its name can be reused by the next texture created.
+ */
+void forget_texture(GLuint texture);
+
+void bind_vertex_array(GLuint vertex_array);
+void bind_uniform_buffer(GLuint binding, GLuint buffer);
+void set_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+/**
+ * Report errors and warnings from the driver through KHR_debug as they happen, in builds with GL_DEBUG defined.
+ */
+void enable_gl_debug_output();
+
+#ifdef GL_DEBUG
+#include <iostream>
+
+#define ERR(CODE)                                               \
+    CODE                                                        \
+    {GLenum last_error;                                         \
+    while ((last_error = glGetError()) != GL_NO_ERROR) {        \
+        std::cerr << "Executing line:" << std::endl;            \
+        std::cerr << #CODE << std::endl;                        \
+        std::cerr << "Got error: " << last_error << std::endl;  \
+    }}
+#else
+// Every glGetError waits for the driver, which costs more than the calls themselves on slow machines
+#define ERR(CODE) CODE
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+#include "headless.h"
+
+#include <iostream>
+
+#ifdef HAVE_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#ifndef EGL_CONTEXT_OPENGL_DEBUG
+#define EGL_CONTEXT_OPENGL_DEBUG 0x31B0
+#endif
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+/**
+ * Prefer Mesa's surfaceless platform, which works without a GPU through llvmpipe,
+ * but fall back to the default display for drivers that do not have it.
+ */
+static EGLDisplay get_display() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display) {
+        EGLDisplay surfaceless = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (surfaceless != EGL_NO_DISPLAY) {
+            return surfaceless;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool create_headless_context() {
+    display = get_display();
+    if (display == EGL_NO_DISPLAY) {
+        std::cerr << "Failed to get an EGL display!" << std::endl;
+        return false;
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(display, &major, &minor)) {
+        std::cerr << "Failed to initialize EGL, error " << eglGetError() << std::endl;
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL does not support desktop OpenGL!" << std::endl;
+        goto err;
+    }
+
+    {
+        // Nothing is rendered to an EGL surface, so any config works, or none at all with EGL_KHR_no_config_context
+        const EGLint config_attributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config = (EGLConfig) 0;
+        EGLint config_count = 0;
+        if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) {
+            config = (EGLConfig) 0;
+        }
+
+        const EGLint context_attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef GL_DEBUG
+            EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    }
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create an OpenGL 3.3 context, EGL error " << eglGetError() << std::endl;
+        goto err;
+    }
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "Failed to make the context current without a surface, EGL error " << eglGetError() << std::endl;
+        eglDestroyContext(display, context);
+        context = EGL_NO_CONTEXT;
+        goto err;
+    }
+
+    return true;
+
+err:
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+    return false;
+}
+
+void destroy_headless_context() {
+    if (display == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT) {
+        eglDestroyContext(display, context);
+        context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+}
+
+#else
+
+bool create_headless_context() {
+    std::cerr << "Headless rendering needs EGL, which this build does not have!" << std::endl;
+    return false;
+}
+
+void destroy_headless_context() {
+}
+
+#endif
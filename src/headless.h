@@ -0,0 +1,11 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+/**
+ * Create an OpenGL 3.3 core context without a window or display, using a surfaceless EGL context.
+ * Everything has to be rendered into framebuffer objects, since there is no default framebuffer.
+ */
+bool create_headless_context();
+void destroy_headless_context();
+
+#endif
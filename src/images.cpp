@@ -1,17 +1,25 @@
 #include "images.h"
 
+#include <algorithm>
 #include <string>
 #include <stdio.h>
 #include <iostream>
 
+#ifndef NO_OPENGL
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include "glstate.h"
+#endif
+
 #include <jpeglib.h>
 #include <jerror.h>
 #include <png.h>
 
+#include "stats.h"
+#include "trace.h"
+
 static bool load_jpeg(const std::string &filename, struct Image &image) {
     FILE *file = fopen(filename.c_str(), "rb");
 
@@ -39,9 +47,9 @@ static bool load_jpeg(const std::string &filename, struct Image &image) {
     image.height = info.output_height;
     image.channels = info.num_components;
 
-    image.data = new unsigned char[image.width * image.height * image.channels];
+    image.data = new unsigned char[(std::size_t) image.width * image.height * image.channels];
     while (info.output_scanline < image.height) {
-        rowptr[0] = image.data + info.output_scanline * image.channels * image.width;
+        rowptr[0] = image.data + (std::size_t) info.output_scanline * image.channels * image.width;
         jpeg_read_scanlines(&info, rowptr, 1);
     }
     jpeg_finish_decompress(&info);
@@ -120,7 +128,7 @@ static bool load_png(const std::string &filename, struct Image &image) {
     png_read_update_info(png_ptr, info_ptr);
 
     //png_get_rowbytes(png_ptr, info_ptr);
-    image.data = new unsigned char[image.width * image.height * image.channels];
+    image.data = new unsigned char[(std::size_t) image.width * image.height * image.channels];
     row_pointers = new png_bytep[image.height];
 
     if (setjmp(png_jmpbuf(png_ptr))) {
@@ -129,7 +137,7 @@ static bool load_png(const std::string &filename, struct Image &image) {
     }
 
     for (int y = 0; y < image.height; y++) {
-        row_pointers[y] = &image.data[y * image.width * image.channels];
+        row_pointers[y] = &image.data[(std::size_t) y * image.width * image.channels];
     }
 
     png_read_image(png_ptr, row_pointers);
@@ -150,13 +158,13 @@ error_png_header:
     return false;
 }
 
-bool load_image(const std::string &filename, struct Image &image) {
+static bool get_extension(const std::string &filename, std::string &ext) {
     std::size_t lp = filename.find_last_of('.');
     if (lp == std::string::npos) {
         std::cerr << "Could not determine file extension for " << filename << "!" << std::endl;
         return false;
     }
-    std::string ext = filename.substr(lp + 1);
+    ext = filename.substr(lp + 1);
 
     if (ext.size() > 4) {
         std::cerr << "Unknown image file extension: ." << ext << std::endl;
@@ -169,9 +177,20 @@ bool load_image(const std::string &filename, struct Image &image) {
         }
     }
 
+    return true;
+}
+
+bool load_image(const std::string &filename, struct Image &image) {
+    std::string ext;
+    if (!get_extension(filename, ext)) {
+        return false;
+    }
+
     if (ext == "jpg" || ext == "jpeg") {
+        TRACE_ZONE("load_jpeg");
         return load_jpeg(filename, image);
     } else if (ext == "png") {
+        TRACE_ZONE("load_png");
         return load_png(filename, image);
     }
 
@@ -183,6 +202,467 @@ void free_image(struct Image &image) {
     delete[] image.data;
 }
 
+// Png color types by number of channels
+static const int color_types[4] = {PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA};
+
+struct WriterState {
+    FILE *file;
+    bool png;
+
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    struct jpeg_compress_struct jpeg_info;
+    struct jpeg_error_mgr jpeg_err;
+};
+
+static bool open_png_writer(WriterState *state, struct ImageWriter &writer) {
+
+    state->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!state->png_ptr) {
+        std::cerr << "Failed to create png write struct" << std::endl;
+        return false;
+    }
+
+    state->info_ptr = png_create_info_struct(state->png_ptr);
+    if (!state->info_ptr) {
+        std::cerr << "Failed to set up png info struct" << std::endl;
+        png_destroy_write_struct(&state->png_ptr, NULL);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(state->png_ptr))) {
+        std::cerr << "Failed to prepare writing png file" << std::endl;
+        png_destroy_write_struct(&state->png_ptr, &state->info_ptr);
+        return false;
+    }
+
+    png_init_io(state->png_ptr, state->file);
+    png_set_IHDR(state->png_ptr, state->info_ptr, writer.width, writer.height, 8, color_types[writer.channels - 1], PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Large images spend most of their time in zlib, and the default level is much slower for little gain
+    png_set_compression_level(state->png_ptr, 3);
+    png_write_info(state->png_ptr, state->info_ptr);
+
+    return true;
+}
+
+static bool open_jpeg_writer(WriterState *state, struct ImageWriter &writer) {
+    if (writer.channels != 1 && writer.channels != 3) {
+        std::cerr << "Can only write jpeg images with 1 or 3 channels, got " << (int) writer.channels << std::endl;
+        return false;
+    }
+
+    state->jpeg_info.err = jpeg_std_error(&state->jpeg_err);
+    jpeg_create_compress(&state->jpeg_info);
+    jpeg_stdio_dest(&state->jpeg_info, state->file);
+
+    state->jpeg_info.image_width = writer.width;
+    state->jpeg_info.image_height = writer.height;
+    state->jpeg_info.input_components = writer.channels;
+    state->jpeg_info.in_color_space = writer.channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+
+    jpeg_set_defaults(&state->jpeg_info);
+    jpeg_set_quality(&state->jpeg_info, 95, TRUE);
+    jpeg_start_compress(&state->jpeg_info, TRUE);
+
+    return true;
+}
+
+bool open_image_writer(const std::string &filename, unsigned int width, unsigned int height, unsigned char channels, struct ImageWriter &writer) {
+    std::string ext;
+    if (!get_extension(filename, ext)) {
+        return false;
+    }
+
+    if (ext != "png" && ext != "jpg" && ext != "jpeg") {
+        std::cerr << "Unknown image file extension: ." << ext << std::endl;
+        return false;
+    }
+
+    if (channels < 1 || channels > 4) {
+        std::cerr << "Cannot write an image with " << (int) channels << " channels" << std::endl;
+        return false;
+    }
+
+    writer.width = width;
+    writer.height = height;
+    writer.channels = channels;
+    writer.rows_written = 0;
+
+    WriterState *state = new WriterState;
+    state->png = ext == "png";
+    state->file = fopen(filename.c_str(), "wb");
+    if (!state->file) {
+        std::cerr << "Failed to open " << filename << " for writing!" << std::endl;
+        delete state;
+        return false;
+    }
+
+    if (!(state->png ? open_png_writer(state, writer) : open_jpeg_writer(state, writer))) {
+        fclose(state->file);
+        delete state;
+        return false;
+    }
+
+    writer.state = state;
+    return true;
+}
+
+bool write_image_rows(struct ImageWriter &writer, const unsigned char *data, unsigned int rows) {
+    WriterState *state = (WriterState *) writer.state;
+    if (writer.rows_written + rows > writer.height) {
+        std::cerr << "Tried to write more rows than the image has" << std::endl;
+        return false;
+    }
+
+    unsigned int stride = writer.width * writer.channels;
+    if (state->png) {
+        if (setjmp(png_jmpbuf(state->png_ptr))) {
+            std::cerr << "Failed to write png rows" << std::endl;
+            return false;
+        }
+        for (unsigned int i = 0; i < rows; i++) {
+            png_write_row(state->png_ptr, (png_const_bytep) (data + i * stride));
+        }
+    } else {
+        for (unsigned int i = 0; i < rows; i++) {
+            JSAMPROW row = (JSAMPROW) (data + i * stride);
+            jpeg_write_scanlines(&state->jpeg_info, &row, 1);
+        }
+    }
+
+    writer.rows_written += rows;
+    return true;
+}
+
+/**
+ * Write the end of a png file, apart from close_image_writer so that none of its locals are live across the setjmp.
+ */
+static bool end_png(WriterState *state) {
+    if (setjmp(png_jmpbuf(state->png_ptr))) {
+        std::cerr << "Failed to finish png file" << std::endl;
+        return false;
+    }
+    png_write_end(state->png_ptr, NULL);
+    return true;
+}
+
+bool close_image_writer(struct ImageWriter &writer) {
+    WriterState *state = (WriterState *) writer.state;
+    bool result = writer.rows_written == writer.height;
+    if (!result) {
+        std::cerr << "Closing image after only " << writer.rows_written << " of " << writer.height << " rows" << std::endl;
+    }
+
+    if (state->png) {
+        if (result) {
+            result = end_png(state);
+        }
+        png_destroy_write_struct(&state->png_ptr, &state->info_ptr);
+    } else {
+        if (result) {
+            jpeg_finish_compress(&state->jpeg_info);
+        }
+        jpeg_destroy_compress(&state->jpeg_info);
+    }
+
+    fclose(state->file);
+    delete state;
+    writer.state = nullptr;
+    return result;
+}
+
+bool save_image(const std::string &filename, const struct Image &image) {
+    struct ImageWriter writer;
+    if (!open_image_writer(filename, image.width, image.height, image.channels, writer)) {
+        return false;
+    }
+    bool result = write_image_rows(writer, image.data, image.height);
+    return close_image_writer(writer) && result;
+}
+
+static void write_png_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+    std::string *output = (std::string *) png_get_io_ptr(png_ptr);
+    output->append((const char *) data, length);
+}
+
+static void flush_png_data(png_structp) {
+}
+
+bool encode_png(const struct Image &image, std::string &data) {
+    if (image.channels < 1 || image.channels > 4) {
+        std::cerr << "Cannot write an image with " << (int) image.channels << " channels" << std::endl;
+        return false;
+    }
+
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info_ptr = NULL;
+    if (!png_ptr) {
+        std::cerr << "Failed to create png write struct" << std::endl;
+        return false;
+    }
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr) {
+        std::cerr << "Failed to set up png info struct" << std::endl;
+        png_destroy_write_struct(&png_ptr, NULL);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        std::cerr << "Failed to encode png" << std::endl;
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return false;
+    }
+
+    data.clear();
+    png_set_write_fn(png_ptr, &data, write_png_data, flush_png_data);
+    png_set_IHDR(png_ptr, info_ptr, image.width, image.height, 8, color_types[image.channels - 1], PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_compression_level(png_ptr, 3);
+    png_write_info(png_ptr, info_ptr);
+    for (unsigned int y = 0; y < image.height; y++) {
+        png_write_row(png_ptr, (png_const_bytep) (image.data + (std::size_t) y * image.width * image.channels));
+    }
+    png_write_end(png_ptr, NULL);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    return true;
+}
+
+struct ReaderState {
+    FILE *file;
+    bool png;
+
+    png_structp png_ptr;
+    png_infop info_ptr;
+
+    struct jpeg_decompress_struct jpeg_info;
+    struct jpeg_error_mgr jpeg_err;
+};
+
+/**
+ * With headers_only, stop after reading the size, which also works for interlaced files.
+ */
+static bool open_png_reader(ReaderState *state, struct ImageReader &reader, bool headers_only) {
+    unsigned char header[8];
+    if (fread(header, 1, 8, state->file) != 8 || png_sig_cmp(header, 0, 8)) {
+        std::cerr << "Invalid png header" << std::endl;
+        return false;
+    }
+
+    state->info_ptr = NULL;
+    state->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!state->png_ptr) {
+        std::cerr << "Failed to create png read struct" << std::endl;
+        return false;
+    }
+
+    state->info_ptr = png_create_info_struct(state->png_ptr);
+    if (!state->info_ptr) {
+        std::cerr << "Failed to set up png info struct" << std::endl;
+        png_destroy_read_struct(&state->png_ptr, &state->info_ptr, NULL);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(state->png_ptr))) {
+        std::cerr << "Failed to prepare reading png file" << std::endl;
+        png_destroy_read_struct(&state->png_ptr, &state->info_ptr, NULL);
+        return false;
+    }
+
+    png_init_io(state->png_ptr, state->file);
+    png_set_sig_bytes(state->png_ptr, 8);
+    png_read_info(state->png_ptr, state->info_ptr);
+
+    // The same conversions as in load_png
+    reader.width = png_get_image_width(state->png_ptr, state->info_ptr);
+    reader.height = png_get_image_height(state->png_ptr, state->info_ptr);
+    unsigned char color_type = png_get_color_type(state->png_ptr, state->info_ptr);
+    unsigned char bit_depth = png_get_bit_depth(state->png_ptr, state->info_ptr);
+    if (bit_depth == 16) {
+        png_set_strip_16(state->png_ptr);
+    } else if (bit_depth < 8) {
+        png_set_packing(state->png_ptr);
+    }
+    reader.channels = png_get_channels(state->png_ptr, state->info_ptr);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(state->png_ptr);
+        reader.channels = 3;
+    }
+    if (png_get_valid(state->png_ptr, state->info_ptr, PNG_INFO_tRNS) != 0) {
+        png_set_tRNS_to_alpha(state->png_ptr);
+        reader.channels++;
+    }
+    if (headers_only) {
+        return true;
+    }
+
+    if (png_get_interlace_type(state->png_ptr, state->info_ptr) != PNG_INTERLACE_NONE) {
+        std::cerr << "Interlaced png files cannot be read by rows" << std::endl;
+        png_destroy_read_struct(&state->png_ptr, &state->info_ptr, NULL);
+        return false;
+    }
+
+    png_read_update_info(state->png_ptr, state->info_ptr);
+    return true;
+}
+
+/**
+ * With headers_only, nothing is decompressed, which progressive files would otherwise do in full right away.
+ */
+static bool open_jpeg_reader(ReaderState *state, struct ImageReader &reader, bool headers_only) {
+    state->jpeg_info.err = jpeg_std_error(&state->jpeg_err);
+    jpeg_create_decompress(&state->jpeg_info);
+    jpeg_stdio_src(&state->jpeg_info, state->file);
+    jpeg_read_header(&state->jpeg_info, TRUE);
+    if (headers_only) {
+        reader.width = state->jpeg_info.image_width;
+        reader.height = state->jpeg_info.image_height;
+        reader.channels = state->jpeg_info.num_components;
+        return true;
+    }
+    jpeg_start_decompress(&state->jpeg_info);
+
+    reader.width = state->jpeg_info.output_width;
+    reader.height = state->jpeg_info.output_height;
+    reader.channels = state->jpeg_info.num_components;
+    return true;
+}
+
+static ReaderState *open_reader_state(const std::string &filename, struct ImageReader &reader, bool headers_only) {
+    std::string ext;
+    if (!get_extension(filename, ext)) {
+        return nullptr;
+    }
+
+    if (ext != "png" && ext != "jpg" && ext != "jpeg") {
+        std::cerr << "Unknown image file extension: ." << ext << std::endl;
+        return nullptr;
+    }
+
+    ReaderState *state = new ReaderState;
+    state->png = ext == "png";
+    state->file = fopen(filename.c_str(), "rb");
+    if (!state->file) {
+        std::cerr << "Failed to open " << filename << "!" << std::endl;
+        delete state;
+        return nullptr;
+    }
+
+    if (!(state->png ? open_png_reader(state, reader, headers_only) : open_jpeg_reader(state, reader, headers_only))) {
+        std::cerr << "Failed to read " << filename << std::endl;
+        fclose(state->file);
+        delete state;
+        return nullptr;
+    }
+    return state;
+}
+
+bool open_image_reader(const std::string &filename, struct ImageReader &reader) {
+    ReaderState *state = open_reader_state(filename, reader, false);
+    if (!state) {
+        return false;
+    }
+
+    reader.rows_read = 0;
+    reader.state = state;
+    return true;
+}
+
+bool read_image_info(const std::string &filename, struct Image &info) {
+    ImageReader reader;
+    ReaderState *state = open_reader_state(filename, reader, true);
+    if (!state) {
+        return false;
+    }
+
+    if (state->png) {
+        png_destroy_read_struct(&state->png_ptr, &state->info_ptr, NULL);
+    } else {
+        jpeg_destroy_decompress(&state->jpeg_info);
+    }
+    fclose(state->file);
+    delete state;
+
+    info.width = reader.width;
+    info.height = reader.height;
+    info.channels = reader.channels;
+    info.data = nullptr;
+    return true;
+}
+
+bool read_image_rows(struct ImageReader &reader, unsigned char *data, unsigned int rows) {
+    ReaderState *state = (ReaderState *) reader.state;
+    if (reader.rows_read + rows > reader.height) {
+        std::cerr << "Tried to read more rows than the image has" << std::endl;
+        return false;
+    }
+
+    std::size_t stride = (std::size_t) reader.width * reader.channels;
+    if (state->png) {
+        if (setjmp(png_jmpbuf(state->png_ptr))) {
+            std::cerr << "Failed to read png rows" << std::endl;
+            return false;
+        }
+        for (unsigned int i = 0; i < rows; i++) {
+            png_read_row(state->png_ptr, (png_bytep) (data + i * stride), NULL);
+        }
+    } else {
+        for (unsigned int i = 0; i < rows; i++) {
+            JSAMPROW row = (JSAMPROW) (data + i * stride);
+            jpeg_read_scanlines(&state->jpeg_info, &row, 1);
+        }
+    }
+
+    reader.rows_read += rows;
+    return true;
+}
+
+void close_image_reader(struct ImageReader &reader) {
+    ReaderState *state = (ReaderState *) reader.state;
+    if (state->png) {
+        png_destroy_read_struct(&state->png_ptr, &state->info_ptr, NULL);
+    } else {
+        // Finishing needs all scanlines to have been read, aborting does not
+        jpeg_abort_decompress(&state->jpeg_info);
+        jpeg_destroy_decompress(&state->jpeg_info);
+    }
+
+    fclose(state->file);
+    delete state;
+    reader.state = nullptr;
+}
+
+bool crop_image(struct Image &image, int x, int y, int w, int h) {
+    // Compared in 64 bits, where neither the image size nor a relative crop wraps around
+    long long width = image.width;
+    long long height = image.height;
+    long long crop_w = w <= 0 ? width + w - x : w;
+    long long crop_h = h <= 0 ? height + h - y : h;
+    if (x < 0 || y < 0 || crop_w <= 0 || crop_h <= 0 || x + crop_w > width || y + crop_h > height) {
+        std::cerr << "Crop " << x << "," << y << "," << crop_w << "," << crop_h << " does not fit into a " << image.width << "x" << image.height << " image" << std::endl;
+        return false;
+    }
+    w = crop_w;
+    h = crop_h;
+    if (x == 0 && y == 0 && w == width && h == height) {
+        return true;
+    }
+
+    std::size_t row_size = (std::size_t) w * image.channels;
+    unsigned char *cropped_data = new unsigned char[row_size * h];
+    for (int i = 0; i < h; i++) {
+        const unsigned char *row = image.data + ((std::size_t) (y + i) * image.width + x) * image.channels;
+        std::copy(row, row + row_size, cropped_data + i * row_size);
+    }
+
+    delete[] image.data;
+    image.data = cropped_data;
+    image.width = w;
+    image.height = h;
+
+    return true;
+}
+
 static inline bool is_pow2(unsigned int x) {
     return (x & (x - 1)) == 0;
 }
@@ -197,17 +677,14 @@ static inline unsigned int get_pow2(unsigned int x) {
     return x * 2;
 }
 
-bool load_texture(const std::string &name, struct Texture &texture, unsigned int x, unsigned int y, int w, int h) {
-    std::string filename = "./res/images/" + name;
-
-    struct Image image;
-    if (!load_image(filename, image)) {
-        std::cerr << "Failed to load texture: " << name << std::endl;
-        return false;
-    }
+unsigned int get_padded_size(unsigned int size) {
+    return get_pow2(size);
+}
 
+void pad_image(struct Image &image, unsigned int x, unsigned int y, int w, int h, float &sx, float &sy) {
     // If the texture needs to be cropped, or its size is not a power of 2
     if (x != 0 || y != 0 || (w != 0 && w != image.width) || (h != 0 && h != image.height) || !is_pow2(image.width) || !is_pow2(image.height)) {
+        TRACE_ZONE("pad_image");
         if (w <= 0) {
             w = image.width + w - x;
         }
@@ -233,18 +710,33 @@ bool load_texture(const std::string &name, struct Texture &texture, unsigned int
             original_i += original_skip;
             destination_i += destination_skip;
         }
-        texture.sx = (float) w / (float) nw;
-        texture.sy = (float) h / (float) nh;
+        sx = (float) w / (float) nw;
+        sy = (float) h / (float) nh;
 
         delete[] image.data;
         image.data = cropped_data;
         image.width = nw;
         image.height = nh;
     } else {
-        texture.sx = 1;
-        texture.sy = 1;
+        sx = 1;
+        sy = 1;
     }
+}
+
+#ifndef NO_OPENGL
+bool load_texture(const std::string &name, struct Texture &texture, unsigned int x, unsigned int y, int w, int h) {
+    TRACE_ZONE("load_texture");
+    std::string filename = "./res/images/" + name;
+
+    struct Image image;
+    if (!load_image(filename, image)) {
+        std::cerr << "Failed to load texture: " << name << std::endl;
+        return false;
+    }
+
+    pad_image(image, x, y, w, h, texture.sx, texture.sy);
 
+    texture.target = GL_TEXTURE_2D;
     texture.width = image.width;
     texture.height = image.height;
 
@@ -263,14 +755,27 @@ bool load_texture(const std::string &name, struct Texture &texture, unsigned int
         return false;
     }
 
-    glGenTextures(1, &texture.texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture.texture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, type, texture.width, texture.height, 0, type, GL_UNSIGNED_BYTE, image.data);
+    {
+        TRACE_ZONE("upload_texture");
+        double upload_start = get_stat_time();
+        glGenTextures(1, &texture.texture_id);
+        bind_texture(0, GL_TEXTURE_2D, texture.texture_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, type, texture.width, texture.height, 0, type, GL_UNSIGNED_BYTE, image.data);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        record_stat(STAT_TEXTURE_UPLOAD, get_stat_time() - upload_start);
+    }
 
     free_image(image);
 
     return true;
 }
+
+void free_texture(struct Texture &texture) {
+    // Deleting a bound texture unbinds it, which the cache has to know about
+    forget_texture(texture.texture_id);
+    glDeleteTextures(1, &texture.texture_id);
+    texture.texture_id = 0;
+}
+#endif
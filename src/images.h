@@ -3,7 +3,9 @@
 
 #include <string>
 
+#ifndef NO_OPENGL
 #include <GL/glew.h>
+#endif
 
 struct Image {
     unsigned int width, height;
@@ -11,16 +13,82 @@ struct Image {
     unsigned char *data;
 };
 
+#ifndef NO_OPENGL
 struct Texture {
     GLuint texture_id;
+    // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for the frames of a time series, see series.h
+    GLenum target;
     unsigned int width, height;
     float sx, sy;
 };
+#endif
+
+/**
+ * Writes an image a few rows at a time, so that the whole image never has to be in memory.
+ */
+struct ImageWriter {
+    unsigned int width, height;
+    unsigned char channels;
+    unsigned int rows_written;
+    void *state;
+};
+
+/**
+ * Reads an image a few rows at a time from top to bottom, the counterpart of ImageWriter.
+ */
+struct ImageReader {
+    unsigned int width, height;
+    unsigned char channels;
+    unsigned int rows_read;
+    void *state;
+};
 
 bool load_image(const std::string &name, struct Image &image);
+
+/**
+ * Read the size and channels that load_image would give from the headers only, without decoding anything.
+ * The data of info is left empty.
+ */
+bool read_image_info(const std::string &name, struct Image &info);
 void free_image(struct Image &image);
 
+/**
+ * Crop an image in place. A width or height of 0 or less is relative to the right or bottom edge, the same way as in SphereMap.
+ * Returns false if the crop does not fit into the image, including a negative x or y.
+ */
+bool crop_image(struct Image &image, int x, int y, int w, int h);
+
+bool open_image_writer(const std::string &filename, unsigned int width, unsigned int height, unsigned char channels, struct ImageWriter &writer);
+bool write_image_rows(struct ImageWriter &writer, const unsigned char *data, unsigned int rows);
+bool close_image_writer(struct ImageWriter &writer);
+bool save_image(const std::string &filename, const struct Image &image);
+
+/**
+ * Encode an image as png into memory instead of a file.
+ */
+bool encode_png(const struct Image &image, std::string &data);
+
+/**
+ * Interlaced png files cannot be read by rows and are refused.
+ */
+bool open_image_reader(const std::string &filename, struct ImageReader &reader);
+bool read_image_rows(struct ImageReader &reader, unsigned char *data, unsigned int rows);
+void close_image_reader(struct ImageReader &reader);
+
+/**
+ * Crop an image in place like crop_image, and then pad it with white up to a power of two in both directions.
+ * sx and sy are set to the fraction of the padded image that the crop covers.
+ */
+void pad_image(struct Image &image, unsigned int x, unsigned int y, int w, int h, float &sx, float &sy);
+
+/**
+ * The power of two that pad_image pads size up to.
+ */
+unsigned int get_padded_size(unsigned int size);
+
+#ifndef NO_OPENGL
 bool load_texture(const std::string &name, struct Texture &texture, unsigned int x = 0, unsigned int y = 0, int w = 0, int h = 0);
 void free_texture(struct Texture &texture);
+#endif
 
 #endif
@@ -0,0 +1,116 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "stats.h"
+
+struct LatencyInput {
+    double delivered;
+    double handled;
+};
+
+struct LatencyFrame {
+    std::vector<LatencyInput> inputs;
+    double submitted;
+    double swapped;
+    // Added to a GPU timestamp in seconds, gives the time on the CPU clock
+    double gpu_offset;
+    GLuint query;
+    // Presented and waiting for its query
+    bool pending;
+};
+
+// Enough for the GPU to be a few frames behind
+static const int frame_count = 8;
+static LatencyFrame frames[frame_count];
+static bool queries_created = false;
+static int next_frame = 0;
+// The frame between submit_latency_frame and present_latency_frame, -1 if it is not measured
+static int submitted_frame = -1;
+// Events for the frame that is rendered next
+static std::vector<LatencyInput> inputs;
+
+void add_latency_input(double delivered, double handled) {
+    if (stats_enabled) {
+        inputs.push_back({delivered, handled});
+    }
+}
+
+static void record_ms(Stat stat, double seconds) {
+    record_stat(stat, seconds * 1000);
+}
+
+/**
+ * Record every presented frame whose GPU time is known.
+ */
+static void collect_frames() {
+    for (LatencyFrame &frame : frames) {
+        if (!frame.pending) {
+            continue;
+        }
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 timestamp;
+        glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &timestamp);
+        double drawn = std::max(frame.submitted, timestamp / 1e9 + frame.gpu_offset);
+        double shown = std::max(drawn, frame.swapped);
+        for (const LatencyInput &input : frame.inputs) {
+            record_ms(STAT_INPUT_LATENCY, shown - input.delivered);
+            record_ms(STAT_LATENCY_QUEUE, input.handled - input.delivered);
+            record_ms(STAT_LATENCY_CPU, frame.submitted - input.handled);
+            record_ms(STAT_LATENCY_GPU, drawn - frame.submitted);
+            record_ms(STAT_LATENCY_PRESENT, shown - drawn);
+        }
+        frame.inputs.clear();
+        frame.pending = false;
+    }
+}
+
+void submit_latency_frame(double submitted) {
+    submitted_frame = -1;
+    if (!stats_enabled || inputs.empty()) {
+        inputs.clear();
+        return;
+    }
+    if (!queries_created) {
+        for (LatencyFrame &frame : frames) {
+            glGenQueries(1, &frame.query);
+        }
+        queries_created = true;
+    }
+    collect_frames();
+
+    LatencyFrame &frame = frames[next_frame];
+    if (frame.pending) {
+        // The GPU is too far behind to keep up with measuring, skip this frame's events
+        inputs.clear();
+        return;
+    }
+    glQueryCounter(frame.query, GL_TIMESTAMP);
+    // The current GPU time, which lines up the GPU clock with the CPU one for this frame
+    GLint64 gpu_time;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+    frame.gpu_offset = submitted - gpu_time / 1e9;
+    frame.submitted = submitted;
+    frame.inputs.swap(inputs);
+    submitted_frame = next_frame;
+    next_frame = (next_frame + 1) % frame_count;
+}
+
+void present_latency_frame(double swapped) {
+    if (submitted_frame < 0) {
+        return;
+    }
+    frames[submitted_frame].swapped = swapped;
+    frames[submitted_frame].pending = true;
+    submitted_frame = -1;
+    collect_frames();
+}
@@ -0,0 +1,29 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/**
+ * Input-to-photon latency, recorded into the STAT_INPUT_LATENCY statistics while statistics are enabled.
+ * Every input event that changes the view is followed from the window handing it over (delivered), through the
+ * render thread handling it, the frame that shows it being submitted, the GPU finishing that frame, to the swap
+ * that presents it. The stages are recorded as queue, CPU, GPU and present, and add up to the whole latency.
+ * All times are seconds on the same clock, and everything is only meant to be called from the render thread.
+ */
+
+/**
+ * Add an event that was handled at handled to the frame that is rendered next.
+ */
+void add_latency_input(double delivered, double handled);
+
+/**
+ * Mark the end of the draw calls of the frame, at submitted, with a timestamp query that tells when the GPU is done.
+ * Nothing is measured for frames without input.
+ */
+void submit_latency_frame(double submitted);
+
+/**
+ * Mark the frame as presented at swapped, when the swap returned. Frames count as shown at whichever is later of
+ * that and the GPU finishing, and are recorded once their query is available, without waiting for it.
+ */
+void present_latency_frame(double swapped);
+
+#endif
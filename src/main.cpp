@@ -1,6 +1,14 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <cmath>
 
 #ifdef WIN32
@@ -15,281 +23,337 @@
 #include "projection.h"
 #include "projections/mollweide.h"
 #include "projections/robinson.h"
+#include "projections/winkel.h"
 #include "mapper.h"
+#include "glstate.h"
 #include "shaders.h"
 #include "images.h"
 #include "maps.h"
-
-Projection *output_projection;
+#include "renderer.h"
+#include "options.h"
+#include "export.h"
+#include "animation.h"
+#include "headless.h"
+#include "bulk.h"
+#include "transform.h"
+#include "server.h"
+#include "pyramid.h"
+#include "scaling.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "trace.h"
+#include "regression.h"
+#include "recording.h"
+#include "latency.h"
 
 static bool drag_active = false;
 static bool rotate_active = false;
 static double drag_startx = 0;
 static double drag_starty = 0;
 static double rotate_startangle = 0;
-static double zoom = 1;
+// View that the drag or rotation started in, it keeps using that view's projection until it stops
+static int drag_view = 0;
+
+/**
+ * Frames are rendered at full resolution again once a drag has not moved for this many seconds.
+ */
+static const double idle_delay = 0.1;
+static double last_input_time = 0;
+static bool full_resolution_pending = false;
 
-static bool infinite_mode = false;
+static bool roll_animating = false;
 
+static bool series_playing = false;
+static bool series_timer_running = false;
+static double series_time;
+// How often a paused time series looks for frames that finished decoding, instead of spinning the render loop
+static const double series_poll_interval = 0.01;
+
+static Options options;
+// Output projections that V shows side by side
+static std::vector<Projection *> views;
+
+static GLFWwindow *window;
 static GLFWcursor *normal;
 static GLFWcursor *grab;
 
+static const std::size_t input_capacity = 1024;
+static SpscQueue<InputEvent> input_events(input_capacity);
+// Slots at the end of the queue that cursor moves and scrolls never take, so that keys, buttons and sizes always fit
+static const std::size_t reserved_inputs = 64;
+// Cursor moves and scrolls that did not fit, merged into one of each until the render thread makes room, see push_input
+static InputEvent held_cursor;
+static InputEvent held_scroll;
+static bool cursor_held = false;
+static bool scroll_held = false;
+// Set once the render thread stops taking input
+static std::atomic<bool> render_stopped(false);
+// Only used to sleep while there is nothing to do, the queue itself never locks
+static std::mutex input_mutex;
+static std::condition_variable input_ready;
+
+// Owned by the render thread and kept up to date by size events, instead of asking GLFW on every event
+static int window_width;
+static int window_height;
+static int framebuffer_width;
+static int framebuffer_height;
+static bool quit = false;
+
+// Input replayed on the render thread instead of taken from the window, see replay_input
+static bool replaying = false;
+static Recording replay;
+static std::size_t replay_next = 0;
+static double replay_start;
+// Events recorded up to this time are applied by pop_replay_input
+static double replay_until;
+
+// Cursors can only be changed on the main thread, so the render thread asks for them here
+static std::atomic<bool> cursor_grabbed(false);
+
 /**
- * This function remaps window coordinates to the current projection's coordinates, with (-1, -1) to (1, 1) being the rectangle in which the projection is displayed.
+ * This function remaps coordinates in a view to the projection's coordinates, with (-1, -1) to (1, 1) being the rectangle in which the projection is displayed.
  * 
+ * @param projection projection shown in the view
  * @param x x coordinate to remap
  * @param y y coordinate to remap
- * @param w window width
- * @param h window height
+ * @param w view width
+ * @param h view height
 */
-static void remap_to_map_xy(double &x, double &y, int w, int h) {
+static void remap_to_map_xy(const Projection *projection, double &x, double &y, double w, double h) {
     // If the window's height ratio is larger than than the projection's height ratio
     x = 2 * x - 1;
     y = 2 * y - 1;
-    if (h * output_projection->width > w * output_projection->height) {
+    if (h * projection->width > w * projection->height) {
         // Width is the limiting factor, therefore the real height is smaller than the window's height
-        y *= output_projection->width / (double) output_projection->height * h / (double) w;
+        y *= projection->width / (double) projection->height * h / w;
     } else {
         // Width is the limiting factor, therefore the real width is smaller than the window's width
-        x *= output_projection->height / (double) output_projection->width * w / (double) h;
+        x *= projection->height / (double) projection->width * w / h;
+    }
+}
+
+/**
+ * The view under window coordinates x and y from 0 to 1, with y going up, in the grid of set_views.
+ * Returns 0 when only output_projection is shown, and -1 for the empty cells at the end of the grid.
+ */
+static int find_view(double x, double y) {
+    if (view_projections.empty()) {
+        return 0;
+    }
+    int columns, rows;
+    get_view_grid(view_projections.size(), columns, rows);
+    int column = std::min((int) (x * columns), columns - 1);
+    int row = std::min((int) ((1 - y) * rows), rows - 1);
+    int view = row * columns + column;
+    return view < (int) view_projections.size() ? view : -1;
+}
+
+/**
+ * Remap window coordinates from 0 to 1, with y going up, to the coordinates of the projection shown in view, see
+ * remap_to_map_xy. Points outside of the view's cell end up outside of (-1, -1) to (1, 1).
+ * Returns that projection, or nullptr if the view is gone.
+ */
+static Projection *remap_to_view_xy(int view, double &x, double &y) {
+    if (view_projections.empty()) {
+        remap_to_map_xy(output_projection, x, y, window_width, window_height);
+        return output_projection;
     }
+    if (view < 0 || view >= (int) view_projections.size()) {
+        return nullptr;
+    }
+    int columns, rows;
+    get_view_grid(view_projections.size(), columns, rows);
+    // Rows are filled from the top, y goes up
+    x = x * columns - view % columns;
+    y = y * rows - (rows - 1 - view / columns);
+    remap_to_map_xy(view_projections[view], x, y, window_width / (double) columns, window_height / (double) rows);
+    return view_projections[view];
+}
+
+static void set_cursor_grabbed(bool grabbed) {
+    cursor_grabbed = grabbed;
+    // Wake up the main thread to change it
+    glfwPostEmptyEvent();
 }
 
-void handle_drag_start(GLFWwindow *window) {
-    glfwGetCursorPos(window, &drag_startx, &drag_starty);
-    int w, h;
-    glfwGetWindowSize(window, &w, &h);
-    drag_startx /= w;
-    drag_starty /= h;
+void handle_drag_start(double xpos, double ypos) {
+    drag_startx = xpos / window_width;
+    drag_starty = ypos / window_height;
     drag_starty = 1 - drag_starty;
-    remap_to_map_xy(drag_startx, drag_starty, w, h);
-    if (drag_startx <= -zoom || drag_startx >= zoom || drag_starty <= -zoom || drag_starty >= zoom || !output_projection->xy_to_uv(drag_startx / zoom, drag_starty / zoom, drag_startx, drag_starty)) {
+    int view = find_view(drag_startx, drag_starty);
+    Projection *projection = remap_to_view_xy(view, drag_startx, drag_starty);
+    if (projection == nullptr || drag_startx <= -zoom || drag_startx >= zoom || drag_starty <= -zoom || drag_starty >= zoom || !projection->xy_to_uv(drag_startx / zoom, drag_starty / zoom, drag_startx, drag_starty)) {
         return;
     }
+    drag_view = view;
     drag_active = true;
-    glfwSetCursor(window, grab);
+    set_cursor_grabbed(true);
 }
 
-void handle_drag(GLFWwindow *window, double xpos, double ypos) {
+void handle_drag(double xpos, double ypos) {
     if (!drag_active) {
         return;
     }
 
-    int w, h;
-    glfwGetWindowSize(window, &w, &h);
-    xpos /= w;
-    ypos /= h;
+    xpos /= window_width;
+    ypos /= window_height;
     ypos = 1 - ypos;
-    remap_to_map_xy(xpos, ypos, w, h);
+    Projection *projection = remap_to_view_xy(drag_view, xpos, ypos);
     
     double dx, dy;
-    if (xpos <= -zoom || xpos >= zoom || ypos <= -zoom || ypos >= zoom || !output_projection->xy_to_uv(xpos / zoom, ypos / zoom, dx, dy)) {
+    if (projection == nullptr || xpos <= -zoom || xpos >= zoom || ypos <= -zoom || ypos >= zoom || !projection->xy_to_uv(xpos / zoom, ypos / zoom, dx, dy)) {
         return;
     }
     handle_rotation(drag_startx, drag_starty, dx, dy);
+    request_redraw();
 
     drag_startx = dx;
     drag_starty = dy;
 }
 
-void handle_drag_stop(GLFWwindow *window) {
+void handle_drag_stop() {
     if (!drag_active) {
         return;
     }
 
     drag_active = false;
-    glfwSetCursor(window, normal);
+    set_cursor_grabbed(false);
+    // Show the end of the drag at full resolution straight away
+    request_redraw();
 }
 
-void handle_mouse_button(GLFWwindow *window, int button, int action, int mods) {
+void handle_mouse_button(int button, int action, double x, double y) {
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
         if (action == GLFW_PRESS) {
-            handle_drag_start(window);
+            handle_drag_start(x, y);
         } else {
-            handle_drag_stop(window);
+            handle_drag_stop();
         }
     } else if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
         if (action == GLFW_PRESS) { //Begin rotate
-            rotate_active = true;
-            double x, y;
-            glfwGetCursorPos(window, &x, &y);
-            glfwSetCursor(window, grab);
-            int w, h;
-            glfwGetWindowSize(window, &w, &h);
-            x /= w;
-            y /= h;
+            x /= window_width;
+            y /= window_height;
             y = 1 - y;
-            remap_to_map_xy(x, y, w, h);
+            int view = find_view(x, y);
+            if (remap_to_view_xy(view, x, y) == nullptr) {
+                return;
+            }
+            drag_view = view;
+            rotate_active = true;
+            set_cursor_grabbed(true);
             
             rotate_startangle = std::atan2(y, x);
         } else { //End rotate
             rotate_active = false;
-            glfwSetCursor(window, normal);
+            set_cursor_grabbed(false);
+            request_redraw();
         }
     }
 }
 
-void handle_scroll(GLFWwindow *window, double xscroll, double yscroll) {
+void handle_scroll(double yscroll) {
     zoom *= std::exp(yscroll / 5);
     if (zoom < 1) {
         zoom = 1;
     }
+    request_redraw();
 }
 
-void handle_cursor_position(GLFWwindow *window, double xpos, double ypos) {
+void handle_cursor_position(double xpos, double ypos) {
     if (!drag_active && !rotate_active) {
         return;
     }
+    last_input_time = glfwGetTime();
 
     if (rotate_active && !is_locked()) {
-        int w, h;
         double x, y;
-        glfwGetWindowSize(window, &w, &h);
-        x = xpos / w;
-        y = ypos / h;
+        x = xpos / window_width;
+        y = ypos / window_height;
         y = 1 - y;
-        double end_angle = std::atan2(y - 0.5f, x - 0.5f);
+        // Around the center of the view the rotation started in
+        remap_to_view_xy(drag_view, x, y);
+        double end_angle = std::atan2(y, x);
         rotate_roll(-(end_angle - rotate_startangle));
         rotate_startangle = end_angle;
+        request_redraw();
     }
 
     if (drag_active) {
-        handle_drag(window, xpos, ypos);
+        handle_drag(xpos, ypos);
     }
 }
 
-struct LoadedShader {
-    Projection *source;
-    Projection *output;
-    unsigned int last_width;
-    unsigned int last_height;
-    Shader shader;
-
-    GLuint texture_sampler_id;
-    GLuint zoom_id;
-    GLuint scale_id;
-    GLuint uv_scale_id;
-    GLuint rotation_matrix_id;
-    GLuint infinite_mode_id;
-};
-
-std::map<std::string, unsigned int> projection_id;
-std::map<unsigned long long, LoadedShader> loaded_shaders;
-LoadedShader *current_shader;
-
-static unsigned int get_projection_id(Projection *projection) {
-    static int projection_count = 0;
-
-    auto it = projection_id.find(projection->shader);
-    unsigned int id = -1;
-    if (it == projection_id.end()) {
-        id = projection_count++;
-        projection_id[projection->shader] = id;
-    } else {
-        id = it->second;
+static bool on_roll_frame(double time) {
+    roll_animating = animate_roll(time);
+    if (roll_animating) {
+        request_redraw();
     }
-
-    return id;
+    return roll_animating;
 }
 
-static bool update_shader() {
-    SphereMap *current_map = get_current_map();
-    unsigned int source_id = get_projection_id(current_map->source);
-    unsigned int output_id = get_projection_id(output_projection);
-    unsigned long long shader_id = (((unsigned long long) source_id) << 32) | output_id;
-
-    LoadedShader *loaded_shader;
-    auto it = loaded_shaders.find(shader_id);
-    if (it == loaded_shaders.end()) {
-        LoadedShader temp;
-        loaded_shader = &temp;
-
-        temp.source = current_map->source;
-        temp.output = output_projection;
-        temp.last_width = 0;
-        temp.last_height = 0;
-
-        std::string vertex_shader;
-        std::string fragment_shader;
-        std::string buffer;
-
-        if (!read_shader("vertex", vertex_shader)) {
-            std::cerr << "Failed to load vertex shader!" << std::endl;
-            return false;
-        }
-
-        if (!read_shader("fragment", fragment_shader)) {
-            std::cerr << "Failed to load fragment shader!" << std::endl;
-            return false;
-        }
-
-        if (!read_shader(current_map->source->shader + ".ll_to_xy", buffer)) {
-            std::cerr << "Failed to read " << current_map->source->shader << " source mapping shader!" << std::endl;
-            return false;
-        }
-
-        fragment_shader += "\n" + buffer;
-        buffer.clear();
-
-        if (!read_shader(output_projection->shader + ".xy_to_ll", buffer)) {
-            std::cerr << "Failed to read " << output_projection->shader << " output mapping shader!" << std::endl;
-            return false;
-        }
-
-        fragment_shader += "\n" + buffer;
-
-        if (!load_shader(current_map->source->shader + " to " + output_projection->shader, vertex_shader, fragment_shader, temp.shader)) {
-            std::cerr << "Failed to compile generated " << current_map->source->shader << " to " << output_projection->shader << " shader!" << std::endl;
-            std::cerr << "Fragment shader dump:" << std::endl;
-            std::cerr << fragment_shader << std::endl;
-            return false;
-        }
-
-        //std::cout << "Loaded shader " << current_map->source->shader + " to " + output_projection->shader << ", code:" << std::endl;
-        //std::cout << fragment_shader << std::endl;
-
-        temp.texture_sampler_id = glGetUniformLocation(temp.shader.program_id, "texture_sampler");
-        temp.scale_id = glGetUniformLocation(temp.shader.program_id, "scale");
-        temp.uv_scale_id = glGetUniformLocation(temp.shader.program_id, "uv_scale");
-        temp.rotation_matrix_id = glGetUniformLocation(temp.shader.program_id, "rotation");
-        temp.zoom_id = glGetUniformLocation(temp.shader.program_id, "zoom");
-        temp.infinite_mode_id = glGetUniformLocation(temp.shader.program_id, "infinite_mode");
-
-        loaded_shader = &loaded_shaders[shader_id];
-        *loaded_shader = temp;
-    } else {
-        loaded_shader = &(it->second);
+/**
+ * Step the roll animation before every frame until it is done.
+ */
+static void start_roll_animation() {
+    if (!roll_animating) {
+        roll_animating = true;
+        add_timer(glfwGetTime(), 0, on_roll_frame);
     }
+}
 
-    current_shader = loaded_shader;
-    if (current_shader->source->prepare_input) {
-        current_shader->source->prepare_input(get_current_map()->texture.width, get_current_map()->texture.height, current_shader->shader.program_id);
+/**
+ * Advance the time series while it plays and upload the frames that finished decoding, before every frame while it
+ * plays and every series_poll_interval while it only has frames loading.
+ */
+static bool on_series_frame(double time) {
+    series_timer_running = false;
+    TimeSeries *series = get_current_map()->series;
+    if (!series) {
+        return false;
     }
-    if (current_shader->output->prepare_output) {
-        current_shader->output->prepare_output(get_current_map()->texture.width, get_current_map()->texture.height, current_shader->shader.program_id);
+    if (series_playing) {
+        set_series_position(series, get_series_position(series) + (time - series_time) * options.series_speed);
+        request_redraw();
     }
-    glUseProgram(current_shader->shader.program_id);
-    glUniform2f(current_shader->uv_scale_id, get_current_map()->texture.sx, get_current_map()->texture.sy);
-    return true;
+    series_time = time;
+    if (update_time_series(series)) {
+        request_redraw();
+    }
+    if (series_playing || is_series_loading(series)) {
+        series_timer_running = true;
+        add_timer(time + (series_playing ? 0 : series_poll_interval), 0, on_series_frame);
+    }
+    return false;
 }
 
-static bool set_projection(Projection *projection) {
-    Projection *prev = output_projection;
-    output_projection = projection;
-    if (!update_shader()) {
-        std::cerr << "Failed to load shader for new output projection " << projection->shader << ", going back to " << prev->shader << std::endl;
-        output_projection = prev;
-        return false;
+static void start_series_timer() {
+    if (!series_timer_running && get_current_map()->series) {
+        series_timer_running = true;
+        series_time = glfwGetTime();
+        add_timer(series_time, 0, on_series_frame);
+    }
+}
+
+/**
+ * Move a time series by whole frames from the frame it is on.
+ */
+static void step_series(int frames) {
+    TimeSeries *series = get_current_map()->series;
+    if (series) {
+        set_series_position(series, std::floor(get_series_position(series)) + frames);
+        start_series_timer();
     }
-    return true;
 }
 
 static void select_map(unsigned int id) {
+    TRACE_ZONE("select_map");
     if (!set_map(id)) {
         std::cerr << "Failed to set map " << id << std::endl;
         return;
     }
     if (update_shader()) {
+        start_series_timer();
         return;
     }
     if (!set_map_pack(0)) {
@@ -306,11 +370,13 @@ static void select_map(unsigned int id) {
 }
 
 static void select_pack(unsigned int id) {
+    TRACE_ZONE("select_pack");
     if (!set_map_pack(id)) {
         std::cerr << "Failed to set map pack " << id << std::endl;
         return;
     }
     if (update_shader()) {
+        start_series_timer();
         return;
     }
     if (!set_map_pack(0)) {
@@ -322,8 +388,23 @@ static void select_pack(unsigned int id) {
     }
 }
 
-void handle_key(GLFWwindow *window, int key, int scancode, int action, int mods) {
+static void reload_maps() {
+    TRACE_ZONE("reload_maps");
+    // A manifest that can not be read keeps the catalog from before
+    if (!reload_map_catalog() || update_shader()) {
+        start_series_timer();
+        return;
+    }
+    if (!set_map_pack(0) || !set_map(0) || !update_shader()) {
+        std::cerr << "Failed to reset to the first map after reloading the catalog" << std::endl;
+    }
+}
+
+void handle_key(int key, int action) {
     if (action == GLFW_PRESS) {
+        // Nearly every binding changes the view, the others do not mind an extra frame
+        request_redraw();
+
         // 1-9 - set map
         if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9) {
             select_map(key - GLFW_KEY_1);
@@ -337,21 +418,96 @@ void handle_key(GLFWwindow *window, int key, int scancode, int action, int mods)
         else if (key == GLFW_KEY_T) { select_pack(4); }
         else if (key == GLFW_KEY_Y) { select_pack(5); }
 
-        // ASDF - set output projection
+        // ASDFGHJ - set output projection
         else if (key == GLFW_KEY_A) { set_projection(&equirectangular); }
         else if (key == GLFW_KEY_S) { set_projection(&mollweide); }
         else if (key == GLFW_KEY_D) { set_projection(&hammer); }
         else if (key == GLFW_KEY_F) { set_projection(&azimuthal); }
         else if (key == GLFW_KEY_G) { set_projection(&robinson); }
+        else if (key == GLFW_KEY_H) { set_projection(&winkel); }
+        else if (key == GLFW_KEY_J) { set_projection(&mercator); }
+
+        // Previous and next map of the pack, and previous and next pack, for catalogs with more than fit on the keys
+        else if (key == GLFW_KEY_COMMA || key == GLFW_KEY_PERIOD) {
+            unsigned int count = get_map_count();
+            select_map((get_current_map_id() + (key == GLFW_KEY_PERIOD ? 1 : count - 1)) % count);
+        }
+        else if (key == GLFW_KEY_PAGE_UP || key == GLFW_KEY_PAGE_DOWN) {
+            unsigned int count = get_map_pack_count();
+            select_pack((get_current_map_pack_id() + (key == GLFW_KEY_PAGE_DOWN ? 1 : count - 1)) % count);
+        }
+
+        // Read the map catalog again
+        else if (key == GLFW_KEY_L) {
+            reload_maps();
+        }
+
+        // Play or pause a time series, and step through it a frame at a time
+        else if (key == GLFW_KEY_B) {
+            if (get_current_map()->series) {
+                series_playing = !series_playing;
+                start_series_timer();
+            }
+        }
+        else if (key == GLFW_KEY_LEFT_BRACKET) {
+            step_series(-1);
+        }
+        else if (key == GLFW_KEY_RIGHT_BRACKET) {
+            step_series(1);
+        }
+
+        // Toggle showing every view side by side
+        else if (key == GLFW_KEY_V) {
+            set_views(view_projections.empty() ? views : std::vector<Projection *>());
+        }
 
         // Reset roll
         else if (key == GLFW_KEY_SPACE) {
             reset_roll();
+            start_roll_animation();
         }
 
         // Toggle locked/unlocked mode
         else if (key == GLFW_KEY_X) {
             toggle_lock();
+            start_roll_animation();
+        }
+
+        // Export the current view as a poster
+        else if (key == GLFW_KEY_P) {
+            export_poster(options.poster_file, options.poster_width, options.poster_height);
+        }
+
+        // Toggle between interpolating over a mesh and computing every pixel
+        else if (key == GLFW_KEY_M) {
+            mesh_mode = !mesh_mode;
+            std::cout << (mesh_mode ? "Rendering with an adaptive mesh" : "Rendering every pixel exactly") << std::endl;
+        }
+
+        // Toggle showing the estimated cost of every pixel instead of the map
+        else if (key == GLFW_KEY_K) {
+            cost_heatmap = !cost_heatmap;
+            if (!update_shader()) {
+                cost_heatmap = !cost_heatmap;
+                update_shader();
+            }
+        }
+
+        // Toggle recording frame statistics, which are printed when it stops
+        else if (key == GLFW_KEY_I) {
+            if (stats_enabled) {
+                print_stats();
+                set_stats_enabled(false);
+            } else {
+                reset_stats();
+                set_stats_enabled(true);
+                std::cout << "Recording frame statistics" << std::endl;
+            }
+        }
+
+        // Write the frame statistics so far to a JSON file
+        else if (key == GLFW_KEY_O) {
+            dump_stats(options.stats_file);
         }
 
         // Easter egg to make the projeciton infinite
@@ -361,9 +517,230 @@ void handle_key(GLFWwindow *window, int key, int scancode, int action, int mods)
         
         // Close the window
         else if (key == GLFW_KEY_ESCAPE) {
+            quit = true;
             glfwSetWindowShouldClose(window, 1);
+            glfwPostEmptyEvent();
+        }
+    }
+}
+
+/**
+ * Hand an event to the render thread, waiting for room if the queue is full.
+ */
+static void send_input(const InputEvent &event) {
+    while (!input_events.push(event)) {
+        if (render_stopped) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::lock_guard<std::mutex> lock(input_mutex);
+    }
+    input_ready.notify_one();
+}
+
+static bool has_motion_room() {
+    return input_events.size() + reserved_inputs < input_capacity;
+}
+
+/**
+ * Hand over the held cursor move and scroll if there is room for them, or in any case if force is set.
+ */
+static void flush_held_input(bool force) {
+    if (cursor_held && (force || has_motion_room())) {
+        send_input(held_cursor);
+        cursor_held = false;
+    }
+    if (scroll_held && (force || has_motion_room())) {
+        send_input(held_scroll);
+        scroll_held = false;
+    }
+}
+
+/**
+ * The queue only fills up while the render thread is stuck, for example exporting a poster. Cursor moves and scrolls
+ * are then merged on this side the same way apply_inputs merges them, and everything else is always delivered, so a
+ * release or quit is never lost.
+ */
+static void push_input(InputEvent event) {
+    event.time = glfwGetTime();
+    record_input(event, event.time);
+    if (event.type == INPUT_CURSOR || event.type == INPUT_SCROLL) {
+        flush_held_input(false);
+        bool &held = event.type == INPUT_CURSOR ? cursor_held : scroll_held;
+        InputEvent &merged = event.type == INPUT_CURSOR ? held_cursor : held_scroll;
+        if (!held && has_motion_room()) {
+            send_input(event);
+        } else if (!held) {
+            merged = event;
+            held = true;
+        } else if (event.type == INPUT_SCROLL) {
+            merged.x += event.x;
+            merged.y += event.y;
+        } else {
+            // Keep the time of the first move for measuring latency
+            merged.x = event.x;
+            merged.y = event.y;
+        }
+        return;
+    }
+    // Whatever happened before has to arrive first
+    flush_held_input(true);
+    send_input(event);
+}
+
+static void on_key(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    push_input({INPUT_KEY, key, action, 0, 0, 0});
+}
+
+static void on_mouse_button(GLFWwindow *window, int button, int action, int mods) {
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    push_input({INPUT_MOUSE_BUTTON, button, action, x, y, 0});
+}
+
+static void on_cursor_position(GLFWwindow *window, double xpos, double ypos) {
+    push_input({INPUT_CURSOR, 0, 0, xpos, ypos, 0});
+}
+
+static void on_scroll(GLFWwindow *window, double xscroll, double yscroll) {
+    push_input({INPUT_SCROLL, 0, 0, xscroll, yscroll, 0});
+}
+
+static void on_window_size(GLFWwindow *window, int width, int height) {
+    push_input({INPUT_WINDOW_SIZE, 0, 0, (double) width, (double) height, 0});
+}
+
+static void on_framebuffer_size(GLFWwindow *window, int width, int height) {
+    push_input({INPUT_FRAMEBUFFER_SIZE, 0, 0, (double) width, (double) height, 0});
+}
+
+static void apply_input(const InputEvent &event) {
+    // Take the flag to see whether this event changes the view, the handlers set it again if they do
+    bool redraw = take_redraw();
+    switch (event.type) {
+        case INPUT_KEY: handle_key(event.code, event.action); break;
+        case INPUT_MOUSE_BUTTON: handle_mouse_button(event.code, event.action, event.x, event.y); break;
+        case INPUT_CURSOR: handle_cursor_position(event.x, event.y); break;
+        case INPUT_SCROLL: handle_scroll(event.y); break;
+        case INPUT_WINDOW_SIZE: window_width = event.x; window_height = event.y; request_redraw(); break;
+        case INPUT_FRAMEBUFFER_SIZE: framebuffer_width = event.x; framebuffer_height = event.y; request_redraw(); break;
+        case INPUT_QUIT: quit = true; break;
+    }
+    if (take_redraw()) {
+        add_latency_input(event.time, glfwGetTime());
+        redraw = true;
+    }
+    if (redraw) {
+        request_redraw();
+    }
+}
+
+/**
+ * Handle every event that next gives.
+ * Cursor moves in a row only matter where they end up, and scrolls in a row add up, so each run is handled as one event,
+ * which keeps the time of the first one for measuring latency.
+ */
+static void apply_inputs(bool (*next)(InputEvent &event)) {
+    InputEvent event;
+    InputEvent pending;
+    bool has_pending = false;
+    while (next(event)) {
+        if (has_pending && event.type == pending.type && (event.type == INPUT_CURSOR || event.type == INPUT_SCROLL)) {
+            if (event.type == INPUT_SCROLL) {
+                pending.y += event.y;
+            } else {
+                double time = pending.time;
+                pending = event;
+                pending.time = time;
+            }
+            continue;
+        }
+        if (has_pending) {
+            apply_input(pending);
+            has_pending = false;
+        }
+        if (event.type == INPUT_CURSOR || event.type == INPUT_SCROLL) {
+            pending = event;
+            has_pending = true;
+        } else {
+            apply_input(event);
+        }
+    }
+    if (has_pending) {
+        apply_input(pending);
+    }
+}
+
+static bool pop_input(InputEvent &event) {
+    return input_events.pop(event);
+}
+
+/**
+ * Handle everything that arrived since the last frame.
+ */
+static void process_input() {
+    TRACE_ZONE("process_input");
+    apply_inputs(pop_input);
+}
+
+/**
+ * Sizes come from the window the recording is replayed in, which was opened at the recorded size.
+ */
+static bool pop_replay_input(InputEvent &event) {
+    while (replay_next < replay.events.size() && replay.events[replay_next].time <= replay_until) {
+        event = replay.events[replay_next++].event;
+        event.time = glfwGetTime();
+        if (event.type != INPUT_WINDOW_SIZE && event.type != INPUT_FRAMEBUFFER_SIZE) {
+            return true;
         }
     }
+    return false;
+}
+
+/**
+ * Handle the recorded events that are due, which are those up to the time since the replay started, or at maximum
+ * speed the next ones, so that every event that changes the view gets a frame of its own.
+ * Returns false once every event has been handled.
+ */
+static bool replay_input() {
+    if (replay_next >= replay.events.size()) {
+        return false;
+    }
+    TRACE_ZONE("replay_input");
+    replay_until = options.replay_max_speed ? replay.events[replay_next].time : glfwGetTime() - replay_start;
+    apply_inputs(pop_replay_input);
+    return true;
+}
+
+/**
+ * Seconds until the next recorded event is due, or -1 if there are none left.
+ */
+static double get_replay_delay() {
+    if (replay_next >= replay.events.size()) {
+        return -1;
+    }
+    return options.replay_max_speed ? 0 : std::fmax(0.0, replay.events[replay_next].time - (glfwGetTime() - replay_start));
+}
+
+static void finish_replay() {
+    std::cout << "Replayed " << replay_next << " of " << replay.events.size() << " events in " << glfwGetTime() - replay_start << " seconds" << std::endl;
+    glfwSetWindowShouldClose(window, 1);
+    glfwPostEmptyEvent();
+}
+
+/**
+ * Sleep until there is input, or for at most timeout seconds if it is not negative.
+ */
+static void wait_for_input(double timeout) {
+    std::unique_lock<std::mutex> lock(input_mutex);
+    auto has_input = [] { return !input_events.empty(); };
+    if (timeout < 0) {
+        input_ready.wait(lock, has_input);
+    } else {
+        input_ready.wait_for(lock, std::chrono::duration<double>(timeout), has_input);
+    }
 }
 
 static double last_time;
@@ -385,10 +762,12 @@ static void measure_fps() {
     if (dt > worst_dt) {
         worst_dt = dt;
     }
+    record_stat(STAT_FRAME, dt * 1000);
     frames_since++;
     if (nt - 10 >= (long long) last_checked) {
         std::cout << "Average time between " << frames_since << " frames: " << sum_since_checked / frames_since << ", FPS: " << (frames_since / sum_since_checked) << std::endl;
         std::cout << "Worst time between frames: " << worst_dt << ", FPS: " << (1 / worst_dt) << std::endl;
+        std::cout << "Resolution while interacting: " << get_render_scale() * 100 << "%" << std::endl;
         last_checked = nt;
         frames_since = 0;
         worst_dt = 0;
@@ -396,14 +775,265 @@ static void measure_fps() {
     }
 }
 
-#define ERR(CODE)                                               \
-    CODE                                                        \
-    {GLenum last_error;                                         \
-    while ((last_error = glGetError()) != GL_NO_ERROR) {        \
-        std::cerr << "Executing line:" << std::endl;            \
-        std::cerr << #CODE << std::endl;                        \
-        std::cerr << "Got error: " << last_error << std::endl;  \
-    }}
+/**
+ * Set up everything that needs an OpenGL context and load the starting view.
+ */
+static bool prepare_rendering() {
+    TRACE_ZONE("prepare_rendering");
+    // Before anything is compiled or uploaded, so that loading the first map is recorded too
+    set_stats_enabled(options.stats);
+
+    GLenum glew_result = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX complains about the missing X display with EGL contexts, even though it loads everything
+    if (glew_result == GLEW_ERROR_NO_GLX_DISPLAY && options.headless) {
+        glew_result = GLEW_OK;
+    }
+#endif
+    if (glew_result != GLEW_OK) {
+        std::cerr << "Failed to initialize GLEW" << std::endl;
+        return false;
+    }
+    enable_gl_debug_output();
+
+    prepare_rectangle();
+
+    output_projection = find_projection(options.projection);
+    if (!output_projection) {
+        std::cerr << "Unknown output projection " << options.projection << "!" << std::endl;
+        return false;
+    }
+    series_layers = options.series_layers;
+    if (!set_map_pack(options.map_pack) || !set_map(options.map)) {
+        std::cerr << "Failed to load map " << options.map << " of map pack " << options.map_pack << "!" << std::endl;
+        return false;
+    }
+    TimeSeries *series = get_current_map()->series;
+    if (series && options.series_position != 0) {
+        set_series_position(series, options.series_position);
+        // Batch renders are of this one position, so they wait for its frames
+        if (!wait_for_series(series)) {
+            std::cerr << "Failed to load frame " << options.series_position << " of the time series" << std::endl;
+            return false;
+        }
+    }
+    if (!update_shader()) {
+        std::cerr << "Failed to load default output projection shader " << output_projection->shader << "! Aborting!" << std::endl;
+        return false;
+    }
+    for (const std::string &name : options.views) {
+        Projection *projection = find_projection(name);
+        if (!projection) {
+            std::cerr << "Unknown view projection " << name << "!" << std::endl;
+            return false;
+        }
+        views.push_back(projection);
+    }
+    if (options.show_views && !set_views(views)) {
+        return false;
+    }
+
+    const float PI = 3.141592653589793238462;
+    set_rotation(options.longitude * PI / 180, options.latitude * PI / 180, options.roll * PI / 180);
+    zoom = options.zoom;
+    set_frame_budget(options.frame_budget);
+
+    return true;
+}
+
+/**
+ * Whether the view is changing, so that frames should be rendered quickly rather than at full resolution.
+ */
+static bool is_interacting() {
+    return roll_animating || ((drag_active || rotate_active) && glfwGetTime() - last_input_time < idle_delay);
+}
+
+static bool on_full_resolution(double time) {
+    full_resolution_pending = false;
+    request_redraw();
+    return false;
+}
+
+/**
+ * Own the OpenGL context and render only when something changed the view, until asked to quit.
+ * All input that arrived during a frame is handled at once, so a drag costs one frame per display refresh at most.
+ */
+static void render_loop() {
+    glfwMakeContextCurrent(window);
+    // Wait for the display in swaps, so that drags and animations never render frames that are not shown,
+    // except when replaying as fast as possible
+    glfwSwapInterval(replaying && options.replay_max_speed ? 0 : 1);
+    // Frames of a time series that are still loading are picked up by its timer
+    start_series_timer();
+
+    if (replaying) {
+        // Time every frame of the replay
+        reset_stats();
+        set_stats_enabled(true);
+        replay_start = glfwGetTime();
+    }
+
+    while (true) {
+        process_input();
+        bool replay_left = replaying && replay_input();
+        if (quit) {
+            // A replayed escape or a close of the window ends the replay too
+            if (replaying) {
+                finish_replay();
+            }
+            break;
+        }
+
+        run_timers(glfwGetTime());
+        if (!take_redraw()) {
+            double delay = get_timer_delay(glfwGetTime());
+            if (replaying && !replay_left && delay < 0) {
+                finish_replay();
+                replaying = false;
+            }
+            double replay_delay = replaying ? get_replay_delay() : -1;
+            if (replay_delay >= 0 && (delay < 0 || replay_delay < delay)) {
+                delay = replay_delay;
+            }
+            // Sleep until there is input or a timer or recorded event is due
+            if (delay != 0) {
+                wait_for_input(delay);
+            }
+            continue;
+        }
+
+        TRACE_ZONE("frame");
+        start_frame();
+
+        bool scaled = render_map_scaled(framebuffer_width, framebuffer_height, is_interacting());
+        submit_latency_frame(glfwGetTime());
+
+        {
+            TRACE_ZONE("swap_buffers");
+            glfwSwapBuffers(window);
+        }
+        present_latency_frame(glfwGetTime());
+
+        measure_fps();
+
+#ifdef GL_DEBUG
+        GLenum last_error;
+        while ((last_error = glGetError()) != GL_NO_ERROR) {
+            std::cerr << "Got error: " << last_error << std::endl;
+        }
+#endif
+
+        // Render at full resolution once nothing has happened for a moment
+        if (scaled && !full_resolution_pending) {
+            full_resolution_pending = true;
+            add_timer(last_input_time + idle_delay, 0, on_full_resolution);
+        }
+    }
+
+    render_stopped = true;
+    glfwMakeContextCurrent(NULL);
+}
+
+/**
+ * Handle window events on the main thread, as GLFW requires, while a render thread draws the map.
+ * Rendering goes on while the main thread is stuck in a resize or move of the window.
+ */
+static void run_window() {
+    glfwGetWindowSize(window, &window_width, &window_height);
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+    glfwSetWindowSizeCallback(window, on_window_size);
+    glfwSetFramebufferSizeCallback(window, on_framebuffer_size);
+
+    if (!options.record_file.empty() && start_recording(options.record_file, window_width, window_height, glfwGetTime())) {
+        std::cout << "Recording input to " << options.record_file << std::endl;
+    }
+
+    glfwMakeContextCurrent(NULL);
+    std::thread render_thread(render_loop);
+
+    bool grabbed = false;
+    while (!glfwWindowShouldClose(window)) {
+        // Held input is handed over once the render thread has made room, even if nothing else happens
+        if (cursor_held || scroll_held) {
+            glfwWaitEventsTimeout(0.01);
+        } else {
+            glfwWaitEvents();
+        }
+        flush_held_input(false);
+        if (cursor_grabbed != grabbed) {
+            grabbed = cursor_grabbed;
+            glfwSetCursor(window, grabbed ? grab : normal);
+        }
+    }
+
+    // Closing the window is not part of the session, a replay ends on its own once the events run out
+    stop_recording();
+    push_input({INPUT_QUIT, 0, 0, 0, 0, 0});
+    render_thread.join();
+
+    if (stats_enabled) {
+        print_stats();
+        dump_stats(options.stats_file);
+    }
+}
+
+static bool is_batch() {
+    return options.export_poster || !options.animation_file.empty() || options.check;
+}
+
+/**
+ * Run the jobs that render without any interaction.
+ */
+static bool run_batch() {
+    if (options.export_poster && !export_poster(options.poster_file, options.poster_width, options.poster_height)) {
+        return false;
+    }
+    if (!options.animation_file.empty() && !render_animation(options)) {
+        return false;
+    }
+    if (options.check && !run_regression_checks(options)) {
+        return false;
+    }
+    return true;
+}
+
+static int run_headless() {
+    if (!create_headless_context()) {
+        return 1;
+    }
+
+    int exit_code = 1;
+    if (prepare_rendering()) {
+        std::cout << "Rendering headless with " << glGetString(GL_RENDERER) << std::endl;
+        if (run_batch()) {
+            exit_code = 0;
+        }
+    }
+
+    destroy_headless_context();
+    return exit_code;
+}
+
+/**
+ * Start tracing if MAPPROJECTION_TRACE or --trace FILE names a trace file. --trace is taken out of the arguments
+ * wherever it is, so that it works the same with every command.
+ */
+static void parse_trace_option(int &argc, char **argv) {
+    const char *filename = std::getenv("MAPPROJECTION_TRACE");
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+            filename = argv[++i];
+            continue;
+        }
+        argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    if (filename && *filename) {
+        start_tracing(filename);
+    }
+}
 
 #ifdef WIN32
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nCmdShow)
@@ -411,6 +1041,43 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine,
 int main(int argc, char** argv)
 #endif
 {
+#ifdef WIN32
+    int argc = __argc;
+    char **argv = __argv;
+#endif
+    parse_trace_option(argc, argv);
+
+    // Reprojecting image files runs on the CPU and needs neither a window nor OpenGL
+    if (argc > 1 && std::string(argv[1]) == "reproject") {
+        return run_reproject_command(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "transform") {
+        return run_transform_command(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        return run_serve_command(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "pyramid") {
+        return run_pyramid_command(argc - 1, argv + 1);
+    }
+
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    // Only the manifest is read here, which stays quick however many maps it lists
+    if (!load_map_catalog(options.maps_file)) {
+        return 1;
+    }
+    if (options.list_maps) {
+        return print_map_catalog() ? 0 : 1;
+    }
+
+    if (options.headless) {
+        return run_headless();
+    }
+
     if (!glfwInit()) {
         std::cerr << "Failed to init GLFW!" << std::endl;
         const char* error_description = "";
@@ -424,8 +1091,26 @@ int main(int argc, char** argv)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef GL_DEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
 
-    GLFWwindow* window = glfwCreateWindow(1920, 1080, "Map projection demo", NULL, NULL);
+    // Batch rendering only needs the OpenGL context
+    if (is_batch()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
+    // Recorded cursor positions only land on the same points of the map in a window of the same size
+    if (!options.replay_file.empty()) {
+        if (!load_recording(options.replay_file, replay)) {
+            glfwTerminate();
+            return 1;
+        }
+        replaying = true;
+    }
+
+    int exit_code = 0;
+    window = glfwCreateWindow(replaying ? replay.window_width : 1920, replaying ? replay.window_height : 1080, "Map projection demo", NULL, NULL);
 
     if (!window) {
         std::cerr << "Failed to create window!" << std::endl;
@@ -437,10 +1122,13 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    glfwSetKeyCallback(window, handle_key);
-    glfwSetCursorPosCallback(window, handle_cursor_position);
-    glfwSetMouseButtonCallback(window, handle_mouse_button);
-    glfwSetScrollCallback(window, handle_scroll);
+    // A replay is only driven by the recording
+    if (!replaying) {
+        glfwSetKeyCallback(window, on_key);
+        glfwSetCursorPosCallback(window, on_cursor_position);
+        glfwSetMouseButtonCallback(window, on_mouse_button);
+        glfwSetScrollCallback(window, on_scroll);
+    }
 
     {
         Image window_icon;
@@ -458,81 +1146,27 @@ int main(int argc, char** argv)
 
     glfwMakeContextCurrent(window);
 
-    if (glewInit() != GLEW_OK) {
-        std::cerr << "Failed to initialize GLEW" << std::endl;
-        return 1;
-    }
-
     normal = glfwCreateStandardCursor(GLFW_CURSOR_NORMAL);
     grab = glfwCreateStandardCursor(GLFW_CROSSHAIR_CURSOR);
 
-    prepare_rectangle();
-
-    output_projection = &equirectangular;
-    if (!set_map_pack(0)) {
-        std::cerr << "Failed to load map pack 0!" << std::endl;
-        goto clean;
-    }
-    if (!update_shader()) {
-        std::cerr << "Failed to load default output projection shader " << output_projection->shader << "! Aborting!" << std::endl;
+    if (!prepare_rendering()) {
+        exit_code = 1;
         goto clean;
     }
 
-    while (true) {
-        start_frame();
-
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-
-        if (width != current_shader->last_width || height != current_shader->last_height) {
-            current_shader->last_width = width;
-            current_shader->last_height = height;
-            glViewport(0, 0, width, height);
-            float scale_x = 1;
-            float scale_y = 1;
-            if (height * output_projection->width > width * output_projection->height) {
-                scale_y = output_projection->height / output_projection->width * width / height;
-            } else {
-                scale_x = output_projection->width / output_projection->height * height / width;
-            }
-            ERR(glUseProgram(current_shader->shader.program_id);)
-            ERR(glUniform2f(current_shader->scale_id, scale_x, scale_y);)
-        }
-
-        ERR(glUseProgram(current_shader->shader.program_id);)
-        ERR(glActiveTexture(GL_TEXTURE0);)
-        ERR(glBindTexture(GL_TEXTURE_2D, get_current_map()->texture.texture_id);)
-        ERR(glUniform1i(current_shader->texture_sampler_id, 0);)
-        ERR(glUniform1f(current_shader->zoom_id, zoom);)
-        ERR(glUniform1i(current_shader->infinite_mode_id, infinite_mode);)
-        ERR(render_rectangle(current_shader->rotation_matrix_id);)
-
-        glfwSwapBuffers(window);
-
-        measure_fps();
-
-        GLenum last_error;
-        while ((last_error = glGetError()) != GL_NO_ERROR) {
-            std::cerr << "Got error: " << last_error << std::endl;
-        }
-
-        if (animate_roll(glfwGetTime())) {
-            glfwPollEvents();
-        } else {
-            glfwWaitEvents();
-        }
-
-        if (glfwWindowShouldClose(window)) {
-            break;
+    if (is_batch()) {
+        if (!run_batch()) {
+            exit_code = 1;
         }
+        goto clean;
     }
 
+    run_window();
+
 clean:
     glfwDestroyWindow(window);
 
     glfwTerminate();
 
-    return 0;
+    return exit_code;
 }
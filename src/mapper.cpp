@@ -3,6 +3,8 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "glstate.h"
+
 // Magic constant
 const float PI = 3.141592653589793238462;
 
@@ -12,30 +14,41 @@ const float PI = 3.141592653589793238462;
  */
 static float rot_mat[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
 
-void rotate_roll(float roll) {
-    float sz = std::sin(roll), cz = std::cos(roll);
-
-    float rotz[9] = {
-        cz, sz, 0,
-        -sz, cz, 0,
-        0, 0, 1
-    };
-    
+/**
+ * Multiply matrix by rotation from the left.
+ */
+static void apply_rotation(const float rotation[9], float matrix[9]) {
     float rot[9];
     for (int i = 0; i < 3; i++) {
         for (int j = 0; j < 3; j++) {
             rot[i * 3 + j] = 0;
             for (int k = 0; k < 3; k++) {
-                rot[i * 3 + j] += rotz[i * 3 + k] * rot_mat[k * 3 + j];
+                rot[i * 3 + j] += rotation[i * 3 + k] * matrix[k * 3 + j];
             }
         }
     }
     for (int i = 0; i < 9; i++) {
-        rot_mat[i] = rot[i];
+        matrix[i] = rot[i];
     }
 }
 
-static void rotate_by(float rx, float ry) {
+static void rotate_roll(float roll, float matrix[9]) {
+    float sz = std::sin(roll), cz = std::cos(roll);
+
+    float rotz[9] = {
+        cz, sz, 0,
+        -sz, cz, 0,
+        0, 0, 1
+    };
+
+    apply_rotation(rotz, matrix);
+}
+
+void rotate_roll(float roll) {
+    rotate_roll(roll, rot_mat);
+}
+
+static void rotate_by(float rx, float ry, float matrix[9]) {
     float sx = std::sin(-rx), cx = std::cos(-rx);
     float sy = std::sin(-ry), cy = std::cos(-ry);
 
@@ -45,19 +58,12 @@ static void rotate_by(float rx, float ry) {
         0, cx, sx,
         -sy, -sx * cy, cx * cy
     };
-    
-    float rot[9];
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            rot[i * 3 + j] = 0;
-            for (int k = 0; k < 3; k++) {
-                rot[i * 3 + j] += rotxy[i * 3 + k] * rot_mat[k * 3 + j];
-            }
-        }
-    }
-    for (int i = 0; i < 9; i++) {
-        rot_mat[i] = rot[i];
-    }
+
+    apply_rotation(rotxy, matrix);
+}
+
+static void rotate_by(float rx, float ry) {
+    rotate_by(rx, ry, rot_mat);
 }
 
 /**
@@ -121,6 +127,25 @@ bool animate_roll(float time) {
     return true;
 }
 
+void make_rotation(float longitude, float latitude, float roll, float rotation[9]) {
+    rotation[0] = 1; rotation[1] = 0; rotation[2] = 0;
+    rotation[3] = 0; rotation[4] = 1; rotation[5] = 0;
+    rotation[6] = 0; rotation[7] = 0; rotation[8] = 1;
+    rotate_by(0, longitude, rotation);
+    rotate_by(latitude, 0, rotation);
+    rotate_roll(roll, rotation);
+}
+
+void set_rotation(float longitude, float latitude, float roll) {
+    make_rotation(longitude, latitude, roll, rot_mat);
+}
+
+void get_rotation(float rotation[9]) {
+    for (int i = 0; i < 9; i++) {
+        rotation[i] = rot_mat[i];
+    }
+}
+
 void toggle_lock() {
     if (!lock_north) {
         roll_animation_lock_north = true;
@@ -158,6 +183,19 @@ void handle_rotation(double sx, double sy, double ex, double ey) {
 static GLuint main_square;
 static GLuint main_square_data;
 
+GLuint create_vertex_array(GLuint buffer) {
+    GLuint vertex_array;
+    glGenVertexArrays(1, &vertex_array);
+    bind_vertex_array(vertex_array);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*) 0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*) (3 * sizeof(GLfloat)));
+    return vertex_array;
+}
+
 void prepare_rectangle() {
     static const GLfloat main_square_vertices[] = {
         -1.0f, -1.0f, 0.0f,  0.0f, 0.0f,
@@ -169,24 +207,13 @@ void prepare_rectangle() {
         -1.0f, -1.0f, 0.0f,  0.0f, 0.0f
     };
 
-    glGenVertexArrays(1, &main_square);
-    glBindVertexArray(main_square);
-
     glGenBuffers(1, &main_square_data);
     glBindBuffer(GL_ARRAY_BUFFER, main_square_data);
     glBufferData(GL_ARRAY_BUFFER, sizeof(main_square_vertices), main_square_vertices, GL_STATIC_DRAW);
+    main_square = create_vertex_array(main_square_data);
 }
 
-void render_rectangle(GLuint rotation_matrix_id) {
-    glUniformMatrix3fv(rotation_matrix_id, 1, GL_FALSE, rot_mat);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, main_square_data);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*) 0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*) (3 * sizeof(GLfloat)));
-
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+void render_rectangle(int instances) {
+    bind_vertex_array(main_square);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances);
 }
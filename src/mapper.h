@@ -1,6 +1,8 @@
 #ifndef MAPPER_H
 #define MAPPER_H
 
+#include <GL/glew.h>
+
 void rotate_roll(float roll);
 
 /**
@@ -13,11 +15,35 @@ void reset_roll();
  */
 bool animate_roll(float time);
 
+/**
+ * Replace the rotation with one built from scratch the same way as in locked north mode,
+ * moving by longitude and latitude and then rolling around the center. All angles are in radians.
+ */
+void set_rotation(float longitude, float latitude, float roll);
+
+/**
+ * Build the same matrix as set_rotation without touching the current rotation, so it can be used from any thread.
+ */
+void make_rotation(float longitude, float latitude, float roll, float rotation[9]);
+
+/**
+ * Copy the current rotation matrix, in the same row-major layout that is given to the shader.
+ */
+void get_rotation(float rotation[9]);
+
 void toggle_lock();
 bool is_locked();
 void handle_rotation(double sx, double sy, double ex, double ey);
 
+/**
+ * Create a vertex array that reads buffer as vertices with 3 coordinates followed by 2 texture coordinates.
+ */
+GLuint create_vertex_array(GLuint buffer);
+
 void prepare_rectangle();
-void render_rectangle(GLuint rotation_matrix_id);
+/**
+ * Draw the rectangle that covers the frame instances times, which the shader tells apart by gl_InstanceID.
+ */
+void render_rectangle(int instances);
 
 #endif
@@ -1,136 +1,404 @@
 #include "maps.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <vector>
+
+#include <GL/glew.h>
 
 #include "images.h"
+#include "trace.h"
 #include "projection.h"
-#include "projections/mollweide.h"
-#include "projections/robinson.h"
-
-#define CROP(a, b, c, d) .x = a, .y = b, .w = c, .h = d
-#define NO_CROP CROP(0, 0, 0, 0)
-
-static SphereMap earth[] = {
-    {
-        .loaded = false,
-        .texture_name = "earth1.jpg",
-        .source = &equirectangular,
-        NO_CROP
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth2.jpg",
-        .source = &equirectangular,
-        NO_CROP
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth3.jpg",
-        .source = &equirectangular,
-        NO_CROP
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth4.jpg",
-        .source = &equirectangular,
-        NO_CROP
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth5.jpg",
-        .source = &azimuthal
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth6.jpg",
-        .source = &mollweide,
-        CROP(6, 7, -6, -7)
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth7.png",
-        .source = &mollweide,
-        CROP(16, 18, 1579, 787)
-    },
-    {
-        .loaded = false,
-        .texture_name = "earth8.jpg",
-        .source = &robinson,
-        CROP(1, 1, -1, -1)
-    }
+
+static const std::string default_catalog_file = "res/maps.txt";
+static const std::string image_dir = "./res/images/";
+
+struct SphereMapPack {
+    std::string name;
+    std::vector<SphereMap> maps;
+    unsigned int current_map;
 };
-static SphereMap moon[] = {
-    {
-        .loaded = false,
-        .texture_name = "moon1.jpg",
-        .source = &equirectangular,
-        NO_CROP
+
+static std::vector<SphereMapPack> map_packs;
+static unsigned int current_map_pack;
+static std::string catalog_file;
+// Set once a catalog was read, so that the default one is not read on top of it
+static bool catalog_loaded = false;
+static std::once_flag default_catalog;
+
+static bool catalog_error(const std::string &filename, unsigned int line, const std::string &message) {
+    std::cerr << filename << ":" << line << ": " << message << std::endl;
+    return false;
+}
+
+/**
+ * Parse a crop given as X,Y,W,H, the same way as the crops of reproject.
+ */
+static bool parse_crop(const std::string &text, SphereMap &map) {
+    char end;
+    if (std::sscanf(text.c_str(), "%d,%d,%d,%d%c", &map.x, &map.y, &map.w, &map.h, &end) != 4) {
+        return false;
     }
-};
-static SphereMap mars[] = {
-    {
-        .loaded = false,
-        .texture_name = "mars1.jpg",
-        .source = &equirectangular,
-        NO_CROP
-    },
-    {
-        .loaded = false,
-        .texture_name = "mars2.jpg",
-        .source = &equirectangular,
-        NO_CROP
+    return map.x >= 0 && map.y >= 0;
+}
+
+/**
+ * Parse frames given as FIRST-LAST, where pattern has to number them with a single %d, optionally padded like %03d.
+ */
+static bool parse_frames(const std::string &text, SphereMap &map) {
+    unsigned int first, last;
+    char end;
+    if (std::sscanf(text.c_str(), "%u-%u%c", &first, &last, &end) != 2 || first > last) {
+        return false;
     }
-};
-static SphereMap jupiter[] = {
-    {
-        .loaded = false,
-        .texture_name = "jupiter1.jpg",
-        .source = &equirectangular,
-        NO_CROP
+    map.first_frame = first;
+    map.frame_count = last - first + 1;
+    return true;
+}
+
+static bool parse_opacity(const std::string &text, SphereMap &map) {
+    char *end;
+    map.opacity = std::strtof(text.c_str(), &end);
+    return *end == '\0' && map.opacity >= 0 && map.opacity <= 1;
+}
+
+static bool is_frame_pattern(const std::string &pattern) {
+    std::size_t position = pattern.find('%');
+    if (position == std::string::npos || pattern.find('%', position + 1) != std::string::npos) {
+        return false;
     }
-};
-static SphereMap saturn[] = {
-    {
-        .loaded = false,
-        .texture_name = "saturn1.jpg",
-        .source = &equirectangular,
-        NO_CROP
+    std::size_t end = pattern.find_first_not_of("0123456789", position + 1);
+    return end != std::string::npos && pattern[end] == 'd';
+}
+
+static bool parse_catalog(const std::string &filename, std::vector<SphereMapPack> &packs) {
+    TRACE_ZONE("parse_catalog");
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to open the map catalog " << filename << std::endl;
+        return false;
     }
-};
-static SphereMap universe[] = {
-    {
-        .loaded = false,
-        .texture_name = "universe1.png",
-        .source = &mollweide,
-        NO_CROP
+
+    std::string line;
+    unsigned int number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        std::size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first)) {
+            continue;
+        }
+
+        if (first == "pack") {
+            SphereMapPack pack = {"", {}, 0};
+            std::string rest;
+            if (!(words >> pack.name) || words >> rest) {
+                return catalog_error(filename, number, "expected pack NAME");
+            }
+            packs.push_back(pack);
+            continue;
+        }
+        if (packs.empty()) {
+            return catalog_error(filename, number, "map " + first + " comes before the first pack");
+        }
+        bool overlay = first == "+";
+        if (overlay) {
+            if (packs.back().maps.empty()) {
+                return catalog_error(filename, number, "overlay comes before the first map of pack " + packs.back().name);
+            }
+            if (packs.back().maps.back().overlays.size() >= max_overlays) {
+                return catalog_error(filename, number, "a map can have at most " + std::to_string(max_overlays) + " overlays");
+            }
+            if (!(words >> first)) {
+                return catalog_error(filename, number, "expected + FILE SOURCE");
+            }
+        }
+
+        SphereMap map = {};
+        map.loaded = false;
+        map.info_loaded = false;
+        map.series = nullptr;
+        map.opacity = 1;
+        map.texture_name = first;
+        std::string source;
+        if (!(words >> source) || !(map.source = find_projection(source))) {
+            return catalog_error(filename, number, "expected the source projection of " + first);
+        }
+        std::string key;
+        while (words >> key) {
+            std::string value;
+            if (!(words >> value)) {
+                return catalog_error(filename, number, "missing value of " + key);
+            }
+            if (key == "crop") {
+                if (!parse_crop(value, map)) {
+                    return catalog_error(filename, number, "invalid crop " + value);
+                }
+            } else if (overlay && key == "opacity") {
+                if (!parse_opacity(value, map)) {
+                    return catalog_error(filename, number, "invalid opacity " + value);
+                }
+            } else if (overlay) {
+                return catalog_error(filename, number, "unknown overlay field " + key);
+            } else if (key == "pyramid") {
+                map.pyramid_dir = value;
+            } else if (key == "frames") {
+                if (!parse_frames(value, map)) {
+                    return catalog_error(filename, number, "invalid frames " + value);
+                }
+                if (!is_frame_pattern(first)) {
+                    return catalog_error(filename, number, first + " has to number its frames with a single %d");
+                }
+            } else {
+                return catalog_error(filename, number, "unknown field " + key);
+            }
+        }
+        if (overlay) {
+            packs.back().maps.back().overlays.push_back(map);
+        } else {
+            packs.back().maps.push_back(map);
+        }
     }
-};
 
-struct SphereMapPack {
-    SphereMap *maps;
-    int count;
-    int current_map;
-};
+    if (packs.empty()) {
+        std::cerr << "The map catalog " << filename << " has no packs" << std::endl;
+        return false;
+    }
+    for (const SphereMapPack &pack : packs) {
+        if (pack.maps.empty()) {
+            std::cerr << "Pack " << pack.name << " in " << filename << " has no maps" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
 
-#define MAP_PACK(x) {x, sizeof(x) / sizeof(*x), 0}
+bool load_map_catalog(const std::string &filename) {
+    std::vector<SphereMapPack> packs;
+    if (!parse_catalog(filename, packs)) {
+        return false;
+    }
+    map_packs.swap(packs);
+    current_map_pack = 0;
+    catalog_file = filename;
+    catalog_loaded = true;
+    return true;
+}
 
-static SphereMapPack map_packs[] = {
-    MAP_PACK(earth),
-    MAP_PACK(moon),
-    MAP_PACK(mars),
-    MAP_PACK(jupiter),
-    MAP_PACK(saturn),
-    MAP_PACK(universe),
-};
-static unsigned int current_map_pack;
+/**
+ * Read the default catalog unless one was read already. The tile server looks up maps from many threads at once.
+ */
+static void ensure_catalog() {
+    std::call_once(default_catalog, []() {
+        if (!catalog_loaded) {
+            load_map_catalog(default_catalog_file);
+        }
+    });
+}
+
+/**
+ * Whether a and b show the same images, and so can share their textures. The overlays are part of a map's images.
+ */
+static bool is_same_image(const SphereMap &a, const SphereMap &b) {
+    if (a.overlays.size() != b.overlays.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.overlays.size(); i++) {
+        if (!is_same_image(a.overlays[i], b.overlays[i])) {
+            return false;
+        }
+    }
+    return a.texture_name == b.texture_name && a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h && a.first_frame == b.first_frame && a.frame_count == b.frame_count;
+}
+
+/**
+ * Move the textures and header sizes of old_map and its overlays to map, which shows the same images.
+ */
+static void take_textures(SphereMap &map, SphereMap &old_map) {
+    map.loaded = old_map.loaded;
+    map.texture = old_map.texture;
+    map.series = old_map.series;
+    map.info_loaded = old_map.info_loaded;
+    map.info = old_map.info;
+    old_map.loaded = false;
+    old_map.info_loaded = false;
+    for (std::size_t i = 0; i < map.overlays.size(); i++) {
+        take_textures(map.overlays[i], old_map.overlays[i]);
+    }
+}
+
+static void free_textures(SphereMap &map) {
+    if (map.loaded && map.series) {
+        close_time_series(map.series);
+    } else if (map.loaded) {
+        free_texture(map.texture);
+    }
+    map.loaded = false;
+    for (SphereMap &overlay : map.overlays) {
+        free_textures(overlay);
+    }
+}
+
+static std::string get_map_name(const SphereMap &map) {
+    return map.texture_name.substr(0, map.texture_name.find_last_of('.'));
+}
+
+/**
+ * A map of packs that shows the same image as map and has its texture or at least its size, preferring the texture.
+ */
+static SphereMap *find_same_image(std::vector<SphereMapPack> &packs, const SphereMap &map) {
+    SphereMap *found = nullptr;
+    for (SphereMapPack &pack : packs) {
+        for (SphereMap &other : pack.maps) {
+            if (is_same_image(map, other) && (other.loaded || (other.info_loaded && !found))) {
+                found = &other;
+            }
+        }
+    }
+    return found;
+}
+
+static bool set_map(unsigned int pack, unsigned int id);
+
+bool reload_map_catalog() {
+    TRACE_ZONE("reload_map_catalog");
+    ensure_catalog();
+    std::vector<SphereMapPack> packs;
+    if (!parse_catalog(catalog_file.empty() ? default_catalog_file : catalog_file, packs)) {
+        std::cerr << "Keeping the maps from before" << std::endl;
+        return false;
+    }
+
+    // Textures and header sizes are moved to the maps that show the same image, the rest are freed
+    for (SphereMapPack &pack : packs) {
+        for (SphereMap &map : pack.maps) {
+            SphereMap *old_map = find_same_image(map_packs, map);
+            if (old_map) {
+                take_textures(map, *old_map);
+            }
+        }
+    }
+
+    std::string current_pack;
+    std::string current_map;
+    if (!map_packs.empty()) {
+        current_pack = map_packs[current_map_pack].name;
+        current_map = get_map_name(*get_current_map());
+    }
+    for (SphereMapPack &old_pack : map_packs) {
+        for (SphereMap &old_map : old_pack.maps) {
+            free_textures(old_map);
+        }
+    }
+    map_packs.swap(packs);
+
+    unsigned int maps = 0;
+    for (const SphereMapPack &pack : map_packs) {
+        maps += pack.maps.size();
+    }
+    std::cout << "Reloaded " << maps << " maps in " << map_packs.size() << " packs" << std::endl;
+
+    for (unsigned int pack = 0; pack < map_packs.size(); pack++) {
+        if (map_packs[pack].name != current_pack) {
+            continue;
+        }
+        for (unsigned int i = 0; i < map_packs[pack].maps.size(); i++) {
+            if (get_map_name(map_packs[pack].maps[i]) == current_map && set_map(pack, i)) {
+                current_map_pack = pack;
+                return true;
+            }
+        }
+    }
+    current_map_pack = 0;
+    return set_map(0, 0);
+}
+
+/**
+ * Size of the crop of a map whose info is loaded, in the same way as crop_image.
+ */
+static void get_crop_size(const SphereMap &map, int &w, int &h) {
+    w = map.w <= 0 ? (int) map.info.width + map.w - map.x : map.w;
+    h = map.h <= 0 ? (int) map.info.height + map.h - map.y : map.h;
+}
+
+std::string get_frame_name(const SphereMap &map, unsigned int frame) {
+    if (map.frame_count == 0) {
+        return map.texture_name;
+    }
+    char name[4096];
+    std::snprintf(name, sizeof(name), map.texture_name.c_str(), map.first_frame + frame);
+    return name;
+}
+
+bool load_map_info(SphereMap &map) {
+    if (!map.info_loaded) {
+        // The first frame stands in for the size of every frame, which is checked again as each one is decoded
+        if (!read_image_info(image_dir + get_frame_name(map, 0), map.info)) {
+            return false;
+        }
+        map.info_loaded = true;
+    }
+
+    int w, h;
+    get_crop_size(map, w, h);
+    if (w <= 0 || h <= 0 || map.x + w > map.info.width || map.y + h > map.info.height) {
+        std::cerr << "Crop " << map.x << "," << map.y << "," << map.w << "," << map.h << " of " << map.texture_name << " does not fit into its " << map.info.width << "x" << map.info.height << " image" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool load_map_texture(SphereMap &sm) {
+    if (sm.loaded) {
+        return true;
+    }
+    // Only the headers are read to check the crop and size, before decoding the whole image
+    if (!load_map_info(sm)) {
+        return false;
+    }
+    int w, h;
+    get_crop_size(sm, w, h);
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (get_padded_size(w) > (unsigned int) max_size || get_padded_size(h) > (unsigned int) max_size) {
+        std::cerr << sm.texture_name << " is too large for a texture, which can be at most " << max_size << " pixels wide" << std::endl;
+        return false;
+    }
+    if (sm.frame_count > 0) {
+        std::vector<std::string> filenames;
+        for (unsigned int i = 0; i < sm.frame_count; i++) {
+            filenames.push_back(image_dir + get_frame_name(sm, i));
+        }
+        if (!(sm.series = open_time_series(filenames, sm.info, sm.x, sm.y, sm.w, sm.h, sm.texture))) {
+            return false;
+        }
+        sm.loaded = true;
+    } else if (!(sm.loaded = load_texture(sm.texture_name, sm.texture, sm.x, sm.y, sm.w, sm.h))) {
+        return false;
+    }
+    return true;
+}
 
 static bool set_map(unsigned int pack, unsigned int id) {
-    if (id >= map_packs[pack].count) {
+    TRACE_ZONE("set_map");
+    if (pack >= map_packs.size() || id >= map_packs[pack].maps.size()) {
         return false;
     }
     SphereMap &sm = map_packs[pack].maps[id];
-    if (!sm.loaded) {
-        if (!(sm.loaded = load_texture(sm.texture_name, sm.texture, sm.x, sm.y, sm.w, sm.h))) {
+    if (!load_map_texture(sm)) {
+        return false;
+    }
+    for (SphereMap &overlay : sm.overlays) {
+        if (!load_map_texture(overlay)) {
             return false;
         }
     }
@@ -139,11 +407,13 @@ static bool set_map(unsigned int pack, unsigned int id) {
 }
 
 bool set_map(unsigned int id) {
+    ensure_catalog();
     return set_map(current_map_pack, id);
 }
 
 bool set_map_pack(unsigned int id) {
-    if (id >= sizeof(map_packs) / sizeof(*map_packs)) {
+    ensure_catalog();
+    if (id >= map_packs.size()) {
         return false;
     }
 
@@ -155,7 +425,101 @@ bool set_map_pack(unsigned int id) {
     return false;
 }
 
+unsigned int get_map_pack_count() {
+    ensure_catalog();
+    return map_packs.size();
+}
+
+unsigned int get_map_count() {
+    ensure_catalog();
+    return map_packs.empty() ? 0 : map_packs[current_map_pack].maps.size();
+}
+
+unsigned int get_current_map_pack_id() {
+    return current_map_pack;
+}
+
+unsigned int get_current_map_id() {
+    return map_packs.empty() ? 0 : map_packs[current_map_pack].current_map;
+}
+
+SphereMap *find_map(const std::string &name) {
+    ensure_catalog();
+    for (SphereMapPack &pack : map_packs) {
+        for (SphereMap &map : pack.maps) {
+            if (get_map_name(map) == name) {
+                return &map;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool set_map(const std::string &name) {
+    ensure_catalog();
+    for (unsigned int pack = 0; pack < map_packs.size(); pack++) {
+        for (unsigned int i = 0; i < map_packs[pack].maps.size(); i++) {
+            if (get_map_name(map_packs[pack].maps[i]) == name && set_map(pack, i)) {
+                current_map_pack = pack;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool load_map_image(const SphereMap &map, struct Image &image) {
+    TRACE_ZONE("load_map_image");
+    unsigned int frame = map.series ? (unsigned int) get_series_position(map.series) : 0;
+    if (!load_image(image_dir + get_frame_name(map, frame), image)) {
+        return false;
+    }
+    if (!crop_image(image, map.x, map.y, map.w, map.h)) {
+        free_image(image);
+        return false;
+    }
+    return true;
+}
+
+bool print_map_catalog() {
+    ensure_catalog();
+    bool result = !map_packs.empty();
+    for (unsigned int pack = 0; pack < map_packs.size(); pack++) {
+        std::cout << "pack " << pack << " " << map_packs[pack].name << std::endl;
+        for (unsigned int i = 0; i < map_packs[pack].maps.size(); i++) {
+            SphereMap &map = map_packs[pack].maps[i];
+            bool readable = load_map_info(map);
+            std::cout << "  " << i << " " << map.texture_name << " " << map.source->shader;
+            if (readable) {
+                std::cout << " " << map.info.width << "x" << map.info.height << "x" << (int) map.info.channels;
+                if (map.frame_count > 0) {
+                    std::cout << " " << map.frame_count << " frames";
+                }
+            } else {
+                std::cout << " unreadable";
+                result = false;
+            }
+            std::cout << std::endl;
+            for (SphereMap &overlay : map.overlays) {
+                bool overlay_readable = load_map_info(overlay);
+                std::cout << "    + " << overlay.texture_name << " " << overlay.source->shader;
+                if (overlay_readable) {
+                    std::cout << " " << overlay.info.width << "x" << overlay.info.height << "x" << (int) overlay.info.channels;
+                } else {
+                    std::cout << " unreadable";
+                    result = false;
+                }
+                std::cout << " opacity " << overlay.opacity << std::endl;
+            }
+        }
+    }
+    return result;
+}
+
 SphereMap* get_current_map() {
+    if (map_packs.empty()) {
+        return nullptr;
+    }
     SphereMapPack &pack = map_packs[current_map_pack];
     return &pack.maps[pack.current_map];
 }
@@ -2,9 +2,11 @@
 #define MAPS_H
 
 #include <string>
+#include <vector>
 
 #include "images.h"
 #include "projection.h"
+#include "series.h"
 
 struct SphereMap {
     bool loaded;
@@ -15,10 +17,77 @@ struct SphereMap {
     int y;
     int w;
     int h;
+    // Where the pyramid command writes this map's tiles by default, empty for none
+    std::string pyramid_dir;
+    // The size of the image from its headers, see load_map_info
+    bool info_loaded;
+    Image info;
+    // A time series of images numbered from first_frame when frame_count is not 0, with texture_name as the pattern
+    unsigned int first_frame;
+    unsigned int frame_count;
+    // Set while a time series is loaded, in which case texture is its array texture
+    TimeSeries *series;
+    // Images drawn over the map in order, each with its own source projection and crop, see get_layer_code
+    std::vector<SphereMap> overlays;
+    // How much of an overlay covers what is below it, the map itself is always opaque
+    float opacity;
 };
 
+// As many as there are texture units left next to the map and the lookup tables of the projections
+static const unsigned int max_overlays = 4;
+
+/**
+ * Read the packs of maps from a manifest, see res/maps.txt for its format. Only the manifest is read, images are
+ * read when their map is first shown. Without a call to this, the catalog is read from res/maps.txt on first use.
+ * Pointers to maps stay valid until the catalog is read again.
+ */
+bool load_map_catalog(const std::string &filename);
+
+/**
+ * Read the same manifest again, keeping the textures of the maps whose image and crop did not change, and the
+ * current map if it is still in the catalog. The catalog from before is kept if the manifest can not be read.
+ */
+bool reload_map_catalog();
+
 bool set_map(unsigned int id);
 bool set_map_pack(unsigned int id);
 SphereMap* get_current_map();
 
+unsigned int get_map_pack_count();
+// Number of maps in the current pack
+unsigned int get_map_count();
+unsigned int get_current_map_pack_id();
+unsigned int get_current_map_id();
+
+/**
+ * Find a map in any pack by the name of its image without the extension, like earth7, or return nullptr.
+ */
+SphereMap *find_map(const std::string &name);
+
+/**
+ * Make the map with the same name as in find_map current, along with its pack.
+ */
+bool set_map(const std::string &name);
+
+/**
+ * The file name of a frame of a time series, or of the map's image if it has no frames.
+ */
+std::string get_frame_name(const SphereMap &map, unsigned int frame);
+
+/**
+ * Load a map's image for use on the CPU, cropped the same way as its texture, without its overlays.
+ * For a time series this is the frame at the position if it is loaded, or the first frame otherwise.
+ */
+bool load_map_image(const SphereMap &map, struct Image &image);
+
+/**
+ * Read the size of a map's image from its headers once, and check that the crop fits into it. Overlays are left out.
+ */
+bool load_map_info(SphereMap &map);
+
+/**
+ * Print every pack and map with the size of its image, returns false if any of the images can not be read.
+ */
+bool print_map_catalog();
+
 #endif
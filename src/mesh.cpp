@@ -0,0 +1,201 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+/**
+ * Cells start this many pixels wide, and are split until they are at most min_cell_size pixels wide.
+ * Cells that still can not be interpolated at that size are left to the per pixel shader.
+ */
+static const unsigned int base_cell_size = 32;
+static const unsigned int min_cell_size = 4;
+
+struct MeshPoint {
+    // Screen coordinate from (0, 0) at the bottom left to (1, 1), like UV in the shader
+    double x, y;
+    // Texture coordinate, only set if valid
+    double s, t;
+    bool valid;
+};
+
+struct MeshBuilder {
+    const Reprojection &reprojection;
+    double scale_x, scale_y;
+    unsigned int width, height;
+    unsigned int texture_width, texture_height;
+    Mesh &mesh;
+};
+
+static MeshPoint evaluate(const MeshBuilder &builder, double x, double y) {
+    MeshPoint point = {x, y, 0, 0, false};
+    point.valid = output_to_source(builder.reprojection, (2 * x - 1) / builder.scale_x, (2 * y - 1) / builder.scale_y, point.s, point.t);
+    return point;
+}
+
+static MeshPoint evaluate_between(const MeshBuilder &builder, const MeshPoint &a, const MeshPoint &b) {
+    return evaluate(builder, (a.x + b.x) / 2, (a.y + b.y) / 2);
+}
+
+/**
+ * How far the point is from the middle of a and b, in pixels of the texture.
+ */
+static double interpolation_error(const MeshBuilder &builder, const MeshPoint &point, const MeshPoint &a, const MeshPoint &b) {
+    return std::fmax(std::abs(point.s - (a.s + b.s) / 2) * builder.texture_width, std::abs(point.t - (a.t + b.t) / 2) * builder.texture_height);
+}
+
+/**
+ * Add the cell as two triangles split along the diagonal from corner 0 to corner 2.
+ * With screen_uv, UV is the screen coordinate instead of the texture coordinate.
+ */
+static void add_cell(std::vector<float> &list, const MeshPoint corners[4], bool screen_uv) {
+    static const int order[6] = {0, 1, 2, 2, 3, 0};
+    for (int i : order) {
+        const MeshPoint &point = corners[i];
+        list.push_back(2 * point.x - 1);
+        list.push_back(2 * point.y - 1);
+        list.push_back(0);
+        list.push_back(screen_uv ? point.x : point.s);
+        list.push_back(screen_uv ? point.y : point.t);
+    }
+}
+
+/**
+ * Corners go counter-clockwise from the bottom left, like the rectangle in mapper.
+ */
+static void refine(const MeshBuilder &builder, const MeshPoint corners[4]) {
+    // Midpoints of the bottom, right, top and left edges, then the center
+    MeshPoint middle[5];
+    for (int i = 0; i < 4; i++) {
+        middle[i] = evaluate_between(builder, corners[i], corners[(i + 1) % 4]);
+    }
+    middle[4] = evaluate_between(builder, corners[0], corners[2]);
+
+    int valid = 0;
+    for (int i = 0; i < 4; i++) {
+        valid += corners[i].valid + middle[i].valid;
+    }
+    valid += middle[4].valid;
+    // Samples are a few pixels apart, so a cell where all of them are outside of the projection has nothing to draw
+    if (valid == 0) {
+        return;
+    }
+
+    double cell_pixels = std::fmax((corners[1].x - corners[0].x) * builder.width, (corners[3].y - corners[0].y) * builder.height);
+
+    if (valid == 9) {
+        // Half a pixel of the screen or of the texture, whichever is more texels
+        double span = 0;
+        for (int i = 0; i < 4; i++) {
+            const MeshPoint &a = corners[i], &b = corners[(i + 1) % 4];
+            span = std::fmax(span, std::fmax(std::abs(a.s - b.s) * builder.texture_width, std::abs(a.t - b.t) * builder.texture_height));
+        }
+        double tolerance = 0.5 * std::fmax(1.0, span / cell_pixels);
+
+        // The triangles share the diagonal, so the center is interpolated along it.
+        // Jumps across the edge of the texture, like at the antimeridian, are far off and never pass
+        double error = interpolation_error(builder, middle[4], corners[0], corners[2]);
+        for (int i = 0; i < 4; i++) {
+            error = std::fmax(error, interpolation_error(builder, middle[i], corners[i], corners[(i + 1) % 4]));
+        }
+
+        if (error <= tolerance) {
+            add_cell(builder.mesh.triangles, corners, false);
+            return;
+        }
+    }
+
+    if (cell_pixels <= min_cell_size) {
+        add_cell(builder.mesh.fallback, corners, true);
+        return;
+    }
+
+    const MeshPoint cells[4][4] = {
+        {corners[0], middle[0], middle[4], middle[3]},
+        {middle[0], corners[1], middle[1], middle[4]},
+        {middle[4], middle[1], corners[2], middle[2]},
+        {middle[3], middle[4], middle[2], corners[3]}
+    };
+    for (int i = 0; i < 4; i++) {
+        refine(builder, cells[i]);
+    }
+}
+
+/**
+ * Evaluate the corners of the first cells in every threads-th row, starting from first_row.
+ */
+static void evaluate_grid(const MeshBuilder &builder, unsigned int columns, unsigned int rows, unsigned int first_row, unsigned int threads, std::vector<MeshPoint> &grid) {
+    for (unsigned int row = first_row; row <= rows; row += threads) {
+        for (unsigned int col = 0; col <= columns; col++) {
+            double x = std::min(col * base_cell_size, builder.width) / (double) builder.width;
+            double y = std::min(row * base_cell_size, builder.height) / (double) builder.height;
+            grid[row * (columns + 1) + col] = evaluate(builder, x, y);
+        }
+    }
+}
+
+/**
+ * Refine the first cells in every threads-th row, starting from first_row.
+ */
+static void refine_grid(const MeshBuilder &builder, unsigned int columns, unsigned int rows, unsigned int first_row, unsigned int threads, const std::vector<MeshPoint> &grid) {
+    for (unsigned int row = first_row; row < rows; row += threads) {
+        for (unsigned int col = 0; col < columns; col++) {
+            const MeshPoint corners[4] = {
+                grid[row * (columns + 1) + col],
+                grid[row * (columns + 1) + col + 1],
+                grid[(row + 1) * (columns + 1) + col + 1],
+                grid[(row + 1) * (columns + 1) + col]
+            };
+            refine(builder, corners);
+        }
+    }
+}
+
+void build_mesh(const Reprojection &reprojection, unsigned int width, unsigned int height,
+                unsigned int texture_width, unsigned int texture_height, Mesh &mesh) {
+    mesh.triangles.clear();
+    mesh.fallback.clear();
+    // The lookup tables have to exist before several threads use them
+    if (!prepare_cpu_conversions()) {
+        return;
+    }
+
+    double scale_x, scale_y;
+    get_output_scale(reprojection.output, width, height, scale_x, scale_y);
+
+    // The corners of the first cells are shared between neighbours, so they are computed once
+    unsigned int columns = (width + base_cell_size - 1) / base_cell_size;
+    unsigned int rows = (height + base_cell_size - 1) / base_cell_size;
+    std::vector<MeshPoint> grid((std::size_t) (columns + 1) * (rows + 1));
+
+    // Every thread adds to its own mesh, and they are joined in the end
+    unsigned int threads = std::max(1u, std::min(std::thread::hardware_concurrency(), rows));
+    std::vector<Mesh> parts(threads);
+    std::vector<MeshBuilder> builders;
+    for (unsigned int i = 0; i < threads; i++) {
+        builders.push_back({reprojection, scale_x, scale_y, width, height, texture_width, texture_height, i == 0 ? mesh : parts[i]});
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(evaluate_grid, std::cref(builders[i]), columns, rows, i, threads, std::ref(grid));
+    }
+    evaluate_grid(builders[0], columns, rows, 0, threads, grid);
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+
+    pool.clear();
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(refine_grid, std::cref(builders[i]), columns, rows, i, threads, std::cref(grid));
+    }
+    refine_grid(builders[0], columns, rows, 0, threads, grid);
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+
+    for (unsigned int i = 1; i < threads; i++) {
+        mesh.triangles.insert(mesh.triangles.end(), parts[i].triangles.begin(), parts[i].triangles.end());
+        mesh.fallback.insert(mesh.fallback.end(), parts[i].fallback.begin(), parts[i].fallback.end());
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+
+#include "reproject.h"
+
+/**
+ * A screen covered by triangles whose texture coordinates are interpolated instead of computed for every pixel.
+ * Both lists have 5 floats per vertex like the rectangle in mapper, the position from (-1, -1) to (1, 1) and then UV.
+ */
+struct Mesh {
+    // UV is the coordinate in the source texture, from (0, 0) to (1, 1) before uv_scale
+    std::vector<float> triangles;
+    // Cells that could not be approximated, like the antimeridian and the edges of the projection.
+    // UV is the screen coordinate from (0, 0) to (1, 1), the same as the rectangle, so the normal shader can draw them
+    std::vector<float> fallback;
+};
+
+/**
+ * Build the mesh for a frame of width x height pixels that shows the whole output projection, like render_map.
+ * The mapping is computed exactly at the corners, edge midpoints and center of every cell, and cells are split in four
+ * until interpolating between the corners is off by less than half a pixel of either the texture or the screen.
+ * texture_width and texture_height are the size of the source image, which sets how small an error can be seen.
+ * The rows of cells are spread over all cores.
+ */
+void build_mesh(const Reprojection &reprojection, unsigned int width, unsigned int height,
+                unsigned int texture_width, unsigned int texture_height, Mesh &mesh);
+
+#endif
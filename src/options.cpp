@@ -0,0 +1,722 @@
+#include "options.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Parse a size given as WIDTHxHEIGHT or just WIDTH, in which case the height is set to 0.
+ */
+static bool parse_size(const std::string &text, unsigned int &width, unsigned int &height) {
+    char *end;
+    long w = std::strtol(text.c_str(), &end, 10);
+    long h = 0;
+    if (*end == 'x') {
+        h = std::strtol(end + 1, &end, 10);
+        if (h <= 0) {
+            return false;
+        }
+    }
+    if (*end != '\0' || w <= 0) {
+        return false;
+    }
+    width = w;
+    height = h;
+    return true;
+}
+
+/**
+ * Parse a crop given as X,Y,W,H, where W and H can be 0 or negative to be relative to the right and bottom edges.
+ */
+static bool parse_crop(const std::string &text, unsigned int &x, unsigned int &y, int &w, int &h) {
+    char *end;
+    long values[4];
+    const char *start = text.c_str();
+    for (int i = 0; i < 4; i++) {
+        values[i] = std::strtol(start, &end, 10);
+        if (end == start || *end != (i == 3 ? '\0' : ',')) {
+            return false;
+        }
+        start = end + 1;
+    }
+    if (values[0] < 0 || values[1] < 0) {
+        return false;
+    }
+    x = values[0];
+    y = values[1];
+    w = values[2];
+    h = values[3];
+    return true;
+}
+
+/**
+ * Parse a row-major 3x3 matrix given as 9 comma separated numbers.
+ */
+static bool parse_matrix(const std::string &text, double matrix[9]) {
+    char *end;
+    const char *start = text.c_str();
+    for (int i = 0; i < 9; i++) {
+        matrix[i] = std::strtod(start, &end);
+        if (end == start || *end != (i == 8 ? '\0' : ',')) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+/**
+ * Parse a list of names given as NAME[,NAME...].
+ */
+static bool parse_names(const std::string &text, std::vector<std::string> &names) {
+    names.clear();
+    std::size_t start = 0;
+    while (true) {
+        std::size_t end = text.find(',', start);
+        std::string name = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (name.empty()) {
+            return false;
+        }
+        names.push_back(name);
+        if (end == std::string::npos) {
+            return true;
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * Parse a rotation given as LONGITUDE,LATITUDE[,ROLL].
+ */
+static bool parse_rotation(const std::string &text, double &longitude, double &latitude, double &roll) {
+    char *end;
+    longitude = std::strtod(text.c_str(), &end);
+    if (*end != ',') {
+        return false;
+    }
+    latitude = std::strtod(end + 1, &end);
+    roll = 0;
+    if (*end == ',') {
+        roll = std::strtod(end + 1, &end);
+    }
+    return *end == '\0';
+}
+
+void print_usage() {
+    std::cerr << "Usage: MapProjection [options]" << std::endl;
+    std::cerr << "  --maps FILE              manifest of the map packs, default res/maps.txt" << std::endl;
+    std::cerr << "  --list-maps              print every map in the manifest with the size of its image and exit" << std::endl;
+    std::cerr << "  --pack N                 map pack to start with, 0-5" << std::endl;
+    std::cerr << "  --map N                  map in the pack to start with" << std::endl;
+    std::cerr << "  --projection NAME        output projection: equirect, mollweide, hammer, azimuthal, robinson, winkel or mercator" << std::endl;
+    std::cerr << "  --views NAME,NAME...     show these output projections side by side, which V toggles, default all of them" << std::endl;
+    std::cerr << "  --series-layers N        frames of a time series that are kept on the GPU at once, at least 2, default 8" << std::endl;
+    std::cerr << "  --series-speed FPS       frames of a time series that B plays per second, default 4" << std::endl;
+    std::cerr << "  --series-position F      frame of a time series to start at, fractions blending into the next frame, default 0" << std::endl;
+    std::cerr << "  --rotation LON,LAT[,ROLL] starting rotation in degrees" << std::endl;
+    std::cerr << "  --zoom Z                 starting zoom, at least 1" << std::endl;
+    std::cerr << "  --frame-budget MS        GPU time per frame while dragging before the resolution drops, default 12, 0 for off" << std::endl;
+    std::cerr << "  --stats                  record frame, GPU, texture upload and shader compile times from the start" << std::endl;
+    std::cerr << "  --stats-file FILE        JSON file that O and exiting with statistics on write them to, default stats.json" << std::endl;
+    std::cerr << "  --record FILE            record the window's input to FILE" << std::endl;
+    std::cerr << "  --replay FILE            replay the input recorded in FILE instead of taking input, then print frame statistics" << std::endl;
+    std::cerr << "  --max-speed              replay every event as soon as the one before has been drawn" << std::endl;
+    std::cerr << "  --headless               render without a window or display through EGL, needs --export, --animate or --check" << std::endl;
+    std::cerr << "  --export                 export a poster of the starting view and exit" << std::endl;
+    std::cerr << "  --poster-file FILE       file that P exports the current view to (.png or .jpg), default poster.png" << std::endl;
+    std::cerr << "  --poster-size W[xH]      size of the exported poster, the height defaults to the projection's aspect ratio" << std::endl;
+    std::cerr << "  --animate FILE           render the keyframed rotation path in FILE without showing a window, then exit" << std::endl;
+    std::cerr << "  --animation-output OUT   printf pattern for frame images (frames/%05d.png), or a .yuv file for raw I420 video" << std::endl;
+    std::cerr << "  --frames N               number of frames to render, defaults to the last keyframe" << std::endl;
+    std::cerr << "  --frame-size WxH         size of the animation frames, default 1920x1080" << std::endl;
+    std::cerr << "  --threads N              number of encoding threads, defaults to one per core" << std::endl;
+    std::cerr << "  --check                  render a fixed set of views with OpenGL and the CPU, compare them to golden images and exit" << std::endl;
+    std::cerr << "  --golden-dir DIR         directory of the golden images and timings, default res/golden" << std::endl;
+    std::cerr << "  --update-golden          write the golden images and timings instead of checking against them" << std::endl;
+    std::cerr << "  --tolerance N            channel difference above which a pixel differs, default 2" << std::endl;
+    std::cerr << "  --max-diff PERCENT       pixels that may differ from the golden images, default 0.1" << std::endl;
+    std::cerr << "  --max-parity-error N     mean channel difference allowed between OpenGL and the CPU, default 8" << std::endl;
+    std::cerr << "  --max-slowdown X         times slower than the recorded timings a case may render, default 2, 0 for off" << std::endl;
+    std::cerr << "  --check-report FILE      write the results of every case to a JSON file" << std::endl;
+    std::cerr << "  --trace FILE             write a Chrome trace of loading and rendering to FILE on exit, also MAPPROJECTION_TRACE=FILE" << std::endl;
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+    options.maps_file = "res/maps.txt";
+    options.list_maps = false;
+    options.map_pack = 0;
+    options.map = 0;
+    options.projection = "equirect";
+    options.views = {"equirect", "mollweide", "hammer", "azimuthal", "robinson", "winkel", "mercator"};
+    options.show_views = false;
+    options.series_layers = 8;
+    options.series_speed = 4;
+    options.series_position = 0;
+    options.longitude = 0;
+    options.latitude = 0;
+    options.roll = 0;
+    options.zoom = 1;
+    options.frame_budget = 12;
+    options.stats = false;
+    options.stats_file = "stats.json";
+    options.replay_max_speed = false;
+    options.headless = false;
+    options.export_poster = false;
+    options.poster_file = "poster.png";
+    options.poster_width = 8192;
+    options.poster_height = 0;
+    options.animation_output = "frame%05d.png";
+    options.frames = 0;
+    options.frame_width = 1920;
+    options.frame_height = 1080;
+    options.threads = 0;
+    options.check = false;
+    options.golden_dir = "res/golden";
+    options.update_golden = false;
+    options.pixel_tolerance = 2;
+    options.max_golden_diff = 0.1;
+    options.max_parity_error = 8;
+    options.max_slowdown = 2;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--maps" && has_value) {
+            options.maps_file = argv[++i];
+        } else if (arg == "--list-maps") {
+            options.list_maps = true;
+        } else if (arg == "--pack" && has_value) {
+            options.map_pack = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--map" && has_value) {
+            options.map = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--projection" && has_value) {
+            options.projection = argv[++i];
+        } else if (arg == "--views" && has_value) {
+            if (!parse_names(argv[++i], options.views)) {
+                std::cerr << "Invalid list of views: " << argv[i] << std::endl;
+                return false;
+            }
+            options.show_views = true;
+        } else if (arg == "--series-layers" && has_value) {
+            options.series_layers = std::strtoul(argv[++i], NULL, 10);
+            if (options.series_layers < 2) {
+                std::cerr << "Invalid number of series layers: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--series-speed" && has_value) {
+            options.series_speed = std::strtod(argv[++i], NULL);
+            if (!(options.series_speed > 0)) {
+                std::cerr << "Invalid series speed: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--series-position" && has_value) {
+            options.series_position = std::strtod(argv[++i], NULL);
+            if (!(options.series_position >= 0)) {
+                std::cerr << "Invalid series position: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--rotation" && has_value) {
+            if (!parse_rotation(argv[++i], options.longitude, options.latitude, options.roll)) {
+                std::cerr << "Invalid rotation: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--zoom" && has_value) {
+            options.zoom = std::strtod(argv[++i], NULL);
+            if (!(options.zoom >= 1)) {
+                std::cerr << "Invalid zoom: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--frame-budget" && has_value) {
+            options.frame_budget = std::strtod(argv[++i], NULL);
+            if (!(options.frame_budget >= 0)) {
+                std::cerr << "Invalid frame budget: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--stats-file" && has_value) {
+            options.stats_file = argv[++i];
+        } else if (arg == "--record" && has_value) {
+            options.record_file = argv[++i];
+        } else if (arg == "--replay" && has_value) {
+            options.replay_file = argv[++i];
+        } else if (arg == "--max-speed") {
+            options.replay_max_speed = true;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--export") {
+            options.export_poster = true;
+        } else if (arg == "--poster-file" && has_value) {
+            options.poster_file = argv[++i];
+        } else if (arg == "--poster-size" && has_value) {
+            if (!parse_size(argv[++i], options.poster_width, options.poster_height)) {
+                std::cerr << "Invalid poster size: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--animate" && has_value) {
+            options.animation_file = argv[++i];
+        } else if (arg == "--animation-output" && has_value) {
+            options.animation_output = argv[++i];
+        } else if (arg == "--frames" && has_value) {
+            options.frames = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--frame-size" && has_value) {
+            if (!parse_size(argv[++i], options.frame_width, options.frame_height) || options.frame_height == 0) {
+                std::cerr << "Invalid frame size: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--check") {
+            options.check = true;
+        } else if (arg == "--golden-dir" && has_value) {
+            options.golden_dir = argv[++i];
+        } else if (arg == "--update-golden") {
+            options.update_golden = true;
+        } else if (arg == "--tolerance" && has_value) {
+            options.pixel_tolerance = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--max-diff" && has_value) {
+            options.max_golden_diff = std::strtod(argv[++i], NULL);
+            if (!(options.max_golden_diff >= 0)) {
+                std::cerr << "Invalid golden image difference: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--max-parity-error" && has_value) {
+            options.max_parity_error = std::strtod(argv[++i], NULL);
+            if (!(options.max_parity_error >= 0)) {
+                std::cerr << "Invalid parity error: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--max-slowdown" && has_value) {
+            options.max_slowdown = std::strtod(argv[++i], NULL);
+            if (!(options.max_slowdown >= 0)) {
+                std::cerr << "Invalid slowdown: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--check-report" && has_value) {
+            options.check_report = argv[++i];
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (!options.record_file.empty() && !options.replay_file.empty()) {
+        std::cerr << "--record and --replay cannot be used together" << std::endl;
+        return false;
+    }
+
+    if (options.headless && !options.export_poster && options.animation_file.empty() && !options.check) {
+        std::cerr << "--headless needs --export, --animate or --check" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void print_reproject_usage() {
+    std::cerr << "Usage: MapProjection reproject [options] INPUT..." << std::endl;
+    std::cerr << "Inputs are image files or directories of .jpg and .png images." << std::endl;
+    std::cerr << "  --source NAME            projection of the inputs that follow, default equirect" << std::endl;
+    std::cerr << "  --crop X,Y,W,H           crop of the inputs that follow, W and H of 0 or less are relative to the right and bottom edges" << std::endl;
+    std::cerr << "  --projection NAME        output projection, default equirect" << std::endl;
+    std::cerr << "  --rotation LON,LAT[,ROLL] rotation in degrees" << std::endl;
+    std::cerr << "  --zoom Z                 zoom, at least 1" << std::endl;
+    std::cerr << "  --size W[xH]             output size, the height defaults to the projection's aspect ratio, default 2048" << std::endl;
+    std::cerr << "  --out-dir DIR            directory for the output images, default ." << std::endl;
+    std::cerr << "  --format png|jpg         output image format, default png" << std::endl;
+    std::cerr << "  --filter nearest|bilinear sampling of the inputs, default bilinear" << std::endl;
+    std::cerr << "  --threads N              number of reprojection threads, defaults to one per core" << std::endl;
+    std::cerr << "  --stream                 decode and encode images by rows, for images that do not fit into memory" << std::endl;
+    std::cerr << "  --band-rows N            output rows reprojected at a time with --stream, default 64" << std::endl;
+    std::cerr << "  --cache-rows N           source rows kept in memory with --stream, default 1024" << std::endl;
+    std::cerr << "  --cost-heatmap           write a heatmap of the time each pixel took instead, use --threads 1 for steady timings" << std::endl;
+}
+
+bool parse_reproject_options(int argc, char **argv, ReprojectOptions &options) {
+    options.projection = "equirect";
+    options.longitude = 0;
+    options.latitude = 0;
+    options.roll = 0;
+    options.zoom = 1;
+    options.width = 2048;
+    options.height = 0;
+    options.out_dir = ".";
+    options.format = "png";
+    options.bilinear = true;
+    options.threads = 0;
+    options.stream = false;
+    options.band_rows = 64;
+    options.cache_rows = 1024;
+    options.cost_heatmap = false;
+
+    ReprojectInput input = {
+        .filename = "",
+        .source = "equirect",
+        .x = 0,
+        .y = 0,
+        .w = 0,
+        .h = 0
+    };
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--source" && has_value) {
+            input.source = argv[++i];
+        } else if (arg == "--crop" && has_value) {
+            if (!parse_crop(argv[++i], input.x, input.y, input.w, input.h)) {
+                std::cerr << "Invalid crop: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--projection" && has_value) {
+            options.projection = argv[++i];
+        } else if (arg == "--rotation" && has_value) {
+            if (!parse_rotation(argv[++i], options.longitude, options.latitude, options.roll)) {
+                std::cerr << "Invalid rotation: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--zoom" && has_value) {
+            options.zoom = std::strtod(argv[++i], NULL);
+            if (!(options.zoom >= 1)) {
+                std::cerr << "Invalid zoom: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--size" && has_value) {
+            if (!parse_size(argv[++i], options.width, options.height)) {
+                std::cerr << "Invalid size: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--out-dir" && has_value) {
+            options.out_dir = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            options.format = argv[++i];
+            if (options.format != "png" && options.format != "jpg") {
+                std::cerr << "Unknown output format: " << options.format << std::endl;
+                return false;
+            }
+        } else if (arg == "--filter" && has_value) {
+            std::string filter = argv[++i];
+            if (filter != "nearest" && filter != "bilinear") {
+                std::cerr << "Unknown filter: " << filter << std::endl;
+                return false;
+            }
+            options.bilinear = filter == "bilinear";
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg == "--band-rows" && has_value) {
+            options.band_rows = std::strtoul(argv[++i], NULL, 10);
+            if (options.band_rows == 0) {
+                std::cerr << "Invalid band rows: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--cache-rows" && has_value) {
+            options.cache_rows = std::strtoul(argv[++i], NULL, 10);
+            if (options.cache_rows < 2) {
+                std::cerr << "Invalid cache rows, at least 2 are needed: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--cost-heatmap") {
+            options.cost_heatmap = true;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        } else {
+            input.filename = arg;
+            options.inputs.push_back(input);
+        }
+    }
+
+    if (options.inputs.empty()) {
+        std::cerr << "No inputs given" << std::endl;
+        return false;
+    }
+
+    if (options.cost_heatmap && options.stream) {
+        std::cerr << "--cost-heatmap cannot be used with --stream" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void print_transform_usage() {
+    std::cerr << "Usage: MapProjection transform [options] INPUT [OUTPUT]" << std::endl;
+    std::cerr << "Converts longitude,latitude pairs into map coordinates from -1 to 1, or back with --inverse." << std::endl;
+    std::cerr << "The output defaults to the standard output." << std::endl;
+    std::cerr << "  --projection NAME        map projection, default equirect" << std::endl;
+    std::cerr << "  --inverse                convert map coordinates into longitude and latitude" << std::endl;
+    std::cerr << "  --radians                longitude and latitude are in radians instead of degrees" << std::endl;
+    std::cerr << "  --format csv|binary      csv has a pair on each line, binary is little-endian pairs of doubles, default csv" << std::endl;
+    std::cerr << "  --rotation LON,LAT[,ROLL] rotation of the map in degrees, like in the viewer" << std::endl;
+    std::cerr << "  --matrix M0,...,M8       row-major rotation matrix, instead of --rotation" << std::endl;
+    std::cerr << "  --threads N              number of threads, defaults to one per core" << std::endl;
+}
+
+bool parse_transform_options(int argc, char **argv, TransformOptions &options) {
+    options.projection = "equirect";
+    options.inverse = false;
+    options.radians = false;
+    options.binary = false;
+    options.rotate = false;
+    options.longitude = 0;
+    options.latitude = 0;
+    options.roll = 0;
+    options.has_matrix = false;
+    options.threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--projection" && has_value) {
+            options.projection = argv[++i];
+        } else if (arg == "--inverse") {
+            options.inverse = true;
+        } else if (arg == "--radians") {
+            options.radians = true;
+        } else if (arg == "--format" && has_value) {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "binary") {
+                std::cerr << "Unknown format: " << format << std::endl;
+                return false;
+            }
+            options.binary = format == "binary";
+        } else if (arg == "--rotation" && has_value) {
+            if (!parse_rotation(argv[++i], options.longitude, options.latitude, options.roll)) {
+                std::cerr << "Invalid rotation: " << argv[i] << std::endl;
+                return false;
+            }
+            options.rotate = true;
+            options.has_matrix = false;
+        } else if (arg == "--matrix" && has_value) {
+            if (!parse_matrix(argv[++i], options.matrix)) {
+                std::cerr << "Invalid matrix: " << argv[i] << std::endl;
+                return false;
+            }
+            options.rotate = true;
+            options.has_matrix = true;
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        } else if (options.input.empty()) {
+            options.input = arg;
+        } else if (options.output.empty()) {
+            options.output = arg;
+        } else {
+            std::cerr << "Too many files given: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (options.input.empty()) {
+        std::cerr << "No input given" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void print_serve_usage() {
+    std::cerr << "Usage: MapProjection serve [options]" << std::endl;
+    std::cerr << "Serves /SOURCE/PROJECTION/LON,LAT[,ROLL]/Z/X/Y.png tiles and /stats on 127.0.0.1." << std::endl;
+    std::cerr << "  --maps FILE              manifest the sources are looked up in, default res/maps.txt" << std::endl;
+    std::cerr << "  --port N                 port to listen on, default 8080" << std::endl;
+    std::cerr << "  --tile-size N            width and height of tiles, default 256" << std::endl;
+    std::cerr << "  --tile-cache MB          memory for encoded tiles, default 256" << std::endl;
+    std::cerr << "  --source-cache MB        memory for decoded source images, default 1024" << std::endl;
+    std::cerr << "  --filter nearest|bilinear sampling of the sources, default bilinear" << std::endl;
+    std::cerr << "  --threads N              number of connection threads, defaults to one per core" << std::endl;
+}
+
+bool parse_serve_options(int argc, char **argv, ServeOptions &options) {
+    options.maps_file = "res/maps.txt";
+    options.port = 8080;
+    options.tile_size = 256;
+    options.tile_cache = 256;
+    options.source_cache = 1024;
+    options.bilinear = true;
+    options.threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--maps" && has_value) {
+            options.maps_file = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            options.port = std::strtoul(argv[++i], NULL, 10);
+            if (options.port == 0 || options.port > 65535) {
+                std::cerr << "Invalid port: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--tile-size" && has_value) {
+            options.tile_size = std::strtoul(argv[++i], NULL, 10);
+            if (options.tile_size == 0 || options.tile_size > 4096) {
+                std::cerr << "Invalid tile size: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--tile-cache" && has_value) {
+            options.tile_cache = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--source-cache" && has_value) {
+            options.source_cache = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--filter" && has_value) {
+            std::string filter = argv[++i];
+            if (filter != "nearest" && filter != "bilinear") {
+                std::cerr << "Unknown filter: " << filter << std::endl;
+                return false;
+            }
+            options.bilinear = filter == "bilinear";
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::strtoul(argv[++i], NULL, 10);
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void print_pyramid_usage() {
+    std::cerr << "Usage: MapProjection pyramid [options] MAP" << std::endl;
+    std::cerr << "Writes every OUT_DIR/Z/X/Y tile of MAP, the name of one of the maps in the catalog like earth1." << std::endl;
+    std::cerr << "  --maps FILE              manifest the map is looked up in, default res/maps.txt" << std::endl;
+    std::cerr << "  --projection NAME        output projection, default mercator" << std::endl;
+    std::cerr << "  --rotation LON,LAT[,ROLL] rotation of the map in degrees, like in the viewer" << std::endl;
+    std::cerr << "  --max-zoom Z             deepest zoom level, defaults to the first one as wide as the source" << std::endl;
+    std::cerr << "  --tile-size N            width and height of tiles, default 256" << std::endl;
+    std::cerr << "  --out-dir DIR            folder to write the tiles to, defaults to the map's pyramid folder in the catalog or ." << std::endl;
+    std::cerr << "  --format png|jpg         format of the tiles, default png" << std::endl;
+    std::cerr << "  --filter nearest|bilinear sampling of the source, default bilinear" << std::endl;
+    std::cerr << "  --threads N              number of threads, defaults to one per core" << std::endl;
+}
+
+bool parse_pyramid_options(int argc, char **argv, PyramidOptions &options) {
+    options.maps_file = "res/maps.txt";
+    options.projection = "mercator";
+    options.longitude = 0;
+    options.latitude = 0;
+    options.roll = 0;
+    options.max_zoom = -1;
+    options.tile_size = 256;
+    options.out_dir = "";
+    options.format = "png";
+    options.bilinear = true;
+    options.threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--maps" && has_value) {
+            options.maps_file = argv[++i];
+        } else if (arg == "--projection" && has_value) {
+            options.projection = argv[++i];
+        } else if (arg == "--rotation" && has_value) {
+            if (!parse_rotation(argv[++i], options.longitude, options.latitude, options.roll)) {
+                std::cerr << "Invalid rotation: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--max-zoom" && has_value) {
+            options.max_zoom = std::strtol(argv[++i], NULL, 10);
+            if (options.max_zoom < 0 || options.max_zoom > 16) {
+                std::cerr << "Invalid zoom level, expected 0 to 16: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--tile-size" && has_value) {
+            options.tile_size = std::strtoul(argv[++i], NULL, 10);
+            // Tiles are downsampled by halving, so the size has to be even
+            if (options.tile_size < 2 || options.tile_size > 4096 || options.tile_size % 2 != 0) {
+                std::cerr << "Invalid tile size: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--out-dir" && has_value) {
+            options.out_dir = argv[++i];
+        } else if (arg == "--format" && has_value) {
+            options.format = argv[++i];
+            if (options.format != "png" && options.format != "jpg") {
+                std::cerr << "Unknown format: " << options.format << std::endl;
+                return false;
+            }
+        } else if (arg == "--filter" && has_value) {
+            std::string filter = argv[++i];
+            if (filter != "nearest" && filter != "bilinear") {
+                std::cerr << "Unknown filter: " << filter << std::endl;
+                return false;
+            }
+            options.bilinear = filter == "bilinear";
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::strtoul(argv[++i], NULL, 10);
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        } else if (options.map.empty()) {
+            options.map = arg;
+        } else {
+            std::cerr << "Too many maps given: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (options.map.empty()) {
+        std::cerr << "No map given" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void print_bench_usage() {
+    std::cerr << "Usage: MapProjectionBench [options]" << std::endl;
+    std::cerr << "Decodes the images in res/images, from the current directory or next to the executable." << std::endl;
+    std::cerr << "  --filter TEXT            only run the benchmarks whose name contains TEXT" << std::endl;
+    std::cerr << "  --samples N              number of timed samples per benchmark, default 15" << std::endl;
+    std::cerr << "  --min-time MS            minimum duration of a sample, default 50" << std::endl;
+    std::cerr << "  --output FILE            write the JSON results to FILE instead of the standard output" << std::endl;
+    std::cerr << "  --list                   print the names of the benchmarks and exit" << std::endl;
+    std::cerr << "  --images DIR             decode the images in DIR instead" << std::endl;
+}
+
+bool parse_bench_options(int argc, char **argv, BenchOptions &options) {
+    options.samples = 15;
+    options.min_time = 50;
+    options.list = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--samples" && has_value) {
+            options.samples = std::strtoul(argv[++i], NULL, 10);
+            if (options.samples == 0) {
+                std::cerr << "Invalid number of samples: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--min-time" && has_value) {
+            options.min_time = std::strtod(argv[++i], NULL);
+            if (!(options.min_time >= 0)) {
+                std::cerr << "Invalid minimum time: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--output" && has_value) {
+            options.output = argv[++i];
+        } else if (arg == "--list") {
+            options.list = true;
+        } else if (arg == "--images" && has_value) {
+            options.images = argv[++i];
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
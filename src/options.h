@@ -0,0 +1,210 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+
+struct Options {
+    // Manifest of the map packs, see load_map_catalog
+    std::string maps_file;
+    // Print the map catalog and exit
+    bool list_maps;
+    unsigned int map_pack;
+    unsigned int map;
+    std::string projection;
+    // Output projections that V shows side by side, see set_views
+    std::vector<std::string> views;
+    // Start out showing the views
+    bool show_views;
+    // Layers in the ring of a time series, see series.h
+    unsigned int series_layers;
+    // Frames of a time series that B plays per second
+    double series_speed;
+    // Starting position of a time series in frames, see set_series_position
+    double series_position;
+    // Starting rotation in degrees, see set_rotation
+    double longitude;
+    double latitude;
+    double roll;
+    double zoom;
+    // GPU time in milliseconds that a frame may take while interacting before its resolution is lowered, 0 turns it off
+    double frame_budget;
+    // Record frame statistics from the start, otherwise I turns them on
+    bool stats;
+    // File that O and exiting write the statistics to
+    std::string stats_file;
+    // Log the window's input to this file, see start_recording
+    std::string record_file;
+    // Drive the window with the input recorded in this file instead, and time its frames
+    std::string replay_file;
+    // Replay every event as soon as the frame of the one before is drawn, instead of at the recorded times
+    bool replay_max_speed;
+
+    // Render with an EGL context instead of a window, only for batch modes
+    bool headless;
+    // Export a poster of the starting view and exit
+    bool export_poster;
+
+    std::string poster_file;
+    unsigned int poster_width;
+    // 0 means that the height follows from the output projection's aspect ratio
+    unsigned int poster_height;
+
+    // Batch animation mode, enabled when animation_file is set
+    std::string animation_file;
+    std::string animation_output;
+    // 0 means up to and including the last keyframe
+    unsigned int frames;
+    unsigned int frame_width;
+    unsigned int frame_height;
+    // 0 means one per core
+    unsigned int threads;
+
+    // Check the renderers against the golden images and exit, see run_regression_checks
+    bool check;
+    std::string golden_dir;
+    // Write the golden images and timings instead of checking against them
+    bool update_golden;
+    // A pixel differs when any of its channels is off by more than this
+    unsigned int pixel_tolerance;
+    // Percentage of pixels that may differ from the golden images
+    double max_golden_diff;
+    // Mean channel difference allowed between OpenGL and the CPU
+    double max_parity_error;
+    // How many times slower than the recorded timings a case may render, 0 turns the timing checks off
+    double max_slowdown;
+    // JSON file with the results of every case, empty for none
+    std::string check_report;
+};
+
+/**
+ * An image for the reproject command, with its projection and crop given the same way as in SphereMap.
+ */
+struct ReprojectInput {
+    std::string filename;
+    std::string source;
+    unsigned int x;
+    unsigned int y;
+    int w;
+    int h;
+};
+
+struct ReprojectOptions {
+    std::vector<ReprojectInput> inputs;
+    std::string projection;
+    double longitude;
+    double latitude;
+    double roll;
+    double zoom;
+    unsigned int width;
+    // 0 means that the height follows from the output projection's aspect ratio
+    unsigned int height;
+    std::string out_dir;
+    // Extension of the output files, png or jpg
+    std::string format;
+    bool bilinear;
+    // 0 means one per core
+    unsigned int threads;
+
+    // Reproject one image at a time without loading whole images, see reproject_stream
+    bool stream;
+    unsigned int band_rows;
+    unsigned int cache_rows;
+
+    // Write how long each pixel took instead of the reprojected images, see reproject_cost_rows
+    bool cost_heatmap;
+};
+
+struct TransformOptions {
+    std::string projection;
+    // Map coordinates to longitude and latitude instead of the other way around
+    bool inverse;
+    bool radians;
+    // Binary files are little-endian pairs of doubles, CSV files have a pair on each line
+    bool binary;
+    bool rotate;
+    // Rotation in degrees, see set_rotation
+    double longitude;
+    double latitude;
+    double roll;
+    // Use matrix as the rotation instead of the angles
+    bool has_matrix;
+    // Row-major, the same layout as in mapper
+    double matrix[9];
+    std::string input;
+    // Empty for the standard output
+    std::string output;
+    // 0 means one per core
+    unsigned int threads;
+};
+
+struct ServeOptions {
+    // Manifest that the sources are looked up in, see load_map_catalog
+    std::string maps_file;
+    unsigned int port;
+    unsigned int tile_size;
+    // Cache capacities in megabytes, for encoded tiles and decoded source images
+    unsigned int tile_cache;
+    unsigned int source_cache;
+    bool bilinear;
+    // 0 means one per core
+    unsigned int threads;
+};
+
+struct PyramidOptions {
+    // Manifest that the map is looked up in, see load_map_catalog
+    std::string maps_file;
+    // Name of a map's image without the extension, see find_map
+    std::string map;
+    std::string projection;
+    // Rotation in degrees, see set_rotation
+    double longitude;
+    double latitude;
+    double roll;
+    // -1 picks the first zoom level at which the map is at least as wide as the source image
+    int max_zoom;
+    unsigned int tile_size;
+    // Empty for the map's pyramid directory from the catalog, or the current directory if it has none
+    std::string out_dir;
+    // Extension of the tiles, png or jpg
+    std::string format;
+    bool bilinear;
+    // 0 means one per core
+    unsigned int threads;
+};
+
+struct BenchOptions {
+    // Only run the benchmarks whose name contains this
+    std::string filter;
+    unsigned int samples;
+    // Each sample repeats the benchmark until it takes at least this many milliseconds
+    double min_time;
+    // Empty for the standard output
+    std::string output;
+    bool list;
+    // Images of the decoding benchmarks, empty to look for res/images
+    std::string images;
+};
+
+bool parse_options(int argc, char **argv, Options &options);
+void print_usage();
+
+/**
+ * Parse the arguments after "reproject", where --source and --crop apply to all of the inputs that follow them.
+ */
+bool parse_reproject_options(int argc, char **argv, ReprojectOptions &options);
+void print_reproject_usage();
+
+bool parse_transform_options(int argc, char **argv, TransformOptions &options);
+void print_transform_usage();
+
+bool parse_serve_options(int argc, char **argv, ServeOptions &options);
+void print_serve_usage();
+
+bool parse_pyramid_options(int argc, char **argv, PyramidOptions &options);
+void print_pyramid_usage();
+
+bool parse_bench_options(int argc, char **argv, BenchOptions &options);
+void print_bench_usage();
+
+#endif
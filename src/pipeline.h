@@ -0,0 +1,124 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * A blocking queue with a maximum size, used to pass work between the stages of a pipeline.
+ * A full queue blocks the producer, which keeps the memory used by the pipeline bounded.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity(capacity), closed(false) {}
+
+    /**
+     * Add an item, waiting while the queue is full. Returns false if the queue has been closed.
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Take the oldest item, waiting while the queue is empty. Returns false once the queue has been closed and emptied.
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * Stop accepting new items and wake up everyone waiting. Items already in the queue can still be taken.
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    std::size_t capacity;
+    bool closed;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+/**
+ * A fixed size ring for exactly one producer thread and one consumer thread, which never locks or waits.
+ * Used where the producer must never be held up, like input callbacks.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    // One slot is always left empty to tell a full ring from an empty one
+    explicit SpscQueue(std::size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+    /**
+     * Add an item from the producer thread. Returns false without waiting if the queue is full.
+     */
+    bool push(const T &item) {
+        std::size_t current = tail.load(std::memory_order_relaxed);
+        std::size_t next = (current + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[current] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Take the oldest item from the consumer thread. Returns false without waiting if the queue is empty.
+     */
+    bool pop(T &item) {
+        std::size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[current];
+        head.store((current + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Number of items in the queue, which can only shrink while the producer looks and only grow while the consumer does.
+     */
+    std::size_t size() const {
+        std::size_t current = head.load(std::memory_order_acquire);
+        return (tail.load(std::memory_order_acquire) + slots.size() - current) % slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    // Written only by the consumer and the producer respectively, on separate cache lines so they do not slow each other down
+    alignas(64) std::atomic<std::size_t> head;
+    alignas(64) std::atomic<std::size_t> tail;
+};
+
+#endif
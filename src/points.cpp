@@ -0,0 +1,119 @@
+#include "points.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// Magic constant, as a double since points keep full precision
+const double PI = 3.141592653589793238462;
+
+std::size_t lonlat_to_map(const PointTransform &transform, const double *input, double *output, std::size_t count) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double *r = transform.rotation;
+    std::size_t failed = 0;
+
+    for (std::size_t i = 0; i < count; i++) {
+        double u = input[2 * i];
+        double v = input[2 * i + 1];
+        if (transform.degrees) {
+            u *= PI / 180;
+            v *= PI / 180;
+        }
+        // Longitudes can be given in any turn around the sphere
+        u = std::remainder(u, 2 * PI);
+
+        if (transform.rotate) {
+            double point[3] = {std::sin(u) * std::cos(v), std::sin(v), -std::cos(u) * std::cos(v)};
+            // The inverse of the rotation is its transpose
+            double view[3];
+            for (int j = 0; j < 3; j++) {
+                view[j] = r[j * 3] * point[0] + r[j * 3 + 1] * point[1] + r[j * 3 + 2] * point[2];
+            }
+            u = std::atan2(view[0], -view[2]);
+            v = std::asin(std::fmax(-1.0, std::fmin(1.0, view[1])));
+        }
+
+        double x, y;
+        if (!transform.projection->uv_to_xy(u, v, x, y)) {
+            x = y = nan;
+            failed++;
+        }
+        output[2 * i] = x;
+        output[2 * i + 1] = y;
+    }
+
+    return failed;
+}
+
+std::size_t map_to_lonlat(const PointTransform &transform, const double *input, double *output, std::size_t count) {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double *r = transform.rotation;
+    std::size_t failed = 0;
+
+    for (std::size_t i = 0; i < count; i++) {
+        double x = input[2 * i];
+        double y = input[2 * i + 1];
+
+        double u, v;
+        if (!(x >= -1 && x <= 1 && y >= -1 && y <= 1) || !transform.projection->xy_to_uv(x, y, u, v)) {
+            output[2 * i] = output[2 * i + 1] = nan;
+            failed++;
+            continue;
+        }
+
+        if (transform.rotate) {
+            double view[3] = {std::sin(u) * std::cos(v), std::sin(v), -std::cos(u) * std::cos(v)};
+            double point[3];
+            for (int j = 0; j < 3; j++) {
+                point[j] = r[j] * view[0] + r[3 + j] * view[1] + r[6 + j] * view[2];
+            }
+            u = std::atan2(point[0], -point[2]);
+            v = std::asin(std::fmax(-1.0, std::fmin(1.0, point[1])));
+        }
+
+        if (transform.degrees) {
+            u *= 180 / PI;
+            v *= 180 / PI;
+        }
+        output[2 * i] = u;
+        output[2 * i + 1] = v;
+    }
+
+    return failed;
+}
+
+std::size_t transform_points(const PointTransform &transform, bool inverse, const double *input, double *output, std::size_t count, unsigned int threads) {
+    std::size_t chunks = (count + point_chunk_size - 1) / point_chunk_size;
+    threads = std::max<std::size_t>(1, std::min<std::size_t>(threads, chunks));
+
+    std::atomic<std::size_t> next_chunk(0);
+    std::atomic<std::size_t> failed(0);
+    auto work = [&]() {
+        std::size_t chunk;
+        std::size_t chunk_failed = 0;
+        while ((chunk = next_chunk++) < chunks) {
+            std::size_t first = chunk * point_chunk_size;
+            std::size_t n = std::min(point_chunk_size, count - first);
+            if (inverse) {
+                chunk_failed += map_to_lonlat(transform, input + 2 * first, output + 2 * first, n);
+            } else {
+                chunk_failed += lonlat_to_map(transform, input + 2 * first, output + 2 * first, n);
+            }
+        }
+        failed += chunk_failed;
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+
+    return failed;
+}
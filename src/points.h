@@ -0,0 +1,44 @@
+#ifndef POINTS_H
+#define POINTS_H
+
+#include <cstddef>
+
+#include "projection.h"
+
+/**
+ * Points are converted in chunks of this many, which keeps a chunk's input and output within the L2 cache.
+ */
+static const std::size_t point_chunk_size = 4096;
+
+/**
+ * Converts arrays of points between longitude and latitude on the sphere and the coordinates of a map.
+ * The rotation has the same meaning as in the renderer, the map point (x, y) shows rotation * (x, y) on the sphere.
+ */
+struct PointTransform {
+    Projection *projection;
+    bool rotate;
+    // Row-major, the same layout as in mapper but in double precision
+    double rotation[9];
+    // Longitude and latitude are in degrees instead of radians
+    bool degrees;
+};
+
+/**
+ * Convert count (longitude, latitude) pairs into map coordinates from (-1, -1) to (1, 1).
+ * Input and output are arrays of interleaved pairs and can be the same array. Points that cannot be converted become NaN.
+ * Returns the number of such points.
+ */
+std::size_t lonlat_to_map(const PointTransform &transform, const double *input, double *output, std::size_t count);
+
+/**
+ * The inverse of lonlat_to_map, points outside of the map become NaN.
+ */
+std::size_t map_to_lonlat(const PointTransform &transform, const double *input, double *output, std::size_t count);
+
+/**
+ * Convert points in either direction, spreading chunks of point_chunk_size points over threads.
+ * The projections have to be prepared with prepare_cpu_conversions first. Returns the number of points that could not be converted.
+ */
+std::size_t transform_points(const PointTransform &transform, bool inverse, const double *input, double *output, std::size_t count, unsigned int threads);
+
+#endif
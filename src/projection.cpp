@@ -1,11 +1,16 @@
 #include "projection.h"
 
 #include <cmath>
+#include <string>
 
 #include <iostream>
 
+#include "projections/mollweide.h"
+#include "projections/robinson.h"
+#include "projections/winkel.h"
+
 // Magic constant
-const float PI = 3.141592653589793238462;
+const double PI = 3.141592653589793238462;
 
 bool equirectangular_xy_to_uv(const double x, const double y, double &u, double &v) {
     u = x * PI;
@@ -13,11 +18,18 @@ bool equirectangular_xy_to_uv(const double x, const double y, double &u, double
     return !std::isnan(u) && !std::isnan(v);
 }
 
+bool equirectangular_uv_to_xy(const double u, const double v, double &x, double &y) {
+    x = u / PI;
+    y = v * 2 / PI;
+    return !std::isnan(x) && !std::isnan(y);
+}
+
 Projection equirectangular = {
     .width = 2,
     .height = 1,
     .shader = "equirect",
     .xy_to_uv = equirectangular_xy_to_uv,
+    .uv_to_xy = equirectangular_uv_to_xy,
     .prepare_input = nullptr,
     .prepare_output = nullptr,
     .free_input = nullptr,
@@ -45,11 +57,22 @@ bool hammer_xy_to_uv(const double x, const double y, double &u, double &v) {
     return !std::isnan(u) && !std::isnan(v);
 }
 
+bool hammer_uv_to_xy(const double u, const double v, double &x, double &y) {
+    double cos_v = std::cos(v);
+    double d = std::sqrt(1 + cos_v * std::cos(u / 2));
+
+    x = cos_v * std::sin(u / 2) / d;
+    y = std::sin(v) / d;
+
+    return !std::isnan(x) && !std::isnan(y);
+}
+
 Projection hammer = {
     .width = 2,
     .height = 1,
     .shader = "hammer",
     .xy_to_uv = hammer_xy_to_uv,
+    .uv_to_xy = hammer_uv_to_xy,
     .prepare_input = nullptr,
     .prepare_output = nullptr,
     .free_input = nullptr,
@@ -65,13 +88,73 @@ bool azimuthal_xy_to_uv(const double x, const double y, double &u, double &v) {
     return !std::isnan(u) && !std::isnan(v);
 }
 
+bool azimuthal_uv_to_xy(const double u, const double v, double &x, double &y) {
+    double r = (PI / 2 - v) / PI;
+    x = std::sin(u) * r;
+    y = -std::cos(u) * r;
+    return !std::isnan(x) && !std::isnan(y);
+}
+
 Projection azimuthal = {
     .width = 1,
     .height = 1,
     .shader = "azimuthal",
     .xy_to_uv = &azimuthal_xy_to_uv,
+    .uv_to_xy = &azimuthal_uv_to_xy,
     .prepare_input = nullptr,
     .prepare_output = nullptr,
     .free_input = nullptr,
     .free_output = nullptr
 };
+
+// Web Mercator stops at the latitude where the map becomes square, about 85.05 degrees
+static const double mercator_max_latitude = std::atan(std::sinh(PI));
+
+bool mercator_xy_to_uv(const double x, const double y, double &u, double &v) {
+    u = x * PI;
+    v = 2 * std::atan(std::exp(y * PI)) - PI / 2;
+    return !std::isnan(u) && !std::isnan(v);
+}
+
+bool mercator_uv_to_xy(const double u, const double v, double &x, double &y) {
+    // The poles are infinitely far away, so everything past the cut off is clamped to the top and bottom edges
+    double clamped = std::fmax(-mercator_max_latitude, std::fmin(mercator_max_latitude, v));
+    x = u / PI;
+    y = std::log(std::tan(PI / 4 + clamped / 2)) / PI;
+    return !std::isnan(x) && !std::isnan(y);
+}
+
+Projection mercator = {
+    .width = 1,
+    .height = 1,
+    .shader = "mercator",
+    .xy_to_uv = &mercator_xy_to_uv,
+    .uv_to_xy = &mercator_uv_to_xy,
+    .prepare_input = nullptr,
+    .prepare_output = nullptr,
+    .free_input = nullptr,
+    .free_output = nullptr
+};
+
+static Projection *all_projections[] = {&equirectangular, &mollweide, &hammer, &azimuthal, &robinson, &winkel, &mercator};
+
+Projection *find_projection(const std::string &name) {
+    for (Projection *projection : all_projections) {
+        if (projection->shader == name) {
+            return projection;
+        }
+    }
+    return nullptr;
+}
+
+bool prepare_cpu_conversions() {
+    for (Projection *projection : all_projections) {
+        double u, v, x, y;
+        // The center is valid in every projection
+        if (!projection->xy_to_uv(0, 0, u, v) || !projection->uv_to_xy(0, 0, x, y)) {
+            std::cerr << "Failed to prepare the " << projection->shader << " projection" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -3,21 +3,44 @@
 
 #include <string>
 
+/**
+ * Shader preparation is left out of builds without OpenGL, like the benchmarks, which only use the CPU conversions.
+ */
+#ifdef NO_OPENGL
+#define IF_OPENGL(function) nullptr
+#else
+#define IF_OPENGL(function) function
+#endif
+
 struct Projection {
     const double width;
     const double height;
 
     const std::string shader;
 
+    // Map coordinates are (-1, -1) to (1, 1), u is the longitude from -pi to pi and v the latitude from -pi/2 to pi/2
     bool (* const (xy_to_uv))(const double x, const double y, double &u, double &v);
+    bool (* const (uv_to_xy))(const double u, const double v, double &x, double &y);
     bool (* const (prepare_input))(const unsigned int image_width, const unsigned int image_height, const unsigned int shader_program);
     bool (* const (prepare_output))(const unsigned int screen_width, const unsigned int screen_height, const unsigned int shader_program);
     bool (* const (free_input))();
     bool (* const (free_output))();
 };
 
+/**
+ * Find a projection by the name of its shader, or return nullptr.
+ */
+Projection *find_projection(const std::string &name);
+
+/**
+ * Generate the lookup tables of the CPU conversions of every projection.
+ * They are otherwise generated lazily and without locking, so call this before converting from several threads.
+ */
+bool prepare_cpu_conversions();
+
 extern Projection equirectangular;
 extern Projection hammer;
 extern Projection azimuthal;
+extern Projection mercator;
 
 #endif
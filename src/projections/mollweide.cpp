@@ -1,14 +1,20 @@
 #include "mollweide.h"
 
+#ifndef NO_OPENGL
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include "../glstate.h"
+#endif
+
 #include <cmath>
 #include <iostream>
 
+#include "../trace.h"
+
 // Magic constant
-const float PI = 3.141592653589793238462;
+const double PI = 3.141592653589793238462;
 
 bool mollweide_xy_to_uv(const double x, const double y, double &u, double &v) {
     v = std::asin(y);
@@ -20,6 +26,31 @@ bool mollweide_xy_to_uv(const double x, const double y, double &u, double &v) {
     return !std::isnan(u) && !std::isnan(v);
 }
 
+/**
+ * Solve 2 * theta + sin(2 * theta) = pi * sin(v) for theta with Newton's method, the CPU
+ * does not need the lookup textures that the shader uses.
+ */
+bool mollweide_uv_to_xy(const double u, const double v, double &x, double &y) {
+    double target = PI * std::sin(v);
+    double theta = v;
+    for (int i = 0; i < 32; i++) {
+        double derivative = 2 + 2 * std::cos(2 * theta);
+        // The derivative vanishes at the poles, where theta = v anyway
+        if (derivative < 1e-12) {
+            break;
+        }
+        double step = (2 * theta + std::sin(2 * theta) - target) / derivative;
+        theta -= step;
+        if (std::abs(step) < 1e-12) {
+            break;
+        }
+    }
+
+    x = u / PI * std::cos(theta);
+    y = std::sin(theta);
+    return !std::isnan(x) && !std::isnan(y);
+}
+
 static bool textures_prepared = false;
 
 /**
@@ -43,9 +74,11 @@ static const int cnt = cnt_000 - 1 + cnt_300 - 1 + cnt_314;
  */
 static float values[cnt];
 
+#ifndef NO_OPENGL
 static GLuint texture_000_300;
 static GLuint texture_300_314;
 static GLuint texture_314_pi;
+#endif
 
 /**
  * Calculate the index of a y value.
@@ -84,6 +117,7 @@ static void generate_values_between(int li, int ri, double l, double r) {
  * the range.
  */
 static bool generate_values_cpu() {
+    TRACE_ZONE("mollweide_generate_values");
     generate_values_between(0, cnt - 1, 0, PI / 2);
     values[0] = 0;
     values[cnt - 1] = PI / 2;
@@ -98,7 +132,13 @@ static bool generate_values_gpu() {
     return false;
 }
 
+bool mollweide_generate_values() {
+    return generate_values_cpu();
+}
+
+#ifndef NO_OPENGL
 static bool prepare_texture() {
+    TRACE_ZONE("mollweide_prepare_texture");
     GLuint textures[3];
     int widths[3] = {cnt_000, cnt_300, cnt_314};
     float *data[3] = {values, values + (cnt_000 - 1), values + (cnt_000 - 1 + cnt_300 - 1)};
@@ -106,7 +146,7 @@ static bool prepare_texture() {
     glGenTextures(3, textures);
 
     for (int i = 0; i < sizeof(textures) / sizeof(*textures); i++) {
-        glBindTexture(GL_TEXTURE_1D, textures[i]);
+        bind_texture(4 + i, GL_TEXTURE_1D, textures[i]);
         glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, widths[i], 0, GL_RED, GL_FLOAT, data[i]);
 
         glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -146,13 +186,10 @@ bool mollweide_prepare_input_shader(const unsigned int image_width, const unsign
         textures_prepared = true;
     }
 
-    glUseProgram(shader_program);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_1D, texture_000_300);
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_1D, texture_300_314);
-    glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_1D, texture_314_pi);
+    use_program(shader_program);
+    bind_texture(4, GL_TEXTURE_1D, texture_000_300);
+    bind_texture(5, GL_TEXTURE_1D, texture_300_314);
+    bind_texture(6, GL_TEXTURE_1D, texture_314_pi);
 
     GLint t000_id = glGetUniformLocation(shader_program, "texture_000_300");
     GLint t300_id = glGetUniformLocation(shader_program, "texture_300_314");
@@ -175,6 +212,7 @@ bool mollweide_prepare_input_shader(const unsigned int image_width, const unsign
 
     return true;
 }
+#endif
 
 // A useful paper explaining the Mollweide projection:
 // http://master.grad.hr/hdgg/kog_stranica/kog15/2Lapaine-KoG15.pdf
@@ -183,7 +221,8 @@ Projection mollweide = {
     .height = 1,
     .shader = "mollweide",
     .xy_to_uv = &mollweide_xy_to_uv,
-    .prepare_input = mollweide_prepare_input_shader,
+    .uv_to_xy = &mollweide_uv_to_xy,
+    .prepare_input = IF_OPENGL(mollweide_prepare_input_shader),
     .prepare_output = nullptr,
     .free_input = nullptr,
     .free_output = nullptr
@@ -1,3 +1,8 @@
 #include "../projection.h"
 
 extern Projection mollweide;
+
+/**
+ * Generate the lookup table of the shader from scratch, which preparing the shader does once. Used by the benchmarks.
+ */
+bool mollweide_generate_values();
@@ -1,14 +1,20 @@
 #include "robinson.h"
 
+#ifndef NO_OPENGL
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include "../glstate.h"
+#endif
+
 #include <cmath>
 #include <iostream>
 
+#include "../trace.h"
+
 // Magic constant
-const float PI = 3.141592653589793238462;
+const double PI = 3.141592653589793238462;
 
 /**
  * Hard-coded values
@@ -17,15 +23,18 @@ static const double X[19] = { 1.0000, 0.9986, 0.9954, 0.9900, 0.9822, 0.9730, 0.
 static const double Y[19] = { 0.0000, 0.0620, 0.1240, 0.1860, 0.2480, 0.3100, 0.3720, 0.4340, 0.4958, 0.5571, 0.6176, 0.6769, 0.7346, 0.7903, 0.8435, 0.8936, 0.9394, 0.9761, 1.0000 };
 
 static bool values_prepared = false;
+static bool textures_prepared = false;
 
 static const int cnt = 2048;
 static float y_to_l[cnt];
 static float l_to_y[cnt];
 static float l_to_x[cnt];
 
+#ifndef NO_OPENGL
 static GLuint y_to_l_texture;
 static GLuint l_to_y_texture;
 static GLuint l_to_x_texture;
+#endif
 
 static inline double sqr(double t) { return t * t; }
 
@@ -39,6 +48,7 @@ static inline double spline(double t, double x1, double tx1, double x2, double t
 }
 
 static bool generate_values_cpu() {
+    TRACE_ZONE("robinson_generate_values");
     const int vals = sizeof(X) / sizeof(*X);
     double tangent_x[vals];
     double tangent_y[vals];
@@ -135,14 +145,49 @@ static bool generate_values_gpu() {
     return false;
 }
 
+/**
+ * Generate the lookup tables once, they are needed by both the shaders and the CPU side conversions.
+ */
+static bool prepare_values() {
+    if (!values_prepared) {
+        if (!generate_values_cpu()) {
+            std::cerr << "Failed to generate values!" << std::endl;
+            return false;
+        }
+
+        values_prepared = true;
+    }
+
+    return true;
+}
+
+/**
+ * Linearly interpolate a table at l from 0 to 1, the same way the shader's texture lookup does.
+ */
+static double interpolate(const float *table, double l) {
+    double position = l * (cnt - 1);
+    int i = (int) position;
+    if (i >= cnt - 1) {
+        return table[cnt - 1];
+    }
+    double t = position - i;
+    return table[i] * (1 - t) + table[i + 1] * t;
+}
+
+bool robinson_generate_values() {
+    return generate_values_cpu();
+}
+
+#ifndef NO_OPENGL
 static bool prepare_texture() {
+    TRACE_ZONE("robinson_prepare_texture");
     GLuint textures[3];
     float *data[3] = {y_to_l, l_to_y, l_to_x};
 
     glGenTextures(3, textures);
 
     for (int i = 0; i < sizeof(textures) / sizeof(*textures); i++) {
-        glBindTexture(GL_TEXTURE_1D, textures[i]);
+        bind_texture(2, GL_TEXTURE_1D, textures[i]);
         glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, cnt, 0, GL_RED, GL_FLOAT, data[i]);
 
         glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -158,25 +203,23 @@ static bool prepare_texture() {
 }
 
 bool robinson_prepare_input_shader(const unsigned int image_width, const unsigned int image_height, const GLuint shader_program) {
-    if (!values_prepared) {
-        if (!generate_values_cpu()) {
-            std::cerr << "Failed to generate values!" << std::endl;
-            return false;
-        }
+    if (!prepare_values()) {
+        return false;
+    }
 
+    if (!textures_prepared) {
         if (!prepare_texture()) {
             std::cerr << "Failed to prepare texture!" << std::endl;
             return false;
         }
 
-        values_prepared = true;
+        textures_prepared = true;
     }
 
-    glUseProgram(shader_program);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_1D, l_to_y_texture);
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_1D, l_to_x_texture);
+    // Away from the units of the Mollweide lookup tables, as both can be sources of the same shader, see get_layer_code
+    use_program(shader_program);
+    bind_texture(2, GL_TEXTURE_1D, l_to_y_texture);
+    bind_texture(3, GL_TEXTURE_1D, l_to_x_texture);
 
     GLint y_id = glGetUniformLocation(shader_program, "l_to_y");
     GLint x_id = glGetUniformLocation(shader_program, "l_to_x");
@@ -185,33 +228,30 @@ bool robinson_prepare_input_shader(const unsigned int image_width, const unsigne
         return false;
     }
 
-    glUniform1i(y_id, 4);
-    glUniform1i(x_id, 5);
+    glUniform1i(y_id, 2);
+    glUniform1i(x_id, 3);
     glUniform1f(l_id, 0.5f / (float) cnt);
 
     return true;
 }
 
 bool robinson_prepare_output_shader(const unsigned int screen_width, const unsigned int screen_height, const GLuint shader_program) {
-    if (!values_prepared) {
-        if (!generate_values_cpu()) {
-            std::cerr << "Failed to generate values!" << std::endl;
-            return false;
-        }
+    if (!prepare_values()) {
+        return false;
+    }
 
+    if (!textures_prepared) {
         if (!prepare_texture()) {
             std::cerr << "Failed to prepare texture!" << std::endl;
             return false;
         }
 
-        values_prepared = true;
+        textures_prepared = true;
     }
 
-    glUseProgram(shader_program);
-    glActiveTexture(GL_TEXTURE8);
-    glBindTexture(GL_TEXTURE_1D, y_to_l_texture);
-    glActiveTexture(GL_TEXTURE9);
-    glBindTexture(GL_TEXTURE_1D, l_to_x_texture);
+    use_program(shader_program);
+    bind_texture(8, GL_TEXTURE_1D, y_to_l_texture);
+    bind_texture(9, GL_TEXTURE_1D, l_to_x_texture);
 
     GLint y_id = glGetUniformLocation(shader_program, "y_to_l");
     GLint x_id = glGetUniformLocation(shader_program, "yl_to_x");
@@ -226,9 +266,10 @@ bool robinson_prepare_output_shader(const unsigned int screen_width, const unsig
 
     return true;
 }
+#endif
 
 bool robinson_xy_to_uv(const double x, const double y, double &u, double &v) {
-    if (y > 1 || y < -1) {
+    if (y > 1 || y < -1 || !prepare_values()) {
         return false;
     }
 
@@ -237,8 +278,8 @@ bool robinson_xy_to_uv(const double x, const double y, double &u, double &v) {
         mul = -1;
     }
 
-    double l = y_to_l[(int) (mul * y * cnt)];
-    u = x / l_to_x[(int) (l * cnt)];
+    double l = y_to_l[(int) (mul * y * (cnt - 1))];
+    u = x / l_to_x[(int) (l * (cnt - 1))];
     v = mul * l * PI / 2;
 
     if (u < -1 || u > 1) {
@@ -250,6 +291,24 @@ bool robinson_xy_to_uv(const double x, const double y, double &u, double &v) {
     return !std::isnan(u) && !std::isnan(v);
 }
 
+bool robinson_uv_to_xy(const double u, const double v, double &x, double &y) {
+    if (!prepare_values()) {
+        return false;
+    }
+
+    double mul = 1;
+    double l = 2 * v / PI;
+    if (l < 0) {
+        mul = -1;
+        l = -l;
+    }
+
+    x = u / PI * interpolate(l_to_x, l);
+    y = mul * interpolate(l_to_y, l);
+
+    return !std::isnan(x) && !std::isnan(y);
+}
+
 // Robinson projection, with values taken from https://en.wikipedia.org/wiki/Robinson_projection
 // This uses cubic spline interpolation between values
 Projection robinson = {
@@ -257,8 +316,9 @@ Projection robinson = {
     .height = 2536 * 2,
     .shader = "robinson",
     .xy_to_uv = robinson_xy_to_uv,
-    .prepare_input = robinson_prepare_input_shader,
-    .prepare_output = robinson_prepare_output_shader,
+    .uv_to_xy = robinson_uv_to_xy,
+    .prepare_input = IF_OPENGL(robinson_prepare_input_shader),
+    .prepare_output = IF_OPENGL(robinson_prepare_output_shader),
     .free_input = nullptr,
     .free_output = nullptr
 };
@@ -1,3 +1,8 @@
 #include "../projection.h"
 
 extern Projection robinson;
+
+/**
+ * Generate the lookup tables from scratch, which the conversions and shaders do once. Used by the benchmarks.
+ */
+bool robinson_generate_values();
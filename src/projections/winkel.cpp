@@ -0,0 +1,260 @@
+#include "winkel.h"
+
+#ifndef NO_OPENGL
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "../glstate.h"
+#endif
+
+#include <cmath>
+#include <iostream>
+
+#include "../trace.h"
+
+// Magic constant
+const double PI = 3.141592653589793238462;
+
+/**
+ * Half of the width and height of the projection, used to normalize the coordinates to (-1, -1) to (1, 1).
+ * The standard parallel is acos(2 / pi), so the equator is 2 * (1 + pi / 2) wide and the meridian is pi high.
+ */
+static const double X_MAX = 1 + PI / 2;
+static const double Y_MAX = PI / 2;
+
+/**
+ * Size of the grid of initial guesses. The grid only covers the positive quadrant, since the
+ * projection is symmetric around both axes.
+ */
+static const int grid_w = 64;
+static const int grid_h = 32;
+
+/**
+ * Longitude and latitude pairs for each grid point, laid out so that it can be uploaded as a RG texture.
+ */
+static float guess[grid_h * grid_w * 2];
+
+/**
+ * Points that are still this far off after the first Newton step are not on the map.
+ */
+static const double max_error = 0.01;
+
+static bool values_prepared = false;
+
+#ifndef NO_OPENGL
+static GLuint guess_texture;
+#endif
+
+bool winkel_uv_to_xy(const double l, const double p, double &x, double &y) {
+    double cos_a = std::cos(p) * std::cos(l / 2);
+    double sin_a = std::sqrt(1 - cos_a * cos_a);
+    double sinc_a = sin_a == 0 ? 1 : sin_a / std::atan2(sin_a, cos_a);
+
+    x = 0.5 * (l * 2 / PI + 2 * std::cos(p) * std::sin(l / 2) / sinc_a) / X_MAX;
+    y = 0.5 * (p + std::sin(p) / sinc_a) / Y_MAX;
+
+    return !std::isnan(x) && !std::isnan(y);
+}
+
+/**
+ * Do one step of Newton's method for solving winkel_uv_to_xy(l, p) = (x, y), returning the error before the step.
+ * Derivatives taken from Ipbüker and Bildirici, "A General Algorithm for the Inverse Transformation of Map Projections Using Jacobian Matrices" (2002).
+ */
+static double newton_step(const double x, const double y, double &l, double &p) {
+    double tx = x * X_MAX;
+    double ty = y * Y_MAX;
+
+    double cos_p = std::cos(p);
+    double sin_p = std::sin(p);
+    double sin_2p = std::sin(2 * p);
+    double sin2_p = sin_p * sin_p;
+    double cos2_p = cos_p * cos_p;
+    double sin_l = std::sin(l);
+    double cos_l2 = std::cos(l / 2);
+    double sin_l2 = std::sin(l / 2);
+    double sin2_l2 = sin_l2 * sin_l2;
+
+    double c = 1 - cos2_p * cos_l2 * cos_l2;
+    double f = c > 0 ? 1 / c : 0;
+    double e = c > 0 ? std::atan2(std::sqrt(c), cos_p * cos_l2) * std::sqrt(f) : 0;
+
+    double fx = 0.5 * (2 * e * cos_p * sin_l2 + l * 2 / PI) - tx;
+    double fy = 0.5 * (e * sin_p + p) - ty;
+
+    double dx_dl = 0.5 * f * (cos2_p * sin2_l2 + e * cos_p * cos_l2 * sin2_p) + 1 / PI;
+    double dx_dp = f * (sin_l * sin_2p / 4 - e * sin_p * sin_l2);
+    double dy_dl = 0.125 * f * (sin_2p * sin_l2 - e * sin_p * cos2_p * sin_l);
+    double dy_dp = 0.5 * f * (sin2_p * cos_l2 + e * sin2_l2 * cos_p) + 0.5;
+
+    double det = dx_dp * dy_dl - dy_dp * dx_dl;
+
+    l -= (fy * dx_dp - fx * dy_dp) / det;
+    p -= (fx * dy_dl - fy * dx_dl) / det;
+
+    return std::abs(fx) + std::abs(fy);
+}
+
+/**
+ * Solve the inverse at every grid point to full precision, starting from the equirectangular guess.
+ * Grid points outside of the projection converge to the analytic continuation of the projection
+ * (longitudes beyond pi), which keeps the interpolated guesses near the edge of the map smooth.
+ */
+static bool generate_values_cpu() {
+    TRACE_ZONE("winkel_generate_values");
+    for (int j = 0; j < grid_h; j++) {
+        for (int i = 0; i < grid_w; i++) {
+            double x = i / (double) (grid_w - 1);
+            double y = j / (double) (grid_h - 1);
+            double l = x * PI;
+            double p = y * PI / 2;
+
+            for (int k = 0; k < 40; k++) {
+                newton_step(x, y, l, p);
+            }
+
+            if (std::isnan(l) || std::isnan(p)) {
+                l = x * PI;
+                p = y * PI / 2;
+            }
+            if (p > PI / 2) {
+                p = PI / 2;
+            }
+
+            guess[(j * grid_w + i) * 2] = l;
+            guess[(j * grid_w + i) * 2 + 1] = p;
+        }
+    }
+
+    return true;
+}
+
+static bool prepare_values() {
+    if (!values_prepared) {
+        if (!generate_values_cpu()) {
+            std::cerr << "Failed to generate values!" << std::endl;
+            return false;
+        }
+        values_prepared = true;
+    }
+    return true;
+}
+
+/**
+ * Bilinearly interpolate the initial guess, the same way the shader does.
+ */
+static void initial_guess(const double x, const double y, double &l, double &p) {
+    double gx = std::abs(x) * (grid_w - 1);
+    double gy = std::abs(y) * (grid_h - 1);
+    int i = (int) gx;
+    int j = (int) gy;
+    if (i > grid_w - 2) {
+        i = grid_w - 2;
+    }
+    if (j > grid_h - 2) {
+        j = grid_h - 2;
+    }
+    double tx = gx - i;
+    double ty = gy - j;
+
+    const float *g00 = guess + (j * grid_w + i) * 2;
+    const float *g10 = g00 + 2;
+    const float *g01 = g00 + grid_w * 2;
+    const float *g11 = g01 + 2;
+
+    l = (g00[0] * (1 - tx) + g10[0] * tx) * (1 - ty) + (g01[0] * (1 - tx) + g11[0] * tx) * ty;
+    p = (g00[1] * (1 - tx) + g10[1] * tx) * (1 - ty) + (g01[1] * (1 - tx) + g11[1] * tx) * ty;
+
+    if (x < 0) {
+        l = -l;
+    }
+    if (y < 0) {
+        p = -p;
+    }
+}
+
+/**
+ * The Winkel tripel projection has no closed-form inverse, so it is solved with two Newton steps
+ * starting from an interpolated guess. In double precision this is accurate to about 1e-7 radians
+ * anywhere on the map. The shader does the same in single precision, and the two agree to within
+ * 1e-5 radians of arc.
+ *
+ * Outside of the map, in the corners, Newton's method can wander off to an unrelated point inside
+ * the map, so the error left after the first step is used to reject points that are not converging.
+ */
+bool winkel_xy_to_uv(const double x, const double y, double &u, double &v) {
+    if (!prepare_values()) {
+        return false;
+    }
+
+    initial_guess(x, y, u, v);
+    newton_step(x, y, u, v);
+    double error = newton_step(x, y, u, v);
+
+    if (error > max_error || u < -PI || u > PI || v < -PI / 2 || v > PI / 2) {
+        return false;
+    }
+    return !std::isnan(u) && !std::isnan(v);
+}
+
+bool winkel_generate_values() {
+    return generate_values_cpu();
+}
+
+#ifndef NO_OPENGL
+static bool prepare_texture() {
+    TRACE_ZONE("winkel_prepare_texture");
+    glGenTextures(1, &guess_texture);
+    bind_texture(10, GL_TEXTURE_2D, guess_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, grid_w, grid_h, 0, GL_RG, GL_FLOAT, guess);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return true;
+}
+
+bool winkel_prepare_output_shader(const unsigned int screen_width, const unsigned int screen_height, const GLuint shader_program) {
+    static bool texture_prepared = false;
+
+    if (!prepare_values()) {
+        return false;
+    }
+
+    if (!texture_prepared) {
+        if (!prepare_texture()) {
+            std::cerr << "Failed to prepare texture!" << std::endl;
+            return false;
+        }
+
+        texture_prepared = true;
+    }
+
+    use_program(shader_program);
+    bind_texture(10, GL_TEXTURE_2D, guess_texture);
+
+    GLint guess_id = glGetUniformLocation(shader_program, "winkel_guess");
+    if (guess_id < 0) {
+        return false;
+    }
+
+    glUniform1i(guess_id, 10);
+
+    return true;
+}
+#endif
+
+// Winkel tripel projection with the standard parallel at acos(2 / pi), as used by the National Geographic Society
+Projection winkel = {
+    .width = 2 * X_MAX,
+    .height = 2 * Y_MAX,
+    .shader = "winkel",
+    .xy_to_uv = winkel_xy_to_uv,
+    .uv_to_xy = winkel_uv_to_xy,
+    .prepare_input = nullptr,
+    .prepare_output = IF_OPENGL(winkel_prepare_output_shader),
+    .free_input = nullptr,
+    .free_output = nullptr
+};
@@ -0,0 +1,8 @@
+#include "../projection.h"
+
+extern Projection winkel;
+
+/**
+ * Generate the grid of initial guesses from scratch, which the conversions and shader do once. Used by the benchmarks.
+ */
+bool winkel_generate_values();
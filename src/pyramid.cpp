@@ -0,0 +1,275 @@
+#include "pyramid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "images.h"
+#include "mapper.h"
+#include "maps.h"
+#include "options.h"
+#include "projection.h"
+#include "reproject.h"
+
+// Magic constant
+const double PI = 3.141592653589793238462;
+
+struct Pyramid {
+    PyramidOptions options;
+    Reprojection reprojection;
+    const Image *source;
+    unsigned char channels;
+    unsigned int max_zoom;
+
+    // The threads build whole subtrees from this level down, and the levels above it are built from their tops afterwards
+    unsigned int split_zoom;
+    std::vector<std::vector<unsigned char>> split_tiles;
+    bool split_tiles_ready;
+
+    std::atomic<unsigned long long> rendered;
+    std::atomic<unsigned long long> downsampled;
+    std::atomic<bool> failed;
+};
+
+/**
+ * Same frame as the tile server, the map is 2^zoom tiles wide and has the projection's aspect ratio.
+ */
+static void get_frame_size(const Pyramid &pyramid, unsigned int zoom, unsigned int &width, unsigned int &height) {
+    const Projection *output = pyramid.reprojection.output;
+    width = pyramid.options.tile_size << zoom;
+    height = std::max(1.0, width * output->height / output->width + 0.5);
+}
+
+static void get_tile_count(const Pyramid &pyramid, unsigned int zoom, unsigned int &columns, unsigned int &rows) {
+    unsigned int width, height;
+    get_frame_size(pyramid, zoom, width, height);
+    columns = 1u << zoom;
+    rows = (height + pyramid.options.tile_size - 1) / pyramid.options.tile_size;
+}
+
+static bool write_tile(Pyramid &pyramid, unsigned int zoom, unsigned int x, unsigned int y, std::vector<unsigned char> &pixels) {
+    std::filesystem::path folder = std::filesystem::path(pyramid.options.out_dir) / std::to_string(zoom) / std::to_string(x);
+    // Several threads can make the same folder at once, which is only a failure if it still does not exist
+    std::error_code error;
+    std::filesystem::create_directories(folder, error);
+    if (error && !std::filesystem::is_directory(folder)) {
+        std::cerr << "Failed to create " << folder.string() << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    unsigned int tile_size = pyramid.options.tile_size;
+    Image image = {tile_size, tile_size, pyramid.channels, pixels.data()};
+    return save_image((folder / (std::to_string(y) + "." + pyramid.options.format)).string(), image);
+}
+
+/**
+ * Average each 2x2 block of a child tile into one quadrant of its parent.
+ */
+static void downsample_into(const Pyramid &pyramid, const std::vector<unsigned char> &child, std::vector<unsigned char> &parent, unsigned int quadrant_x, unsigned int quadrant_y) {
+    unsigned int tile_size = pyramid.options.tile_size;
+    unsigned int half = tile_size / 2;
+    unsigned char channels = pyramid.channels;
+    std::size_t stride = (std::size_t) tile_size * channels;
+
+    for (unsigned int row = 0; row < half; row++) {
+        const unsigned char *top = child.data() + 2 * row * stride;
+        const unsigned char *bottom = top + stride;
+        unsigned char *pixel = parent.data() + (quadrant_y * half + row) * stride + quadrant_x * half * channels;
+        for (unsigned int col = 0; col < half; col++, top += 2 * channels, bottom += 2 * channels) {
+            for (int c = 0; c < channels; c++) {
+                *pixel++ = (top[c] + top[channels + c] + bottom[c] + bottom[channels + c] + 2) / 4;
+            }
+        }
+    }
+}
+
+/**
+ * Black out the pixels of a tile that are past the edges of the frame, where the children only roughly line up
+ * because the frame height is rounded at every level.
+ */
+static void clear_outside(const Pyramid &pyramid, unsigned int zoom, unsigned int x, unsigned int y, std::vector<unsigned char> &pixels) {
+    unsigned int frame_width, frame_height;
+    get_frame_size(pyramid, zoom, frame_width, frame_height);
+    unsigned int tile_size = pyramid.options.tile_size;
+    unsigned int width = std::min(tile_size, frame_width - x * tile_size);
+    unsigned int height = std::min(tile_size, frame_height - y * tile_size);
+    for (unsigned int row = 0; row < tile_size; row++) {
+        unsigned int first = row < height ? width : 0;
+        std::size_t start = ((std::size_t) row * tile_size + first) * pyramid.channels;
+        std::fill(pixels.begin() + start, pixels.begin() + start + (tile_size - first) * pyramid.channels, 0);
+    }
+}
+
+/**
+ * Build a tile and the whole subtree below it depth first, writing every tile, and leave the tile's pixels in pixels.
+ * Only one chain of tiles from the top to the deepest level is in memory at a time.
+ */
+static bool build_tile(Pyramid &pyramid, unsigned int zoom, unsigned int x, unsigned int y, std::vector<unsigned char> &pixels) {
+    unsigned int tile_size = pyramid.options.tile_size;
+    pixels.assign((std::size_t) tile_size * tile_size * pyramid.channels, 0);
+
+    if (zoom == pyramid.split_zoom && pyramid.split_tiles_ready) {
+        unsigned int columns, rows;
+        get_tile_count(pyramid, zoom, columns, rows);
+        pixels.swap(pyramid.split_tiles[(std::size_t) y * columns + x]);
+        // Already written by the thread that built it
+        return true;
+    }
+
+    if (zoom == pyramid.max_zoom) {
+        unsigned int frame_width, frame_height;
+        get_frame_size(pyramid, zoom, frame_width, frame_height);
+        Image image = {tile_size, tile_size, pyramid.channels, pixels.data()};
+        reproject_region(pyramid.reprojection, *pyramid.source, image, frame_width, frame_height, x * tile_size, y * tile_size);
+        pyramid.rendered++;
+    } else {
+        unsigned int columns, rows;
+        get_tile_count(pyramid, zoom + 1, columns, rows);
+        std::vector<unsigned char> child;
+        for (unsigned int i = 0; i < 4; i++) {
+            unsigned int child_x = 2 * x + i % 2, child_y = 2 * y + i / 2;
+            if (child_y >= rows) {
+                continue;
+            }
+            if (!build_tile(pyramid, zoom + 1, child_x, child_y, child)) {
+                return false;
+            }
+            downsample_into(pyramid, child, pixels, i % 2, i / 2);
+        }
+        clear_outside(pyramid, zoom, x, y, pixels);
+        pyramid.downsampled++;
+    }
+
+    if (pyramid.failed) {
+        return false;
+    }
+    if (!write_tile(pyramid, zoom, x, y, pixels)) {
+        pyramid.failed = true;
+        return false;
+    }
+    return true;
+}
+
+static void build_split_tiles(Pyramid &pyramid, std::atomic<unsigned int> &next) {
+    unsigned int columns, rows;
+    get_tile_count(pyramid, pyramid.split_zoom, columns, rows);
+    unsigned int count = columns * rows;
+    // Neighbouring subtrees read nearby parts of the source, so they are handed out in order
+    for (unsigned int i = next++; i < count && !pyramid.failed; i = next++) {
+        build_tile(pyramid, pyramid.split_zoom, i % columns, i / columns, pyramid.split_tiles[i]);
+    }
+}
+
+int run_pyramid_command(int argc, char **argv) {
+    PyramidOptions options;
+    if (!parse_pyramid_options(argc, argv, options)) {
+        print_pyramid_usage();
+        return 1;
+    }
+    if (!load_map_catalog(options.maps_file)) {
+        return 1;
+    }
+
+    SphereMap *map = find_map(options.map);
+    if (!map) {
+        std::cerr << "Unknown map: " << options.map << std::endl;
+        return 1;
+    }
+    if (options.out_dir.empty()) {
+        options.out_dir = map->pyramid_dir.empty() ? "." : map->pyramid_dir;
+    }
+    Projection *output = find_projection(options.projection);
+    if (!output) {
+        std::cerr << "Unknown projection: " << options.projection << std::endl;
+        return 1;
+    }
+
+    Image source;
+    if (!load_map_image(*map, source)) {
+        return 1;
+    }
+
+    Pyramid pyramid;
+    pyramid.options = options;
+    pyramid.reprojection = {
+        .source = map->source,
+        .output = output,
+        .rotation = {},
+        .zoom = 1,
+        .bilinear = options.bilinear
+    };
+    make_rotation(options.longitude * PI / 180, options.latitude * PI / 180, options.roll * PI / 180, pyramid.reprojection.rotation);
+    pyramid.source = &source;
+    pyramid.channels = source.channels == 1 ? 1 : 3;
+    pyramid.rendered = 0;
+    pyramid.downsampled = 0;
+    pyramid.failed = false;
+    pyramid.split_tiles_ready = false;
+
+    if (options.max_zoom >= 0) {
+        pyramid.max_zoom = options.max_zoom;
+    } else {
+        pyramid.max_zoom = 0;
+        while (pyramid.max_zoom < 16 && (options.tile_size << pyramid.max_zoom) < source.width) {
+            pyramid.max_zoom++;
+        }
+    }
+
+    if (!prepare_cpu_conversions()) {
+        free_image(source);
+        return 1;
+    }
+
+    unsigned int threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Enough subtrees to keep every thread busy even if some are much cheaper than others
+    unsigned int columns, rows;
+    pyramid.split_zoom = 0;
+    get_tile_count(pyramid, 0, columns, rows);
+    while (pyramid.split_zoom < pyramid.max_zoom && columns * rows < threads * 4) {
+        pyramid.split_zoom++;
+        get_tile_count(pyramid, pyramid.split_zoom, columns, rows);
+    }
+    pyramid.split_tiles.resize((std::size_t) columns * rows);
+
+    std::cerr << "Writing zoom levels 0 to " << pyramid.max_zoom << " of " << options.map << " to " << options.out_dir << " with " << threads << " threads" << std::endl;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::atomic<unsigned int> next(0);
+    std::vector<std::thread> pool;
+    for (unsigned int i = 1; i < threads; i++) {
+        pool.emplace_back(build_split_tiles, std::ref(pyramid), std::ref(next));
+    }
+    build_split_tiles(pyramid, next);
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+
+    bool result = !pyramid.failed;
+    if (result && pyramid.split_zoom > 0) {
+        pyramid.split_tiles_ready = true;
+        std::vector<unsigned char> top;
+        result = build_tile(pyramid, 0, 0, 0, top);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    free_image(source);
+
+    if (!result) {
+        std::cerr << "Failed to write the pyramid" << std::endl;
+        return 1;
+    }
+
+    unsigned long long tiles = pyramid.rendered + pyramid.downsampled;
+    std::cerr << "Wrote " << tiles << " tiles (" << pyramid.rendered << " reprojected, " << pyramid.downsampled << " downsampled) in "
+              << elapsed << " s, " << tiles / elapsed << " tiles/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+/**
+ * Run the pyramid command, given the arguments starting from "pyramid".
+ * Writes every Z/X/Y tile of a map down to the deepest zoom level, which is the only one reprojected from the source.
+ * Every other level is made by downsampling the four tiles below it. Returns the exit code.
+ */
+int run_pyramid_command(int argc, char **argv);
+
+#endif
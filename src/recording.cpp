@@ -0,0 +1,193 @@
+#include "recording.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+/**
+ * The file starts with the magic, a version byte and the window size as two 32 bit integers. Every event after that is
+ * its type as a byte, the microseconds since the previous event as a 32 bit integer, and then depending on the type:
+ * a key as 32 bit integer and an action byte, a mouse button and action byte followed by the cursor position as two
+ * floats, two floats for cursor positions, scroll offsets and sizes, or nothing to quit. Everything is little-endian.
+ */
+static const char magic[4] = {'M', 'P', 'I', 'R'};
+static const unsigned char version = 1;
+
+static std::ofstream record_file;
+static std::string record_filename;
+static double last_record_time;
+
+static void write_u8(std::ostream &out, uint8_t value) {
+    out.put((char) value);
+}
+
+static void write_u32(std::ostream &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.put((char) ((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void write_f32(std::ostream &out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    write_u32(out, bits);
+}
+
+static bool read_u8(std::istream &in, uint8_t &value) {
+    int c = in.get();
+    value = (uint8_t) c;
+    return c != EOF;
+}
+
+static bool read_u32(std::istream &in, uint32_t &value) {
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t byte;
+        if (!read_u8(in, byte)) {
+            return false;
+        }
+        value |= (uint32_t) byte << (8 * i);
+    }
+    return true;
+}
+
+static bool read_f32(std::istream &in, float &value) {
+    uint32_t bits;
+    if (!read_u32(in, bits)) {
+        return false;
+    }
+    std::memcpy(&value, &bits, sizeof(value));
+    return true;
+}
+
+bool start_recording(const std::string &filename, int window_width, int window_height, double time) {
+    record_file.open(filename, std::ios::binary);
+    if (record_file.fail()) {
+        std::cerr << "Failed to open " << filename << " for recording input" << std::endl;
+        return false;
+    }
+    record_filename = filename;
+    last_record_time = time;
+    record_file.write(magic, sizeof(magic));
+    write_u8(record_file, version);
+    write_u32(record_file, (uint32_t) window_width);
+    write_u32(record_file, (uint32_t) window_height);
+    return true;
+}
+
+bool is_recording() {
+    return record_file.is_open();
+}
+
+void record_input(const InputEvent &event, double time) {
+    if (!record_file.is_open()) {
+        return;
+    }
+    // Rounding each delta on its own would let the error add up over a long recording
+    double delay = std::fmax(0.0, std::round((time - last_record_time) * 1e6));
+    last_record_time += delay / 1e6;
+
+    write_u8(record_file, (uint8_t) event.type);
+    write_u32(record_file, (uint32_t) delay);
+    switch (event.type) {
+        case INPUT_KEY:
+            write_u32(record_file, (uint32_t) event.code);
+            write_u8(record_file, (uint8_t) event.action);
+            break;
+        case INPUT_MOUSE_BUTTON:
+            write_u8(record_file, (uint8_t) event.code);
+            write_u8(record_file, (uint8_t) event.action);
+            write_f32(record_file, (float) event.x);
+            write_f32(record_file, (float) event.y);
+            break;
+        case INPUT_CURSOR:
+        case INPUT_SCROLL:
+        case INPUT_WINDOW_SIZE:
+        case INPUT_FRAMEBUFFER_SIZE:
+            write_f32(record_file, (float) event.x);
+            write_f32(record_file, (float) event.y);
+            break;
+        case INPUT_QUIT:
+            break;
+    }
+}
+
+bool stop_recording() {
+    if (!record_file.is_open()) {
+        return true;
+    }
+    record_file.close();
+    if (record_file.fail()) {
+        std::cerr << "Failed to write the input recording to " << record_filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_recording(const std::string &filename, Recording &recording) {
+    std::ifstream file(filename, std::ios::binary);
+    if (file.fail()) {
+        std::cerr << "Failed to open input recording " << filename << std::endl;
+        return false;
+    }
+
+    char file_magic[sizeof(magic)];
+    uint8_t file_version;
+    uint32_t width, height;
+    if (!file.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0 ||
+        !read_u8(file, file_version) || file_version != version || !read_u32(file, width) || !read_u32(file, height)) {
+        std::cerr << filename << " is not an input recording" << std::endl;
+        return false;
+    }
+    recording.window_width = (int) width;
+    recording.window_height = (int) height;
+    recording.events.clear();
+
+    double time = 0;
+    uint8_t type;
+    while (read_u8(file, type)) {
+        uint32_t delay;
+        RecordedInput input = {0, {(InputType) type, 0, 0, 0, 0, 0}};
+        bool ok = read_u32(file, delay);
+        time += delay / 1e6;
+        input.time = time;
+
+        uint32_t code = 0;
+        uint8_t byte = 0, action = 0;
+        float x = 0, y = 0;
+        switch (type) {
+            case INPUT_KEY:
+                ok = ok && read_u32(file, code) && read_u8(file, action);
+                input.event.code = (int) code;
+                input.event.action = action;
+                break;
+            case INPUT_MOUSE_BUTTON:
+                ok = ok && read_u8(file, byte) && read_u8(file, action) && read_f32(file, x) && read_f32(file, y);
+                input.event.code = byte;
+                input.event.action = action;
+                input.event.x = x;
+                input.event.y = y;
+                break;
+            case INPUT_CURSOR:
+            case INPUT_SCROLL:
+            case INPUT_WINDOW_SIZE:
+            case INPUT_FRAMEBUFFER_SIZE:
+                ok = ok && read_f32(file, x) && read_f32(file, y);
+                input.event.x = x;
+                input.event.y = y;
+                break;
+            case INPUT_QUIT:
+                break;
+            default:
+                ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Input recording " << filename << " is cut off or corrupt after " << recording.events.size() << " events" << std::endl;
+            return false;
+        }
+        recording.events.push_back(input);
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Input as the callbacks on the main thread get it, to be handled on the render thread.
+ */
+enum InputType {
+    INPUT_KEY,
+    INPUT_MOUSE_BUTTON,
+    INPUT_CURSOR,
+    INPUT_SCROLL,
+    INPUT_WINDOW_SIZE,
+    INPUT_FRAMEBUFFER_SIZE,
+    INPUT_QUIT
+};
+
+struct InputEvent {
+    InputType type;
+    // Key or mouse button
+    int code;
+    int action;
+    // Cursor position, scroll offset or size
+    double x;
+    double y;
+    // When the window handed it over, in seconds, see add_latency_input
+    double time;
+};
+
+struct RecordedInput {
+    // Seconds since the recording started
+    double time;
+    InputEvent event;
+};
+
+struct Recording {
+    // Size of the window when the recording started, which cursor positions are relative to
+    int window_width;
+    int window_height;
+    std::vector<RecordedInput> events;
+};
+
+/**
+ * Log every event passed to record_input to filename until stop_recording.
+ * Events are stored with the time since the previous one in microseconds and only the fields their type uses,
+ * cursor positions and sizes as floats, so that a minute of dragging takes well under a megabyte.
+ */
+bool start_recording(const std::string &filename, int window_width, int window_height, double time);
+
+/**
+ * Add an event that happened at time, in the same clock as given to start_recording. Only one thread may record.
+ */
+void record_input(const InputEvent &event, double time);
+
+/**
+ * Finish the file, returns false if anything could not be written.
+ */
+bool stop_recording();
+
+bool is_recording();
+
+bool load_recording(const std::string &filename, Recording &recording);
+
+#endif
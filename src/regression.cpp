@@ -0,0 +1,476 @@
+#include "regression.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "glstate.h"
+#include "images.h"
+#include "mapper.h"
+#include "maps.h"
+#include "projection.h"
+#include "projections/mollweide.h"
+#include "projections/robinson.h"
+#include "projections/winkel.h"
+#include "renderer.h"
+#include "reproject.h"
+#include "series.h"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Small enough that the golden images stay small, large enough that a wrong pixel row or column shows up.
+ */
+static const unsigned int check_width = 192;
+
+/**
+ * Renders are repeated and the fastest one is kept, which is the most stable measure on a busy machine.
+ */
+static const int timing_repeats = 3;
+
+/**
+ * Cases that take less than this many milliseconds are not checked for slowdowns, their timings are mostly noise.
+ */
+static const double min_checked_time = 1;
+
+static const char *timings_file = "timings.txt";
+
+struct CheckCase {
+    std::string name;
+    std::string map;
+    Projection *output;
+    // Degrees, see set_rotation
+    double longitude;
+    double latitude;
+    double roll;
+    double zoom;
+};
+
+struct CheckResult {
+    double gl_ms;
+    double cpu_ms;
+    // Percentage of pixels that differ from the golden image by more than the tolerance
+    double golden_diff;
+    // Mean channel difference between OpenGL and the CPU
+    double parity_error;
+    bool has_golden;
+    bool passed;
+};
+
+static Projection *outputs[] = {&equirectangular, &mollweide, &hammer, &azimuthal, &robinson, &winkel, &mercator};
+
+/**
+ * Every output projection from a source in each of the projections that maps come in, plus zoomed in views
+ * of the equirectangular map, which show the edges of the texture and the projections.
+ */
+static std::vector<CheckCase> get_cases() {
+    const char *maps[] = {"earth1", "earth5", "earth6", "earth8"};
+    std::vector<CheckCase> cases;
+    for (const char *map : maps) {
+        for (Projection *output : outputs) {
+            cases.push_back({std::string(map) + "-" + output->shader, map, output, 30, 20, 10, 1});
+        }
+    }
+    for (Projection *output : outputs) {
+        cases.push_back({"earth1-" + output->shader + "-zoom", "earth1", output, -60, 45, 0, 2});
+    }
+    return cases;
+}
+
+static double milliseconds_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static unsigned int get_check_height(const Projection *output) {
+    return (unsigned int) (check_width * output->height / output->width);
+}
+
+/**
+ * Render the case with OpenGL into image, which is allocated here, and return the fastest time in milliseconds.
+ */
+static double render_gl(const CheckCase &check, Image &image) {
+    const double PI = 3.141592653589793238462;
+    unsigned int width = check_width;
+    unsigned int height = get_check_height(check.output);
+
+    set_rotation(check.longitude * PI / 180, check.latitude * PI / 180, check.roll * PI / 180);
+    zoom = check.zoom;
+
+    GLuint framebuffer;
+    GLuint renderbuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+    double best = -1;
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+        for (int i = 0; i < timing_repeats; i++) {
+            glFinish();
+            Clock::time_point start = Clock::now();
+            render_map(width, height);
+            glFinish();
+            double ms = milliseconds_since(start);
+            best = best < 0 ? ms : std::min(best, ms);
+        }
+
+        image.width = width;
+        image.height = height;
+        image.channels = 3;
+        image.data = new unsigned char[width * height * 3];
+        std::vector<unsigned char> pixels(width * height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        // OpenGL reads rows bottom up
+        for (unsigned int row = 0; row < height; row++) {
+            std::copy_n(pixels.data() + (height - 1 - row) * width * 3, width * 3, image.data + row * width * 3);
+        }
+    } else {
+        std::cerr << "Failed to create the framebuffer for " << check.name << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    return best;
+}
+
+/**
+ * Render the case on the CPU the same way as the reproject command, with nearest sampling like the textures.
+ */
+static double render_cpu(const CheckCase &check, const Image &source, Image &image) {
+    const double PI = 3.141592653589793238462;
+    Reprojection reprojection = {
+        .source = find_map(check.map)->source,
+        .output = check.output,
+        .rotation = {},
+        .zoom = check.zoom,
+        .bilinear = false
+    };
+    make_rotation(check.longitude * PI / 180, check.latitude * PI / 180, check.roll * PI / 180, reprojection.rotation);
+    prepare_cpu_conversions();
+
+    image.width = check_width;
+    image.height = get_check_height(check.output);
+    image.channels = 3;
+    image.data = new unsigned char[image.width * image.height * 3];
+
+    double best = -1;
+    for (int i = 0; i < timing_repeats; i++) {
+        Clock::time_point start = Clock::now();
+        reproject_rows(reprojection, source, image, 0, image.height);
+        double ms = milliseconds_since(start);
+        best = best < 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+/**
+ * The percentage of pixels where any channel differs by more than tolerance, 100 if the sizes differ.
+ */
+static double get_difference(const Image &a, const Image &b, unsigned int tolerance) {
+    if (a.width != b.width || a.height != b.height || a.channels != b.channels) {
+        return 100;
+    }
+    std::size_t pixels = (std::size_t) a.width * a.height;
+    std::size_t different = 0;
+    for (std::size_t i = 0; i < pixels; i++) {
+        for (int c = 0; c < a.channels; c++) {
+            if ((unsigned int) std::abs(a.data[i * a.channels + c] - b.data[i * b.channels + c]) > tolerance) {
+                different++;
+                break;
+            }
+        }
+    }
+    return pixels ? 100.0 * different / pixels : 0;
+}
+
+/**
+ * The mean difference of all channels, 255 if the sizes differ.
+ * Sources that go through lookup tables on the GPU sample a neighbouring texel fairly often, which changes a lot
+ * of pixels by a little on detailed maps, so OpenGL and the CPU are compared by how much they differ on average.
+ */
+static double get_mean_error(const Image &a, const Image &b) {
+    if (a.width != b.width || a.height != b.height || a.channels != b.channels) {
+        return 255;
+    }
+    std::size_t values = (std::size_t) a.width * a.height * a.channels;
+    double sum = 0;
+    for (std::size_t i = 0; i < values; i++) {
+        sum += std::abs(a.data[i] - b.data[i]);
+    }
+    return values ? sum / values : 0;
+}
+
+/**
+ * Read the timings recorded with the golden images, one "name gl_ms cpu_ms" line per case.
+ */
+static void load_timings(const std::string &filename, std::map<std::string, std::pair<double, double>> &timings) {
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        double gl_ms, cpu_ms;
+        if (line.empty() || line[0] == '#' || !(fields >> name >> gl_ms >> cpu_ms)) {
+            continue;
+        }
+        timings[name] = {gl_ms, cpu_ms};
+    }
+}
+
+static bool is_slower(double ms, double baseline, double max_slowdown) {
+    return max_slowdown > 0 && baseline > 0 && ms > min_checked_time && ms > baseline * max_slowdown;
+}
+
+/**
+ * Wait until nothing of the series is decoding or waiting to be uploaded, or return false after a few seconds.
+ */
+static bool settle_series(TimeSeries *series) {
+    Clock::time_point start = Clock::now();
+    while (milliseconds_since(start) < 5000) {
+        update_time_series(series);
+        if (!is_series_loading(series)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+/**
+ * Play a series of solid frames whose length is not a multiple of the layers across the wrap from the last frame to
+ * the first, and check that the layers given to the renderer hold the frames around the position and that the ring
+ * settles instead of decoding frames over and over. Returns what went wrong, or an empty string.
+ */
+static std::string check_series_wrap() {
+    const int frames = 10;
+    const unsigned int layers = 8;
+    const unsigned int size = 4;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "mapprojection-series-check";
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        return "could not create " + directory.string();
+    }
+
+    // Frame f is solid with a red of 20 * f
+    std::vector<std::string> filenames;
+    std::vector<unsigned char> pixels(size * size * 3);
+    Image frame = {size, size, 3, pixels.data()};
+    for (int f = 0; f < frames; f++) {
+        for (std::size_t i = 0; i < pixels.size(); i += 3) {
+            pixels[i] = 20 * f;
+        }
+        filenames.push_back((directory / ("frame" + std::to_string(f) + ".png")).string());
+        if (!save_image(filenames.back(), frame)) {
+            return "could not write " + filenames.back();
+        }
+    }
+
+    unsigned int last_layers = series_layers;
+    series_layers = layers;
+    Texture texture;
+    TimeSeries *series = open_time_series(filenames, frame, 0, 0, 0, 0, texture);
+    series_layers = last_layers;
+    if (!series) {
+        return "could not open the series";
+    }
+
+    std::ostringstream problems;
+    std::vector<unsigned char> layer_pixels((std::size_t) texture.width * texture.height * 3 * layers);
+    // Twice across the wrap in quarter frames, including 8.25 where frames 8 and 0 would share a layer
+    for (double position = 6; position < 2 * frames + 2 && problems.str().empty(); position += 0.25) {
+        set_series_position(series, position);
+        if (!wait_for_series(series) || !settle_series(series)) {
+            problems << " the series did not load at " << position;
+            break;
+        }
+        update_time_series(series);
+        if (is_series_loading(series)) {
+            problems << " decoded again after loading at " << position;
+        }
+
+        float first_layer, second_layer, blend;
+        get_series_frames(series, first_layer, second_layer, blend);
+        bind_texture(0, GL_TEXTURE_2D_ARRAY, texture.texture_id);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_UNSIGNED_BYTE, layer_pixels.data());
+        std::size_t layer_size = (std::size_t) texture.width * texture.height * 3;
+        int first = (int) std::floor(position) % frames;
+        int first_shown = layer_pixels[(std::size_t) first_layer * layer_size] / 20;
+        int second_shown = layer_pixels[(std::size_t) second_layer * layer_size] / 20;
+        if (first_shown != first || second_shown != (first + 1) % frames || blend != position - std::floor(position)) {
+            problems << " showed frames " << first_shown << " and " << second_shown << " blended by " << blend << " at " << position;
+        }
+    }
+
+    close_time_series(series);
+    std::filesystem::remove_all(directory, error);
+    return problems.str();
+}
+
+static bool write_report(const std::string &filename, const std::vector<CheckCase> &cases, const std::vector<CheckResult> &results) {
+    std::ofstream file(filename);
+    if (file.fail()) {
+        std::cerr << "Failed to open " << filename << " for the check report" << std::endl;
+        return false;
+    }
+    file << "{\"cases\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const CheckResult &result = results[i];
+        file << "  {\"name\": \"" << cases[i].name << "\", \"passed\": " << (result.passed ? "true" : "false")
+             << ", \"gl_ms\": " << result.gl_ms << ", \"cpu_ms\": " << result.cpu_ms
+             << ", \"golden_diff\": " << (result.has_golden ? result.golden_diff : -1)
+             << ", \"parity_error\": " << result.parity_error << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "]}\n";
+    return !file.fail();
+}
+
+bool run_regression_checks(const Options &options) {
+    std::vector<CheckCase> cases = get_cases();
+    std::filesystem::path golden_dir = options.golden_dir;
+
+    std::map<std::string, std::pair<double, double>> timings;
+    load_timings((golden_dir / timings_file).string(), timings);
+
+    if (options.update_golden) {
+        std::error_code error;
+        std::filesystem::create_directories(golden_dir, error);
+        if (error) {
+            std::cerr << "Failed to create " << golden_dir.string() << ": " << error.message() << std::endl;
+            return false;
+        }
+    }
+
+    Projection *last_output = output_projection;
+    std::vector<Projection *> last_views = view_projections;
+    view_projections.clear();
+    bool mesh = mesh_mode;
+    mesh_mode = false;
+
+    std::vector<CheckResult> results;
+    std::ostringstream new_timings;
+    new_timings << "# name gl_ms cpu_ms, the fastest of " << timing_repeats << " renders at " << check_width << " pixels wide\n";
+    unsigned int failed = 0;
+
+    for (const CheckCase &check : cases) {
+        CheckResult result = {-1, -1, 100, 255, false, false};
+
+        SphereMap *map = find_map(check.map);
+        output_projection = check.output;
+        Image source;
+        if (!map || !set_map(check.map) || !update_shader() || !load_map_image(*map, source)) {
+            std::cerr << check.name << ": failed to load the map or shader" << std::endl;
+            results.push_back(result);
+            failed++;
+            continue;
+        }
+
+        Image gl_image = {0, 0, 0, nullptr};
+        Image cpu_image = {0, 0, 0, nullptr};
+        result.gl_ms = render_gl(check, gl_image);
+        result.cpu_ms = render_cpu(check, source, cpu_image);
+        free_image(source);
+
+        std::string golden_file = (golden_dir / (check.name + ".png")).string();
+        if (result.gl_ms >= 0) {
+            result.parity_error = get_mean_error(gl_image, cpu_image);
+            if (options.update_golden) {
+                result.has_golden = save_image(golden_file, gl_image);
+                result.golden_diff = 0;
+            } else {
+                Image golden;
+                if (std::filesystem::exists(golden_file) && load_image(golden_file, golden)) {
+                    result.has_golden = true;
+                    result.golden_diff = get_difference(gl_image, golden, options.pixel_tolerance);
+                    free_image(golden);
+                }
+            }
+        }
+
+        std::ostringstream problems;
+        if (result.gl_ms < 0) {
+            problems << " OpenGL render failed";
+        }
+        if (!result.has_golden) {
+            problems << (options.update_golden ? " could not write " : " missing ") << golden_file;
+        } else if (result.golden_diff > options.max_golden_diff) {
+            problems << " " << result.golden_diff << "% of pixels differ from the golden image";
+        }
+        if (result.parity_error > options.max_parity_error) {
+            problems << " OpenGL and the CPU differ by " << result.parity_error << " on average";
+        }
+        auto timing = timings.find(check.name);
+        if (!options.update_golden && timing != timings.end()) {
+            if (is_slower(result.gl_ms, timing->second.first, options.max_slowdown)) {
+                problems << " OpenGL took " << result.gl_ms << " ms instead of " << timing->second.first << " ms";
+            }
+            if (is_slower(result.cpu_ms, timing->second.second, options.max_slowdown)) {
+                problems << " CPU took " << result.cpu_ms << " ms instead of " << timing->second.second << " ms";
+            }
+        }
+
+        result.passed = problems.str().empty();
+        if (!result.passed) {
+            failed++;
+        }
+        std::cout << (result.passed ? "ok   " : "FAIL ") << check.name << ": OpenGL " << result.gl_ms << " ms, CPU " << result.cpu_ms
+                  << " ms, golden " << result.golden_diff << "%, parity " << result.parity_error << problems.str() << std::endl;
+
+        new_timings << check.name << " " << result.gl_ms << " " << result.cpu_ms << "\n";
+        results.push_back(result);
+        free_image(gl_image);
+        free_image(cpu_image);
+    }
+
+    // Time series have no golden image, the layers they upload are checked directly
+    cases.push_back({"series-wrap", "", nullptr, 0, 0, 0, 1});
+    CheckResult series_result = {-1, -1, 0, 0, false, false};
+    Clock::time_point series_start = Clock::now();
+    std::string series_problems = check_series_wrap();
+    series_result.gl_ms = milliseconds_since(series_start);
+    series_result.passed = series_problems.empty();
+    if (!series_result.passed) {
+        failed++;
+    }
+    std::cout << (series_result.passed ? "ok   " : "FAIL ") << "series-wrap: OpenGL " << series_result.gl_ms << " ms" << series_problems << std::endl;
+    results.push_back(series_result);
+
+    output_projection = last_output;
+    view_projections = last_views;
+    mesh_mode = mesh;
+    // The last case left its map current, which is kept, but with the output projection and views from before
+    update_shader();
+
+    if (options.update_golden) {
+        std::ofstream file(golden_dir / timings_file);
+        file << new_timings.str();
+        if (file.fail()) {
+            std::cerr << "Failed to write " << (golden_dir / timings_file).string() << std::endl;
+            failed++;
+        }
+    }
+    if (!options.check_report.empty() && !write_report(options.check_report, cases, results)) {
+        failed++;
+    }
+
+    std::cout << cases.size() - failed << " of " << cases.size() << " checks passed" << std::endl;
+    return failed == 0;
+}
@@ -0,0 +1,15 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include "options.h"
+
+/**
+ * Render a fixed set of views of several maps and output projections with OpenGL and on the CPU, and compare the
+ * OpenGL images to the golden images in options.golden_dir and the CPU images to the OpenGL ones.
+ * Returns false if any case differs or renders slower than allowed by the options.
+ * With options.update_golden, the golden images and timings are written instead.
+ * Needs a current OpenGL context, like the other batch modes.
+ */
+bool run_regression_checks(const Options &options);
+
+#endif
@@ -0,0 +1,610 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include "GL/glext.h"
+#include "GL/gl.h"
+
+#include "projection.h"
+#include "glstate.h"
+#include "mapper.h"
+#include "shaders.h"
+#include "maps.h"
+#include "mesh.h"
+#include "reproject.h"
+#include "stats.h"
+#include "trace.h"
+
+Projection *output_projection;
+double zoom = 1;
+bool infinite_mode = false;
+bool mesh_mode = false;
+bool cost_heatmap = false;
+
+std::vector<Projection *> view_projections;
+
+static std::map<std::string, LoadedShader> loaded_shaders;
+static LoadedShader *current_shader;
+
+// Texture units of the overlays, after the ones that the lookup tables of the projections use
+static const unsigned int first_overlay_unit = 11;
+
+/**
+ * Append the shader of name that has function, with the function renamed after name, like ll_to_xy_mollweide.
+ */
+static bool append_renamed(const std::string &name, const std::string &function, std::string &code) {
+    std::string buffer;
+    if (!read_shader(name + "." + function, buffer)) {
+        return false;
+    }
+    std::size_t position = buffer.find(" " + function + "(");
+    if (position == std::string::npos) {
+        std::cerr << "No " << function << " in the " << name << " shader!" << std::endl;
+        return false;
+    }
+    buffer.insert(position + 1 + function.size(), "_" + name);
+    code += "\n" + buffer;
+    return true;
+}
+
+/**
+ * The generated shader code for mapping to outputs. Several outputs are compiled into one program, with every
+ * projection's xy_to_ll renamed after it and picked by the view being drawn.
+ */
+static bool get_output_code(const std::vector<Projection *> &outputs, std::string &code) {
+    if (outputs.size() == 1) {
+        return read_shader(outputs[0]->shader + ".xy_to_ll", code);
+    }
+
+    std::string dispatch = "bool xy_to_ll(inout vec2 zoomed) {\n    switch (view) {\n";
+    std::vector<std::string> added;
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+        const std::string &name = outputs[i]->shader;
+        dispatch += "    case " + std::to_string(i) + ": return xy_to_ll_" + name + "(zoomed);\n";
+        // A projection shown twice only needs its functions and uniforms once
+        if (std::find(added.begin(), added.end(), name) != added.end()) {
+            continue;
+        }
+        added.push_back(name);
+        if (!append_renamed(name, "xy_to_ll", code)) {
+            return false;
+        }
+    }
+    code += "\n" + dispatch + "    }\n    return false;\n}\n";
+    return true;
+}
+
+/**
+ * The generated shader code for sampling map through its source projection. With overlays, every overlay is
+ * composited over the map in the same pass: the longitude and latitude come from the rotation once, and are passed
+ * to the ll_to_xy of each layer's source projection, renamed after it.
+ */
+static bool get_layer_code(const SphereMap *map, std::string &code) {
+    if (map->overlays.empty()) {
+        return read_shader(map->source->shader + ".ll_to_xy", code);
+    }
+
+    std::vector<std::string> added;
+    std::string composite = "void composite_layers(vec2 lonlat, inout vec3 color) {\n    vec2 uv;\n    vec4 layer;\n";
+    for (std::size_t i = 0; i <= map->overlays.size(); i++) {
+        const std::string &name = (i == 0 ? map : &map->overlays[i - 1])->source->shader;
+        if (i > 0) {
+            std::string index = std::to_string(i - 1);
+            composite += "    uv = lonlat;\n    ll_to_xy_" + name + "(uv);\n";
+            composite += "    layer = texture(layer_samplers[" + index + "], get_texture_uv(uv) * layer_uv_scales[" + index + "]);\n";
+            composite += "    COST_FETCH(1);\n";
+            composite += "    color = mix(color, layer.rgb, layer.a * layer_opacities[" + index + "]);\n";
+        }
+        if (std::find(added.begin(), added.end(), name) != added.end()) {
+            continue;
+        }
+        added.push_back(name);
+        if (!append_renamed(name, "ll_to_xy", code)) {
+            return false;
+        }
+    }
+    code += "\nvoid ll_to_xy(inout vec2 uv) {\n    ll_to_xy_" + map->source->shader + "(uv);\n}\n";
+    code += "\nuniform sampler2D layer_samplers[LAYER_COUNT];\nuniform vec2 layer_uv_scales[LAYER_COUNT];\nuniform float layer_opacities[LAYER_COUNT];\n";
+    code += "\n" + composite + "}\n";
+    return true;
+}
+
+/**
+ * The sources of every layer of map after its own, see get_layer_code.
+ */
+static std::vector<Projection *> get_overlay_sources(const SphereMap *map) {
+    std::vector<Projection *> sources;
+    for (const SphereMap &overlay : map->overlays) {
+        sources.push_back(overlay.source);
+    }
+    return sources;
+}
+
+/**
+ * Compile the shader that maps the current map to outputs, with every output in a view of its own if there are several.
+ */
+static bool load_map_shader(const std::vector<Projection *> &outputs, LoadedShader &loaded) {
+    SphereMap *current_map = get_current_map();
+    loaded.source = current_map->source;
+    loaded.overlay_sources = get_overlay_sources(current_map);
+    loaded.outputs = outputs;
+
+    std::string vertex_shader;
+    std::string fragment_shader;
+    std::string buffer;
+
+    if (!read_shader("vertex", vertex_shader)) {
+        std::cerr << "Failed to load vertex shader!" << std::endl;
+        return false;
+    }
+
+    if (!read_shader("fragment", fragment_shader)) {
+        std::cerr << "Failed to load fragment shader!" << std::endl;
+        return false;
+    }
+
+    std::string source_names = current_map->source->shader;
+    for (Projection *source : loaded.overlay_sources) {
+        source_names += "+" + source->shader;
+    }
+
+    if (!get_layer_code(current_map, buffer)) {
+        std::cerr << "Failed to read " << source_names << " source mapping shader!" << std::endl;
+        return false;
+    }
+
+    fragment_shader += "\n" + buffer;
+    buffer.clear();
+
+    std::string output_names;
+    for (Projection *output : outputs) {
+        output_names += (output_names.empty() ? "" : ", ") + output->shader;
+    }
+
+    if (!get_output_code(outputs, buffer)) {
+        std::cerr << "Failed to read " << output_names << " output mapping shader!" << std::endl;
+        return false;
+    }
+
+    fragment_shader += "\n" + buffer;
+
+    // Defines have to come after the #version line
+    std::string defines;
+    if (cost_heatmap) {
+        defines += "#define COST_HEATMAP\n";
+    }
+    std::string fragment_defines;
+    if (current_map->series) {
+        fragment_defines += "#define TIME_SERIES\n";
+    }
+    if (!current_map->overlays.empty()) {
+        fragment_defines += "#define LAYER_COUNT " + std::to_string(current_map->overlays.size()) + "\n";
+    }
+    if (outputs.size() > 1) {
+        defines += "#define MULTI_VIEW\n#define VIEW_COUNT " + std::to_string(outputs.size()) + "\n";
+        vertex_shader.insert(vertex_shader.find('\n') + 1, defines);
+    }
+    fragment_shader.insert(fragment_shader.find('\n') + 1, defines + fragment_defines);
+
+    if (!load_shader(source_names + " to " + output_names, vertex_shader, fragment_shader, loaded.shader)) {
+        std::cerr << "Failed to compile generated " << source_names << " to " << output_names << " shader!" << std::endl;
+        std::cerr << "Fragment shader dump:" << std::endl;
+        std::cerr << fragment_shader << std::endl;
+        return false;
+    }
+
+    //std::cout << "Loaded shader " << source_names + " to " + output_names << ", code:" << std::endl;
+    //std::cout << fragment_shader << std::endl;
+
+    // The sampler always reads unit 0 and the block always comes from binding 0, so both are only set once
+    GLuint program = loaded.shader.program_id;
+    use_program(program);
+    glUniform1i(glGetUniformLocation(program, "texture_sampler"), 0);
+    for (std::size_t i = 0; i < loaded.overlay_sources.size(); i++) {
+        glUniform1i(glGetUniformLocation(program, ("layer_samplers[" + std::to_string(i) + "]").c_str()), first_overlay_unit + i);
+    }
+    GLuint view_index = glGetUniformBlockIndex(program, "View");
+    if (view_index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, view_index, 0);
+    }
+    glGenBuffers(1, &loaded.uniform_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, loaded.uniform_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewUniforms), nullptr, GL_DYNAMIC_DRAW);
+    loaded.uniforms_valid = false;
+
+    loaded.view_scales_id = glGetUniformLocation(program, "view_scales");
+    loaded.view_grid_id = glGetUniformLocation(program, "view_grid");
+    loaded.view_tile_id = glGetUniformLocation(program, "view_tile");
+    loaded.view_layout.clear();
+    loaded.layer_uv_scales_id = glGetUniformLocation(program, "layer_uv_scales");
+    loaded.layer_opacities_id = glGetUniformLocation(program, "layer_opacities");
+    return true;
+}
+
+bool update_shader() {
+    TRACE_ZONE("update_shader");
+    SphereMap *current_map = get_current_map();
+    std::vector<Projection *> outputs = view_projections;
+    if (outputs.empty()) {
+        outputs.push_back(output_projection);
+    }
+    // The heatmap and time series variants of a shader are cached next to the normal one
+    std::string shader_key = std::string(cost_heatmap ? "heatmap " : "") + (current_map->series ? "series " : "") + current_map->source->shader;
+    // Maps with overlays from the same sources share a shader, and set the scales and opacities of their own below
+    for (Projection *source : get_overlay_sources(current_map)) {
+        shader_key += "+" + source->shader;
+    }
+    shader_key += " to";
+    for (Projection *output : outputs) {
+        shader_key += " " + output->shader;
+    }
+
+    auto it = loaded_shaders.find(shader_key);
+    if (it == loaded_shaders.end()) {
+        LoadedShader loaded;
+        if (!load_map_shader(outputs, loaded)) {
+            return false;
+        }
+        it = loaded_shaders.emplace(shader_key, loaded).first;
+    }
+
+    current_shader = &it->second;
+    if (current_shader->source->prepare_input) {
+        current_shader->source->prepare_input(current_map->texture.width, current_map->texture.height, current_shader->shader.program_id);
+    }
+    for (Projection *output : current_shader->outputs) {
+        if (output->prepare_output) {
+            output->prepare_output(current_map->texture.width, current_map->texture.height, current_shader->shader.program_id);
+        }
+    }
+    std::vector<GLfloat> uv_scales;
+    std::vector<GLfloat> opacities;
+    for (SphereMap &overlay : current_map->overlays) {
+        if (overlay.source->prepare_input) {
+            overlay.source->prepare_input(overlay.texture.width, overlay.texture.height, current_shader->shader.program_id);
+        }
+        uv_scales.push_back(overlay.texture.sx);
+        uv_scales.push_back(overlay.texture.sy);
+        opacities.push_back(overlay.opacity);
+    }
+    use_program(current_shader->shader.program_id);
+    if (!opacities.empty()) {
+        glUniform2fv(current_shader->layer_uv_scales_id, opacities.size(), uv_scales.data());
+        glUniform1fv(current_shader->layer_opacities_id, opacities.size(), opacities.data());
+    }
+    return true;
+}
+
+bool set_projection(Projection *projection) {
+    Projection *prev = output_projection;
+    output_projection = projection;
+    if (!update_shader()) {
+        std::cerr << "Failed to load shader for new output projection " << projection->shader << ", going back to " << prev->shader << std::endl;
+        output_projection = prev;
+        return false;
+    }
+    return true;
+}
+
+bool set_views(const std::vector<Projection *> &projections) {
+    if (projections.size() > max_views) {
+        std::cerr << "At most " << max_views << " views can be shown at once, got " << projections.size() << std::endl;
+        return false;
+    }
+    std::vector<Projection *> prev = view_projections;
+    view_projections = projections;
+    if (!update_shader()) {
+        std::cerr << "Failed to load shader for " << projections.size() << " views, going back to the ones before" << std::endl;
+        view_projections = prev;
+        return false;
+    }
+    return true;
+}
+
+LoadedShader *get_current_shader() {
+    return current_shader;
+}
+
+void get_view_grid(int count, int &columns, int &rows) {
+    columns = std::max(1, (int) std::ceil(std::sqrt(count)));
+    rows = std::max(1, (count + columns - 1) / columns);
+}
+
+/**
+ * Scale of a view of projection that is width by height pixels, see get_frame_scale.
+ */
+static void get_projection_scale(const Projection *projection, double width, double height, float &scale_x, float &scale_y) {
+    scale_x = 1;
+    scale_y = 1;
+    if (height * projection->width > width * projection->height) {
+        scale_y = projection->height / projection->width * width / height;
+    } else {
+        scale_x = projection->width / projection->height * height / width;
+    }
+}
+
+void get_frame_scale(int width, int height, float &scale_x, float &scale_y) {
+    get_projection_scale(output_projection, width, height, scale_x, scale_y);
+}
+
+double get_frame_aspect_ratio() {
+    if (view_projections.empty()) {
+        return output_projection->height / output_projection->width;
+    }
+    int columns, rows;
+    get_view_grid(view_projections.size(), columns, rows);
+    double ratio = 0;
+    for (Projection *projection : view_projections) {
+        ratio = std::max(ratio, (double) projection->height / projection->width);
+    }
+    return ratio * rows / columns;
+}
+
+/**
+ * The uniforms of the current view, drawn with the given scale and offset.
+ */
+static ViewUniforms get_view_uniforms(float scale_x, float scale_y, float offset_x, float offset_y) {
+    ViewUniforms uniforms = {};
+    float rotation[9];
+    get_rotation(rotation);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            uniforms.rotation[column * 4 + row] = rotation[column * 3 + row];
+        }
+    }
+    SphereMap *map = get_current_map();
+    Texture &texture = map->texture;
+    uniforms.scale[0] = scale_x;
+    uniforms.scale[1] = scale_y;
+    uniforms.offset[0] = offset_x;
+    uniforms.offset[1] = offset_y;
+    uniforms.uv_scale[0] = texture.sx;
+    uniforms.uv_scale[1] = texture.sy;
+    uniforms.zoom = zoom;
+    uniforms.infinite_mode = infinite_mode;
+    if (map->series) {
+        get_series_frames(map->series, uniforms.frame_layers[0], uniforms.frame_layers[1], uniforms.frame_blend);
+    }
+    return uniforms;
+}
+
+/**
+ * Make the shader's View block hold uniforms, which uploads nothing while the view stays the same.
+ */
+static void set_view_uniforms(LoadedShader *shader, const ViewUniforms &uniforms) {
+    if (!shader->uniforms_valid || std::memcmp(&shader->uniforms, &uniforms, sizeof(uniforms)) != 0) {
+        ERR(glBindBuffer(GL_UNIFORM_BUFFER, shader->uniform_buffer);)
+        ERR(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms), &uniforms);)
+        shader->uniforms = uniforms;
+        shader->uniforms_valid = true;
+    }
+    ERR(bind_uniform_buffer(0, shader->uniform_buffer);)
+}
+
+/**
+ * Bind the textures of the current map and its overlays to the units that the shader samples them from.
+ */
+static void bind_map_textures() {
+    SphereMap *map = get_current_map();
+    ERR(bind_texture(0, map->texture.target, map->texture.texture_id);)
+    for (std::size_t i = 0; i < map->overlays.size(); i++) {
+        Texture &texture = map->overlays[i].texture;
+        ERR(bind_texture(first_overlay_unit + i, texture.target, texture.texture_id);)
+    }
+}
+
+static void draw(const ViewUniforms &uniforms) {
+    ERR(use_program(current_shader->shader.program_id);)
+    bind_map_textures();
+    set_view_uniforms(current_shader, uniforms);
+    ERR(render_rectangle(1);)
+}
+
+/**
+ * Draw every view of a frame of frame_width by frame_height pixels with a single instanced draw, where the part of
+ * the frame that is drawn has center (cx, cy) and half size (hx, hy), see render_map_tile.
+ */
+static void draw_views(int frame_width, int frame_height, float cx, float cy, float hx, float hy) {
+    const std::vector<Projection *> &outputs = current_shader->outputs;
+    int columns, rows;
+    get_view_grid(outputs.size(), columns, rows);
+
+    // Scales of every view, then the grid and the tile, only set when they change
+    std::vector<GLfloat> layout;
+    for (Projection *output : outputs) {
+        float scale_x, scale_y;
+        get_projection_scale(output, frame_width / (double) columns, frame_height / (double) rows, scale_x, scale_y);
+        layout.push_back(scale_x);
+        layout.push_back(scale_y);
+    }
+    layout.insert(layout.end(), {(GLfloat) columns, (GLfloat) rows, cx, cy, hx, hy});
+
+    ERR(use_program(current_shader->shader.program_id);)
+    if (layout != current_shader->view_layout) {
+        ERR(glUniform2fv(current_shader->view_scales_id, outputs.size(), layout.data());)
+        ERR(glUniform2i(current_shader->view_grid_id, columns, rows);)
+        ERR(glUniform4f(current_shader->view_tile_id, cx, cy, hx, hy);)
+        current_shader->view_layout = layout;
+    }
+    bind_map_textures();
+    set_view_uniforms(current_shader, get_view_uniforms(1, 1, 0, 0));
+    ERR(render_rectangle(outputs.size());)
+}
+
+/**
+ * Everything the mesh depends on, so that it is only rebuilt when the view changes.
+ */
+struct MeshView {
+    float rotation[9];
+    double zoom;
+    int width;
+    int height;
+    LoadedShader *shader;
+    // Texture names are reused once the catalog is reloaded, the mesh only depends on the size
+    GLuint texture_id;
+    unsigned int texture_width;
+    unsigned int texture_height;
+};
+
+static Shader mesh_shader;
+static bool mesh_shader_loaded = false;
+static GLuint mesh_uv_scale_id;
+static float mesh_uv_scale[2];
+// Triangles and fallback cells
+static GLuint mesh_buffers[2];
+static GLuint mesh_arrays[2];
+static Mesh mesh;
+static MeshView mesh_view;
+
+static bool prepare_mesh_shader() {
+    if (mesh_shader_loaded) {
+        return true;
+    }
+
+    std::string vertex_shader;
+    std::string fragment_shader;
+    if (!read_shader("vertex", vertex_shader) || !read_shader("mesh", fragment_shader) || !load_shader("mesh", vertex_shader, fragment_shader, mesh_shader)) {
+        std::cerr << "Failed to load the mesh shader, going back to computing every pixel" << std::endl;
+        mesh_mode = false;
+        return false;
+    }
+
+    use_program(mesh_shader.program_id);
+    glUniform1i(glGetUniformLocation(mesh_shader.program_id, "texture_sampler"), 0);
+    mesh_uv_scale_id = glGetUniformLocation(mesh_shader.program_id, "uv_scale");
+    mesh_uv_scale[0] = -1;
+    glGenBuffers(2, mesh_buffers);
+    for (int i = 0; i < 2; i++) {
+        mesh_arrays[i] = create_vertex_array(mesh_buffers[i]);
+    }
+    mesh_view.shader = nullptr;
+    mesh_shader_loaded = true;
+    return true;
+}
+
+static bool is_same_view(const MeshView &a, const MeshView &b) {
+    for (int i = 0; i < 9; i++) {
+        if (a.rotation[i] != b.rotation[i]) {
+            return false;
+        }
+    }
+    return a.zoom == b.zoom && a.width == b.width && a.height == b.height && a.shader == b.shader && a.texture_id == b.texture_id && a.texture_width == b.texture_width && a.texture_height == b.texture_height;
+}
+
+static void update_mesh(int width, int height) {
+    Texture &texture = get_current_map()->texture;
+    MeshView view;
+    get_rotation(view.rotation);
+    view.zoom = zoom;
+    view.width = width;
+    view.height = height;
+    view.shader = current_shader;
+    view.texture_id = texture.texture_id;
+    view.texture_width = texture.width;
+    view.texture_height = texture.height;
+    if (is_same_view(view, mesh_view)) {
+        return;
+    }
+    mesh_view = view;
+
+    Reprojection reprojection = {
+        .source = current_shader->source,
+        .output = current_shader->outputs[0],
+        .rotation = {},
+        .zoom = zoom,
+        .bilinear = true
+    };
+    std::copy(view.rotation, view.rotation + 9, reprojection.rotation);
+    build_mesh(reprojection, width, height, texture.width, texture.height, mesh);
+
+    ERR(glBindBuffer(GL_ARRAY_BUFFER, mesh_buffers[0]);)
+    ERR(glBufferData(GL_ARRAY_BUFFER, mesh.triangles.size() * sizeof(float), mesh.triangles.data(), GL_DYNAMIC_DRAW);)
+    ERR(glBindBuffer(GL_ARRAY_BUFFER, mesh_buffers[1]);)
+    ERR(glBufferData(GL_ARRAY_BUFFER, mesh.fallback.size() * sizeof(float), mesh.fallback.data(), GL_DYNAMIC_DRAW);)
+}
+
+static void draw_triangles(GLuint vertex_array, std::size_t vertices) {
+    bind_vertex_array(vertex_array);
+    glDrawArrays(GL_TRIANGLES, 0, vertices);
+}
+
+/**
+ * Draw the map with one texture lookup per pixel wherever the mesh could be interpolated,
+ * and with the normal shader only in the cells left over.
+ */
+static void draw_mesh(int width, int height, const ViewUniforms &uniforms) {
+    update_mesh(width, height);
+
+    Texture &texture = get_current_map()->texture;
+    ERR(use_program(mesh_shader.program_id);)
+    ERR(bind_texture(0, GL_TEXTURE_2D, texture.texture_id);)
+    if (mesh_uv_scale[0] != texture.sx || mesh_uv_scale[1] != texture.sy) {
+        mesh_uv_scale[0] = texture.sx;
+        mesh_uv_scale[1] = texture.sy;
+        ERR(glUniform2f(mesh_uv_scale_id, texture.sx, texture.sy);)
+    }
+    ERR(draw_triangles(mesh_arrays[0], mesh.triangles.size() / 5);)
+
+    if (!mesh.fallback.empty()) {
+        ERR(use_program(current_shader->shader.program_id);)
+        set_view_uniforms(current_shader, uniforms);
+        ERR(draw_triangles(mesh_arrays[1], mesh.fallback.size() / 5);)
+    }
+}
+
+void render_map(int width, int height) {
+    TRACE_ZONE("render_map");
+    set_viewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    float scale_x, scale_y;
+    get_frame_scale(width, height, scale_x, scale_y);
+    ViewUniforms uniforms = get_view_uniforms(scale_x, scale_y, 0, 0);
+
+    begin_gpu_timer();
+    // Every point is valid in infinite mode, which the mesh does not handle, and the heatmap is about the exact shader.
+    // The mesh is built for a single projection, so several views are always drawn per pixel, and its shader only
+    // samples a single 2D texture, which leaves out time series and overlays.
+    SphereMap *map = get_current_map();
+    if (current_shader->outputs.size() > 1) {
+        draw_views(width, height, 0, 0, 1, 1);
+    } else if (mesh_mode && !infinite_mode && !cost_heatmap && !map->series && map->overlays.empty() && prepare_mesh_shader()) {
+        draw_mesh(width, height, uniforms);
+    } else {
+        draw(uniforms);
+    }
+    end_gpu_timer();
+}
+
+/**
+ * The tile covers the rectangle with center c and half size h of the full frame, so the shader's
+ * (UV * 2 - 1 + offset) / scale gives the same coordinates as the full frame when offset = c / h and
+ * scale = full_scale / h.
+ */
+void render_map_tile(int frame_width, int frame_height, int x, int y, int w, int h) {
+    set_viewport(0, 0, w, h);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    double hx = w / (double) frame_width;
+    double hy = h / (double) frame_height;
+    double cx = (2 * x + w) / (double) frame_width - 1;
+    double cy = 1 - (2 * y + h) / (double) frame_height;
+
+    // Views are placed in the vertex shader, which moves the whole grid instead
+    if (current_shader->outputs.size() > 1) {
+        draw_views(frame_width, frame_height, cx, cy, hx, hy);
+        return;
+    }
+
+    float scale_x, scale_y;
+    get_frame_scale(frame_width, frame_height, scale_x, scale_y);
+
+    draw(get_view_uniforms(scale_x / hx, scale_y / hy, cx / hx, cy / hy));
+}
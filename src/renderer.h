@@ -0,0 +1,106 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "projection.h"
+#include "shaders.h"
+
+/**
+ * The View uniform block of the fragment shader, in its std140 layout.
+ */
+struct ViewUniforms {
+    // Column-major, with every column padded to four floats
+    GLfloat rotation[12];
+    GLfloat scale[2];
+    GLfloat offset[2];
+    GLfloat uv_scale[2];
+    GLfloat zoom;
+    GLint infinite_mode;
+    GLfloat frame_layers[2];
+    GLfloat frame_blend;
+    // The block is rounded up to a multiple of 16 bytes
+    GLfloat padding;
+};
+
+struct LoadedShader {
+    Projection *source;
+    // Sources of the overlays of the map, drawn over it in the same pass
+    std::vector<Projection *> overlay_sources;
+    // A single projection, or the projection of every view, see set_views
+    std::vector<Projection *> outputs;
+    Shader shader;
+
+    // Holds the View block of this shader, and is only written when uniforms changes
+    GLuint uniform_buffer;
+    ViewUniforms uniforms;
+    bool uniforms_valid;
+
+    // Only in shaders with several views, where each view has a scale of its own
+    GLint view_scales_id;
+    GLint view_grid_id;
+    GLint view_tile_id;
+    // The scales, grid and tile that were last set
+    std::vector<GLfloat> view_layout;
+
+    // Only in shaders with overlays, set for the current map by update_shader
+    GLint layer_uv_scales_id;
+    GLint layer_opacities_id;
+};
+
+// Enough for a 3x3 grid, which is as small as the views get on a 4K screen while still being useful
+static const unsigned int max_views = 9;
+
+extern Projection *output_projection;
+extern double zoom;
+extern bool infinite_mode;
+// Interpolate texture coordinates over an adaptive mesh in render_map instead of computing them for every pixel
+extern bool mesh_mode;
+// Render the estimated cost of every pixel instead of the map, with shaders built with COST_HEATMAP defined
+extern bool cost_heatmap;
+// Output projections that are shown side by side instead of output_projection when not empty, see set_views
+extern std::vector<Projection *> view_projections;
+
+/**
+ * Make sure the shader for the current map and output projection is compiled and in use.
+ */
+bool update_shader();
+bool set_projection(Projection *projection);
+
+/**
+ * Show the current map in every one of projections at once, in a grid of views filled row by row from the top left.
+ * All of the views are drawn in one instanced draw of a shader that has every projection compiled in, with the same
+ * rotation, zoom and texture. An empty list goes back to showing output_projection on its own.
+ */
+bool set_views(const std::vector<Projection *> &projections);
+LoadedShader *get_current_shader();
+
+/**
+ * Number of columns and rows of the grid that count views are shown in.
+ */
+void get_view_grid(int count, int &columns, int &rows);
+
+/**
+ * Calculate how much the output projection has to be scaled to fit into a frame without stretching.
+ */
+void get_frame_scale(int width, int height, float &scale_x, float &scale_y);
+
+/**
+ * Height per width of a frame that the output projection, or every view, fits into without borders.
+ */
+double get_frame_aspect_ratio();
+
+/**
+ * Render the current map to the whole of the currently bound framebuffer.
+ */
+void render_map(int width, int height);
+
+/**
+ * Render a part of a larger frame to the currently bound framebuffer.
+ * The tile is given in pixels of the full frame, with (0, 0) being the top left corner.
+ */
+void render_map_tile(int frame_width, int frame_height, int x, int y, int w, int h);
+
+#endif
@@ -0,0 +1,226 @@
+#include "reproject.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define HAVE_RDTSC
+#endif
+
+void get_output_scale(const Projection *output, unsigned int width, unsigned int height, double &scale_x, double &scale_y) {
+    scale_x = 1;
+    scale_y = 1;
+    if (height * output->width > width * output->height) {
+        scale_y = output->height / output->width * width / height;
+    } else {
+        scale_x = output->width / output->height * height / width;
+    }
+}
+
+bool output_to_source(const Reprojection &reprojection, double x, double y, double &source_x, double &source_y) {
+    x /= reprojection.zoom;
+    y /= reprojection.zoom;
+    if (x < -1 || x > 1 || y < -1 || y > 1) {
+        return false;
+    }
+
+    double u, v;
+    if (!reprojection.output->xy_to_uv(x, y, u, v)) {
+        return false;
+    }
+
+    double origin[3] = {std::sin(u) * std::cos(v), std::sin(v), -std::cos(u) * std::cos(v)};
+    double dest[3];
+    const float *r = reprojection.rotation;
+    for (int i = 0; i < 3; i++) {
+        dest[i] = r[i] * origin[0] + r[3 + i] * origin[1] + r[6 + i] * origin[2];
+    }
+
+    u = std::atan2(dest[0], -dest[2]);
+    v = std::asin(std::fmax(-1.0, std::fmin(1.0, dest[1])));
+
+    if (!reprojection.source->uv_to_xy(u, v, x, y)) {
+        return false;
+    }
+
+    source_x = (x + 1) / 2;
+    source_y = (y + 1) / 2;
+    source_x -= std::floor(source_x);
+    source_y -= std::floor(source_y);
+    source_y = 1 - source_y;
+
+    return true;
+}
+
+static inline void copy_pixel(const struct Image &source, unsigned int x, unsigned int y, unsigned char *pixel, unsigned char channels) {
+    const unsigned char *from = source.data + (y * source.width + x) * source.channels;
+    for (int c = 0; c < channels; c++) {
+        pixel[c] = from[source.channels == 1 ? 0 : c];
+    }
+}
+
+static void sample_nearest(const struct Image &source, double x, double y, unsigned char *pixel, unsigned char channels) {
+    unsigned int px = std::fmax(0.0, std::fmin(x * source.width, source.width - 1));
+    unsigned int py = std::fmax(0.0, std::fmin(y * source.height, source.height - 1));
+    copy_pixel(source, px, py, pixel, channels);
+}
+
+static void sample_bilinear(const struct Image &source, double x, double y, unsigned char *pixel, unsigned char channels) {
+    double fx = std::fmax(0.0, std::fmin(x * source.width - 0.5, source.width - 1));
+    double fy = std::fmax(0.0, std::fmin(y * source.height - 0.5, source.height - 1));
+    unsigned int x0 = fx, y0 = fy;
+    unsigned int x1 = x0 + 1 < source.width ? x0 + 1 : x0;
+    unsigned int y1 = y0 + 1 < source.height ? y0 + 1 : y0;
+    double tx = fx - x0, ty = fy - y0;
+
+    unsigned char corners[4][4];
+    copy_pixel(source, x0, y0, corners[0], channels);
+    copy_pixel(source, x1, y0, corners[1], channels);
+    copy_pixel(source, x0, y1, corners[2], channels);
+    copy_pixel(source, x1, y1, corners[3], channels);
+
+    for (int c = 0; c < channels; c++) {
+        double top = corners[0][c] * (1 - tx) + corners[1][c] * tx;
+        double bottom = corners[2][c] * (1 - tx) + corners[3][c] * tx;
+        pixel[c] = (unsigned char) (top * (1 - ty) + bottom * ty + 0.5);
+    }
+}
+
+void output_pixel_to_map(const Reprojection &reprojection, unsigned int width, unsigned int height, unsigned int col, unsigned int row, double &x, double &y) {
+    double scale_x, scale_y;
+    get_output_scale(reprojection.output, width, height, scale_x, scale_y);
+    // Pixel centers, with y pointing up like in the shader
+    x = (2 * (col + 0.5) / width - 1) / scale_x;
+    y = (1 - 2 * (row + 0.5) / height) / scale_y;
+}
+
+void sample_source(const Reprojection &reprojection, const struct Image &source, double source_x, double source_y, unsigned char *pixel, unsigned char channels) {
+    if (reprojection.bilinear) {
+        sample_bilinear(source, source_x, source_y, pixel, channels);
+    } else {
+        sample_nearest(source, source_x, source_y, pixel, channels);
+    }
+}
+
+void get_source_rows(const Reprojection &reprojection, unsigned int source_height, double source_y, unsigned int &first, unsigned int &last) {
+    if (reprojection.bilinear) {
+        first = std::fmax(0.0, std::fmin(source_y * source_height - 0.5, source_height - 1));
+        last = first + 1 < source_height ? first + 1 : first;
+    } else {
+        first = last = std::fmin(source_y * source_height, source_height - 1);
+    }
+}
+
+void reproject_rows(const Reprojection &reprojection, const struct Image &source, struct Image &output, unsigned int first_row, unsigned int rows) {
+    if (first_row >= output.height) {
+        return;
+    }
+    Image band = output;
+    band.height = std::min(rows, output.height - first_row);
+    band.data = output.data + first_row * output.width * output.channels;
+    reproject_region(reprojection, source, band, output.width, output.height, 0, first_row);
+}
+
+void reproject_region(const Reprojection &reprojection, const struct Image &source, struct Image &output,
+                      unsigned int frame_width, unsigned int frame_height, unsigned int x, unsigned int y) {
+    for (unsigned int row = 0; row < output.height; row++) {
+        unsigned char *pixel = output.data + row * output.width * output.channels;
+
+        for (unsigned int col = 0; col < output.width; col++, pixel += output.channels) {
+            double map_x, map_y, source_x, source_y;
+            bool inside = x + col < frame_width && y + row < frame_height;
+            if (inside) {
+                output_pixel_to_map(reprojection, frame_width, frame_height, x + col, y + row, map_x, map_y);
+            }
+            if (inside && output_to_source(reprojection, map_x, map_y, source_x, source_y)) {
+                sample_source(reprojection, source, source_x, source_y, pixel, output.channels);
+            } else {
+                for (int c = 0; c < output.channels; c++) {
+                    pixel[c] = 0;
+                }
+            }
+        }
+    }
+}
+
+static inline uint64_t read_cycles() {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+const char *get_cost_unit() {
+#ifdef HAVE_RDTSC
+    return "cycles";
+#else
+    return "ns";
+#endif
+}
+
+void reproject_cost_rows(const Reprojection &reprojection, const struct Image &source, struct Image &output, uint32_t *costs,
+                         unsigned int first_row, unsigned int rows) {
+    unsigned int last_row = std::min(first_row + rows, output.height);
+    for (unsigned int row = first_row; row < last_row; row++) {
+        unsigned char *pixel = output.data + row * output.width * output.channels;
+        uint32_t *cost = costs + row * output.width;
+
+        for (unsigned int col = 0; col < output.width; col++, pixel += output.channels, cost++) {
+            uint64_t start = read_cycles();
+            double map_x, map_y, source_x, source_y;
+            output_pixel_to_map(reprojection, output.width, output.height, col, row, map_x, map_y);
+            bool valid = output_to_source(reprojection, map_x, map_y, source_x, source_y);
+            if (valid) {
+                sample_source(reprojection, source, source_x, source_y, pixel, output.channels);
+            }
+            uint64_t cycles = read_cycles() - start;
+            *cost = (uint32_t) std::min<uint64_t>(cycles, cost_invalid - 1) | (valid ? 0 : cost_invalid);
+        }
+    }
+}
+
+/**
+ * The same ramp as cost_color in the fragment shader, for t from 0 to 1.
+ */
+static void cost_to_color(double t, bool invalid, unsigned char *pixel) {
+    t = std::fmax(0.0, std::fmin(1.0, t)) * 4;
+    double heat[3] = {t - 2, std::fmin(t, 4 - t), 2 - t};
+    double magenta[3] = {1, 0, 1};
+    for (int c = 0; c < 3; c++) {
+        double value = std::fmax(0.0, std::fmin(1.0, heat[c]));
+        if (invalid) {
+            value = (value + magenta[c]) / 2;
+        }
+        pixel[c] = (unsigned char) (value * 255 + 0.5);
+    }
+}
+
+uint32_t paint_cost_heatmap(const uint32_t *costs, struct Image &output) {
+    std::size_t pixels = (std::size_t) output.width * output.height;
+    std::vector<uint32_t> valid;
+    for (std::size_t i = 0; i < pixels; i++) {
+        if (!(costs[i] & cost_invalid)) {
+            valid.push_back(costs[i]);
+        }
+    }
+    uint32_t red = 1;
+    if (!valid.empty()) {
+        std::size_t index = std::min(valid.size() - 1, (std::size_t) (valid.size() * 0.99));
+        std::nth_element(valid.begin(), valid.begin() + index, valid.end());
+        red = std::max(1u, valid[index]);
+    }
+
+    for (std::size_t i = 0; i < pixels; i++) {
+        uint32_t cost = costs[i] & ~cost_invalid;
+        cost_to_color((double) cost / red, costs[i] & cost_invalid, output.data + i * output.channels);
+    }
+    return red;
+}
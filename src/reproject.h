@@ -0,0 +1,86 @@
+#ifndef REPROJECT_H
+#define REPROJECT_H
+
+#include <cstdint>
+
+#include "images.h"
+#include "projection.h"
+
+/**
+ * Everything needed to reproject an image on the CPU, mirroring the uniforms of the fragment shader.
+ */
+struct Reprojection {
+    Projection *source;
+    Projection *output;
+    // Row-major, the same layout as in mapper
+    float rotation[9];
+    double zoom;
+    bool bilinear;
+};
+
+/**
+ * Same as get_frame_scale in the renderer, for any output projection.
+ */
+void get_output_scale(const Projection *output, unsigned int width, unsigned int height, double &scale_x, double &scale_y);
+
+/**
+ * Find where the output map point (x, y), from (-1, -1) to (1, 1) before zooming, comes from in the source image.
+ * The source point is given from (0, 0) at the top left corner to (1, 1) at the bottom right one.
+ * Returns false if the point is outside of the output projection.
+ */
+bool output_to_source(const Reprojection &reprojection, double x, double y, double &source_x, double &source_y);
+
+/**
+ * Find the output map point at the center of a pixel of an output frame, fitted to the output projection the same way as in the renderer.
+ */
+void output_pixel_to_map(const Reprojection &reprojection, unsigned int width, unsigned int height, unsigned int col, unsigned int row, double &x, double &y);
+
+/**
+ * Sample the source image at a point given by output_to_source, writing the first channels of the pixel.
+ */
+void sample_source(const Reprojection &reprojection, const struct Image &source, double source_x, double source_y, unsigned char *pixel, unsigned char channels);
+
+/**
+ * Find the first and last rows of a source image with the given height that sample_source reads for a point.
+ */
+void get_source_rows(const Reprojection &reprojection, unsigned int source_height, double source_y, unsigned int &first, unsigned int &last);
+
+/**
+ * Reproject rows [first_row, first_row + rows) of the output image, which has its size and channels set and its data allocated.
+ * The output frame is fitted to the output projection the same way as in the renderer, the rest is left black.
+ * Output channels are taken from the first source channels, a grayscale source is repeated into all of them.
+ */
+void reproject_rows(const Reprojection &reprojection, const struct Image &source, struct Image &output, unsigned int first_row, unsigned int rows);
+
+/**
+ * Reproject the part of a frame of frame_width by frame_height pixels that starts at (x, y) and has the size of the output image.
+ * Parts of the output outside of the frame are left black.
+ */
+void reproject_region(const Reprojection &reprojection, const struct Image &source, struct Image &output,
+                      unsigned int frame_width, unsigned int frame_height, unsigned int x, unsigned int y);
+
+/**
+ * Set in a cost from reproject_cost_rows for pixels outside of the output projection, or that no source point maps to.
+ */
+const uint32_t cost_invalid = 1u << 31;
+
+/**
+ * Reproject rows like reproject_rows, and store how long each pixel took in costs, which has a value for every pixel
+ * of the output image. Times are in CPU cycles where the processor has a cycle counter, see get_cost_unit.
+ */
+void reproject_cost_rows(const Reprojection &reprojection, const struct Image &source, struct Image &output, uint32_t *costs,
+                         unsigned int first_row, unsigned int rows);
+
+/**
+ * Paint the costs of every pixel of output over it, with the same colours as the cost heatmap of the shaders: from
+ * blue for nothing to red for the 99th percentile and above, and tinted magenta where the result was invalid.
+ * The output needs 3 channels. Returns the cost that red stands for.
+ */
+uint32_t paint_cost_heatmap(const uint32_t *costs, struct Image &output);
+
+/**
+ * "cycles", or "ns" where the costs are measured with a clock instead.
+ */
+const char *get_cost_unit();
+
+#endif
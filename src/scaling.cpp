@@ -0,0 +1,126 @@
+#include "scaling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "renderer.h"
+
+/**
+ * The resolution never drops below this fraction of the window, where the map becomes too blurry to follow.
+ */
+static const double min_scale = 0.25;
+
+/**
+ * Aim below the budget, so that a frame that is a bit slower than the last one still fits.
+ */
+static const double budget_headroom = 0.8;
+
+static double frame_budget = 0;
+static double render_scale = 1;
+
+static GLuint framebuffer = 0;
+static GLuint renderbuffer = 0;
+static int framebuffer_width = 0;
+static int framebuffer_height = 0;
+
+// Only one query is in flight at a time, it is read once the GPU is done with it instead of waiting
+static GLuint time_query = 0;
+static bool query_pending = false;
+static double query_scale = 1;
+
+void set_frame_budget(double milliseconds) {
+    frame_budget = milliseconds;
+}
+
+double get_render_scale() {
+    return render_scale;
+}
+
+static bool prepare_framebuffer(int width, int height) {
+    if (framebuffer == 0) {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(1, &renderbuffer);
+        glGenQueries(1, &time_query);
+    }
+    if (width == framebuffer_width && height == framebuffer_height) {
+        return true;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+    bool result = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!result) {
+        std::cerr << "Failed to create a " << width << "x" << height << " framebuffer for dynamic resolution, turning it off" << std::endl;
+        frame_budget = 0;
+        return false;
+    }
+
+    framebuffer_width = width;
+    framebuffer_height = height;
+    return true;
+}
+
+/**
+ * Move the scale towards the one that would have made the measured frame take as long as the budget.
+ * The cost of a frame is about proportional to its number of pixels, so to the square of the scale.
+ */
+static void update_scale() {
+    if (!query_pending) {
+        return;
+    }
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(time_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return;
+    }
+    GLuint64 nanoseconds;
+    glGetQueryObjectui64v(time_query, GL_QUERY_RESULT, &nanoseconds);
+    query_pending = false;
+
+    double milliseconds = std::max(nanoseconds / 1e6, 0.01);
+    double wanted = query_scale * std::sqrt(frame_budget * budget_headroom / milliseconds);
+    // Halfway there, so that a single odd frame does not make the resolution jump around
+    render_scale = std::clamp(render_scale + (wanted - render_scale) / 2, min_scale, 1.0);
+}
+
+bool render_map_scaled(int width, int height, bool interacting) {
+    if (!interacting || frame_budget <= 0) {
+        render_map(width, height);
+        return false;
+    }
+
+    update_scale();
+
+    int scaled_width = std::max(1, (int) std::lround(width * render_scale));
+    int scaled_height = std::max(1, (int) std::lround(height * render_scale));
+    if (!prepare_framebuffer(scaled_width, scaled_height)) {
+        render_map(width, height);
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    bool measure = !query_pending;
+    if (measure) {
+        glBeginQuery(GL_TIME_ELAPSED, time_query);
+    }
+    render_map(scaled_width, scaled_height);
+    if (measure) {
+        glEndQuery(GL_TIME_ELAPSED);
+        query_pending = true;
+        query_scale = render_scale;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, scaled_width, scaled_height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef SCALING_H
+#define SCALING_H
+
+/**
+ * Set how many milliseconds of GPU time a frame may take while interacting, 0 turns dynamic resolution off.
+ */
+void set_frame_budget(double milliseconds);
+
+/**
+ * Render the map to the whole of the default framebuffer.
+ * While interacting, the map is rendered at a lower resolution that follows the measured GPU time and then scaled up,
+ * otherwise it is rendered at full resolution. Returns whether the frame was rendered at a lower resolution.
+ */
+bool render_map_scaled(int width, int height, bool interacting);
+
+/**
+ * The fraction of the width and height that frames are rendered at while interacting.
+ */
+double get_render_scale();
+
+#endif
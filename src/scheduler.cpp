@@ -0,0 +1,90 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Every slot of the wheel covers one tick, and a timer that is due more than a full turn away waits in its slot
+ * until the wheel gets there in the right turn.
+ */
+static const double tick_length = 0.001;
+static const unsigned int wheel_size = 256;
+
+struct Timer {
+    double due;
+    double interval;
+    TimerCallback callback;
+};
+
+static std::vector<Timer> wheel[wheel_size];
+// The first tick that has not been run yet
+static unsigned long long next_tick = 0;
+static std::size_t timer_count = 0;
+
+static bool redraw = true;
+
+static unsigned long long get_tick(double time) {
+    return time > 0 ? (unsigned long long) (time / tick_length) : 0;
+}
+
+void add_timer(double due, double interval, TimerCallback callback) {
+    // Timers that are already due go into the next slot that is run
+    unsigned long long tick = std::max(get_tick(due), next_tick);
+    wheel[tick % wheel_size].push_back({due, interval, callback});
+    timer_count++;
+}
+
+void run_timers(double time) {
+    unsigned long long last_tick = get_tick(time);
+    if (timer_count == 0 || last_tick < next_tick) {
+        next_tick = std::max(next_tick, last_tick + 1);
+        return;
+    }
+
+    // After a long wait every slot has to be looked at, but never more than once
+    unsigned long long first_tick = std::max(next_tick, last_tick >= wheel_size ? last_tick - wheel_size + 1 : 0);
+    std::vector<Timer> due;
+    for (unsigned long long tick = first_tick; tick <= last_tick; tick++) {
+        std::vector<Timer> &slot = wheel[tick % wheel_size];
+        auto later = std::partition(slot.begin(), slot.end(), [time](const Timer &timer) { return timer.due > time; });
+        due.insert(due.end(), later, slot.end());
+        slot.erase(later, slot.end());
+    }
+    next_tick = last_tick + 1;
+    timer_count -= due.size();
+
+    // Callbacks can add timers of their own, so they are only called once the wheel is consistent again
+    std::sort(due.begin(), due.end(), [](const Timer &a, const Timer &b) { return a.due < b.due; });
+    for (const Timer &timer : due) {
+        if (timer.callback(time)) {
+            add_timer(time + timer.interval, timer.interval, timer.callback);
+        }
+    }
+}
+
+double get_timer_delay(double time) {
+    if (timer_count == 0) {
+        return -1;
+    }
+    double delay = -1;
+    for (const std::vector<Timer> &slot : wheel) {
+        for (const Timer &timer : slot) {
+            double until = std::max(0.0, timer.due - time);
+            if (delay < 0 || until < delay) {
+                delay = until;
+            }
+        }
+    }
+    return delay;
+}
+
+void request_redraw() {
+    redraw = true;
+}
+
+bool take_redraw() {
+    bool result = redraw;
+    redraw = false;
+    return result;
+}
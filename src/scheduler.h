@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/**
+ * Called with the current time in seconds when a timer is due. Returning true runs it again after its interval.
+ */
+typedef bool (*TimerCallback)(double time);
+
+/**
+ * Run callback once time reaches due, and then every interval seconds for as long as it returns true.
+ * An interval of 0 runs it before every frame, which is what animations use.
+ * Timers are kept in a hashed timer wheel, and are only meant to be used from the render thread.
+ */
+void add_timer(double due, double interval, TimerCallback callback);
+
+/**
+ * Run every timer that is due at time.
+ */
+void run_timers(double time);
+
+/**
+ * Seconds from time until the next timer is due, 0 if one is already due, or -1 if there are no timers.
+ */
+double get_timer_delay(double time);
+
+/**
+ * Mark the frame as out of date, so that it is rendered again as soon as possible.
+ */
+void request_redraw();
+
+/**
+ * Return whether a redraw has been requested since the last call.
+ */
+bool take_redraw();
+
+#endif
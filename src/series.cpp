@@ -0,0 +1,434 @@
+#include "series.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <GL/glew.h>
+#include "GL/glext.h"
+#include "GL/gl.h"
+
+#include "glstate.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "trace.h"
+
+unsigned int series_layers = 8;
+
+enum SlotState {
+    SLOT_IDLE,
+    // A worker is writing the pending frame into the pixel buffer
+    SLOT_DECODING,
+    // The pixel buffer holds the pending frame, which the render thread copies into the layer next
+    SLOT_DECODED,
+    SLOT_FAILED
+};
+
+/**
+ * A layer of the ring, along with the pixel buffer that the next frame for the layer is decoded into.
+ */
+struct SeriesSlot {
+    // Frame in the layer, -1 while empty
+    int frame;
+    // Frame being decoded into the pixel buffer, -1 if none
+    int pending;
+    GLuint pixel_buffer;
+    // Mapped by the render thread while a worker writes into it
+    unsigned char *pixels;
+    std::atomic<int> state;
+};
+
+struct SeriesJob {
+    unsigned int slot;
+    int frame;
+};
+
+struct TimeSeries {
+    explicit TimeSeries(unsigned int layers) : layers(layers), slots(new SeriesSlot[layers]), jobs(layers) {}
+
+    std::vector<std::string> filenames;
+    Image info;
+    // The crop, with its size resolved the same way as in crop_image
+    unsigned int x;
+    unsigned int y;
+    unsigned int w;
+    unsigned int h;
+    unsigned int padded_width;
+    unsigned int padded_height;
+    GLenum format;
+    GLuint texture_id;
+
+    unsigned int layers;
+    std::unique_ptr<SeriesSlot[]> slots;
+    // Frames that could not be read, which are skipped from then on
+    std::vector<bool> failed;
+    double position;
+    // The layers and blend that were shown last
+    float shown[3];
+
+    // At most one job per slot, so pushing never waits
+    BoundedQueue<SeriesJob> jobs;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+static std::size_t get_frame_size(const TimeSeries *series) {
+    return (std::size_t) series->padded_width * series->padded_height * series->info.channels;
+}
+
+/**
+ * Decode frame into pixels, cropped and padded with white the same way as in pad_image.
+ */
+static bool decode_frame(const TimeSeries *series, int frame, unsigned char *pixels) {
+    TRACE_ZONE("decode_frame");
+    const std::string &filename = series->filenames[frame];
+    Image image;
+    if (!load_image(filename, image)) {
+        return false;
+    }
+    if (image.width != series->info.width || image.height != series->info.height || image.channels != series->info.channels) {
+        std::cerr << filename << " is " << image.width << "x" << image.height << "x" << (int) image.channels << ", but the first frame is " << series->info.width << "x" << series->info.height << "x" << (int) series->info.channels << std::endl;
+        free_image(image);
+        return false;
+    }
+
+    std::size_t channels = image.channels;
+    std::size_t row = series->w * channels;
+    std::size_t padded_row = series->padded_width * channels;
+    for (unsigned int i = 0; i < series->h; i++) {
+        unsigned char *destination = pixels + i * padded_row;
+        std::memcpy(destination, image.data + ((std::size_t) (series->y + i) * image.width + series->x) * channels, row);
+        std::memset(destination + row, 0xFF, padded_row - row);
+    }
+    std::memset(pixels + series->h * padded_row, 0xFF, (series->padded_height - series->h) * padded_row);
+    free_image(image);
+    return true;
+}
+
+static void decode_frames(TimeSeries *series) {
+    SeriesJob job;
+    while (series->jobs.pop(job)) {
+        SeriesSlot &slot = series->slots[job.slot];
+        bool decoded = decode_frame(series, job.frame, slot.pixels);
+        {
+            std::lock_guard<std::mutex> lock(series->mutex);
+            slot.state = decoded ? SLOT_DECODED : SLOT_FAILED;
+        }
+        series->finished.notify_all();
+    }
+}
+
+static int get_first_frame(const TimeSeries *series) {
+    return std::min((int) std::floor(series->position), (int) series->filenames.size() - 1);
+}
+
+static int get_next_frame(const TimeSeries *series, int frame) {
+    return (frame + 1) % series->filenames.size();
+}
+
+/**
+ * The slot whose layer holds frame, or -1.
+ */
+static int find_slot(const TimeSeries *series, int frame) {
+    for (unsigned int i = 0; i < series->layers; i++) {
+        if (series->slots[i].frame == frame) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool is_uploaded(const TimeSeries *series, int frame) {
+    return find_slot(series, frame) >= 0;
+}
+
+static bool is_pending(const TimeSeries *series, int frame) {
+    for (unsigned int i = 0; i < series->layers; i++) {
+        if (series->slots[i].pending == frame) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_shown(const TimeSeries *series, unsigned int slot) {
+    return slot == series->shown[0] || slot == series->shown[1];
+}
+
+/**
+ * Whether frame is one of the frames from the position onwards that the ring holds, one per layer.
+ */
+static bool is_in_window(const TimeSeries *series, int frame) {
+    int length = series->filenames.size();
+    int ahead = (frame - get_first_frame(series) + length) % length;
+    return ahead < (int) series->layers;
+}
+
+/**
+ * A free slot for a frame of the window, which is one that holds none of its frames, preferably an empty one. The layers
+ * that are shown stay until the frames at the position replace them, so a stall never shows a later frame.
+ * Returns -1 if none.
+ */
+static int find_free_slot(const TimeSeries *series, bool at_position) {
+    int found = -1;
+    for (unsigned int i = 0; i < series->layers; i++) {
+        const SeriesSlot &slot = series->slots[i];
+        if (slot.state != SLOT_IDLE || (slot.frame >= 0 && is_in_window(series, slot.frame)) || (is_shown(series, i) && !at_position)) {
+            continue;
+        }
+        if (slot.frame < 0) {
+            return i;
+        }
+        if (found < 0) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+static bool is_done(const TimeSeries *series, int frame) {
+    return is_uploaded(series, frame) || series->failed[frame];
+}
+
+TimeSeries *open_time_series(const std::vector<std::string> &filenames, const Image &info, unsigned int x, unsigned int y, int w, int h, Texture &texture) {
+    TRACE_ZONE("open_time_series");
+    GLenum format;
+    if (info.channels == 1) {
+        format = GL_RED;
+    } else if (info.channels == 2) {
+        format = GL_RG;
+    } else if (info.channels == 3) {
+        format = GL_RGB;
+    } else if (info.channels == 4) {
+        format = GL_RGBA;
+    } else {
+        std::cerr << "Unknown number of channels in " << filenames[0] << ": " << (int) info.channels << std::endl;
+        return nullptr;
+    }
+
+    GLint max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    // Blending needs the frames on both sides of the position in layers of their own
+    unsigned int layers = std::min({(unsigned int) filenames.size(), std::max(series_layers, 2u), (unsigned int) std::max(max_layers, 2)});
+
+    TimeSeries *series = new TimeSeries(layers);
+    series->filenames = filenames;
+    series->info = info;
+    series->info.data = nullptr;
+    series->x = x;
+    series->y = y;
+    series->w = w <= 0 ? info.width + w - x : w;
+    series->h = h <= 0 ? info.height + h - y : h;
+    series->padded_width = get_padded_size(series->w);
+    series->padded_height = get_padded_size(series->h);
+    series->format = format;
+    series->failed.assign(filenames.size(), false);
+    series->position = 0;
+    series->shown[0] = -1;
+    series->shown[1] = -1;
+    series->shown[2] = 0;
+
+    glGenTextures(1, &series->texture_id);
+    bind_texture(0, GL_TEXTURE_2D_ARRAY, series->texture_id);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, series->padded_width, series->padded_height, layers, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    for (unsigned int i = 0; i < layers; i++) {
+        SeriesSlot &slot = series->slots[i];
+        slot.frame = -1;
+        slot.pending = -1;
+        glGenBuffers(1, &slot.pixel_buffer);
+        slot.pixels = nullptr;
+        slot.state = SLOT_IDLE;
+    }
+
+    // Leave a core to the render thread, there is no use in more workers than layers
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads > 1 ? threads - 1 : 1, layers);
+    for (unsigned int i = 0; i < threads; i++) {
+        series->workers.emplace_back(decode_frames, series);
+    }
+
+    if (!wait_for_series(series)) {
+        std::cerr << "Failed to load the first frame of " << filenames[0] << std::endl;
+        close_time_series(series);
+        return nullptr;
+    }
+    get_series_frames(series, series->shown[0], series->shown[1], series->shown[2]);
+
+    texture.texture_id = series->texture_id;
+    texture.target = GL_TEXTURE_2D_ARRAY;
+    texture.width = series->padded_width;
+    texture.height = series->padded_height;
+    texture.sx = (float) series->w / series->padded_width;
+    texture.sy = (float) series->h / series->padded_height;
+    return series;
+}
+
+void close_time_series(TimeSeries *series) {
+    TRACE_ZONE("close_time_series");
+    // Jobs that were queued already are still decoded, which takes at most one frame per layer
+    series->jobs.close();
+    for (std::thread &worker : series->workers) {
+        worker.join();
+    }
+    for (unsigned int i = 0; i < series->layers; i++) {
+        SeriesSlot &slot = series->slots[i];
+        if (slot.pixels) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pixel_buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.pixel_buffer);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    forget_texture(series->texture_id);
+    glDeleteTextures(1, &series->texture_id);
+    delete series;
+}
+
+unsigned int get_series_length(const TimeSeries *series) {
+    return series->filenames.size();
+}
+
+double get_series_position(const TimeSeries *series) {
+    return series->position;
+}
+
+void set_series_position(TimeSeries *series, double position) {
+    double length = series->filenames.size();
+    position = std::fmod(position, length);
+    if (position < 0) {
+        position += length;
+    }
+    // Adding the length to a tiny negative position can round to the length itself
+    series->position = position < length ? position : 0;
+}
+
+bool update_time_series(TimeSeries *series) {
+    TRACE_ZONE("update_time_series");
+    std::size_t size = get_frame_size(series);
+    bool bound = false;
+    bool uploaded = false;
+    int first = get_first_frame(series);
+    int second = get_next_frame(series, first);
+
+    for (unsigned int i = 0; i < series->layers; i++) {
+        SeriesSlot &slot = series->slots[i];
+        int state = slot.state;
+        if (state != SLOT_DECODED && state != SLOT_FAILED) {
+            continue;
+        }
+        ERR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pixel_buffer);)
+        ERR(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);)
+        bound = true;
+        slot.pixels = nullptr;
+        // The position moved on while the frame was decoded, and a shown layer is only replaced by a frame at the position
+        if (state == SLOT_DECODED && is_shown(series, i) && slot.pending != first && slot.pending != second) {
+            slot.pending = -1;
+            slot.state = SLOT_IDLE;
+            continue;
+        }
+        if (state == SLOT_DECODED) {
+            double upload_start = get_stat_time();
+            ERR(bind_texture(0, GL_TEXTURE_2D_ARRAY, series->texture_id);)
+            // The source is the bound pixel buffer, so the driver copies it into the layer without stopping the CPU
+            ERR(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, series->padded_width, series->padded_height, 1, series->format, GL_UNSIGNED_BYTE, nullptr);)
+            record_stat(STAT_TEXTURE_UPLOAD, get_stat_time() - upload_start);
+            slot.frame = slot.pending;
+            uploaded = true;
+        } else {
+            series->failed[slot.pending] = true;
+        }
+        slot.pending = -1;
+        slot.state = SLOT_IDLE;
+    }
+
+    // The frames from the position onwards, nearest first, one per layer
+    int frame = first;
+    for (unsigned int i = 0; i < series->layers; i++, frame = get_next_frame(series, frame)) {
+        if (is_done(series, frame) || is_pending(series, frame)) {
+            continue;
+        }
+        // Frames further on would not find a slot either
+        int free_slot = find_free_slot(series, frame == first || frame == second);
+        if (free_slot < 0) {
+            break;
+        }
+        SeriesSlot &slot = series->slots[free_slot];
+        ERR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pixel_buffer);)
+        bound = true;
+        // Orphaning the buffer lets the driver hand out new memory instead of waiting for the last copy out of it
+        ERR(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);)
+        slot.pixels = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!slot.pixels) {
+            std::cerr << "Failed to map a pixel buffer for " << series->filenames[frame] << std::endl;
+            break;
+        }
+        slot.pending = frame;
+        slot.state = SLOT_DECODING;
+        series->jobs.push({(unsigned int) free_slot, frame});
+    }
+
+    // Textures uploaded from memory would otherwise be read from the bound buffer
+    if (bound) {
+        ERR(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);)
+    }
+    return uploaded;
+}
+
+bool is_series_loading(const TimeSeries *series) {
+    for (unsigned int i = 0; i < series->layers; i++) {
+        if (series->slots[i].state != SLOT_IDLE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool wait_for_series(TimeSeries *series) {
+    TRACE_ZONE("wait_for_series");
+    int first = get_first_frame(series);
+    int second = get_next_frame(series, first);
+    while (true) {
+        update_time_series(series);
+        if (is_done(series, first) && is_done(series, second)) {
+            return !series->failed[first];
+        }
+        if (!is_series_loading(series)) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(series->mutex);
+        series->finished.wait(lock, [series]() {
+            for (unsigned int i = 0; i < series->layers; i++) {
+                int state = series->slots[i].state;
+                if (state == SLOT_DECODED || state == SLOT_FAILED) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+}
+
+void get_series_frames(TimeSeries *series, float &first_layer, float &second_layer, float &blend) {
+    int first = get_first_frame(series);
+    int second = get_next_frame(series, first);
+    int first_slot = find_slot(series, first);
+    if (first_slot >= 0) {
+        int second_slot = find_slot(series, second);
+        series->shown[0] = first_slot;
+        series->shown[1] = second_slot >= 0 ? second_slot : first_slot;
+        series->shown[2] = second_slot >= 0 ? series->position - first : 0;
+    }
+    first_layer = series->shown[0];
+    second_layer = series->shown[1];
+    blend = series->shown[2];
+}
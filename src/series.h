@@ -0,0 +1,63 @@
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <string>
+#include <vector>
+
+#include "images.h"
+
+/**
+ * Frames of the same extent, like a year of daily imagery, shown through a ring of layers of one array texture.
+ * The frames from the position onwards, one per layer, are decoded on worker threads straight into pixel buffers,
+ * which are then copied without waiting for the GPU into layers that hold none of those frames. Memory stays at one
+ * array texture and one pixel buffer per layer, however long the series is.
+ */
+struct TimeSeries;
+
+// Layers of the ring of every series opened from now on, see open_time_series
+extern unsigned int series_layers;
+
+/**
+ * Open the frames in filenames, which all have to be the size of info, cropped the same way as in SphereMap.
+ * texture is set to the array texture, whose size and scale are those of a single frame. The frames around position
+ * 0 are uploaded before this returns, the rest in the background. Returns nullptr if the first frame can not be shown.
+ */
+TimeSeries *open_time_series(const std::vector<std::string> &filenames, const Image &info, unsigned int x, unsigned int y, int w, int h, Texture &texture);
+
+/**
+ * Stop the workers and free the texture and pixel buffers.
+ */
+void close_time_series(TimeSeries *series);
+
+unsigned int get_series_length(const TimeSeries *series);
+
+/**
+ * The position is in frames, and wraps around from the last frame to the first, so 2.5 is halfway from frame 2 to 3.
+ */
+double get_series_position(const TimeSeries *series);
+void set_series_position(TimeSeries *series, double position);
+
+/**
+ * Upload the frames that finished decoding and start decoding the ones ahead of the position that are missing.
+ * Never waits, and returns whether any frame was uploaded. Only for the render thread, like everything else here.
+ */
+bool update_time_series(TimeSeries *series);
+
+/**
+ * Whether any frame is still being decoded or waiting to be uploaded.
+ */
+bool is_series_loading(const TimeSeries *series);
+
+/**
+ * Wait until the two frames around the position are uploaded, for batch renders that should not show older frames.
+ * Returns false if the frame at the position can not be read.
+ */
+bool wait_for_series(TimeSeries *series);
+
+/**
+ * The layers of the frames around the position and how far the position is from the first to the second. While a
+ * frame is still loading, the frames that were shown last are shown instead, so playback never waits for the disk.
+ */
+void get_series_frames(TimeSeries *series, float &first_layer, float &second_layer, float &blend);
+
+#endif
@@ -0,0 +1,522 @@
+#include "server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET Socket;
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int Socket;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#endif
+
+#include "cache.h"
+#include "images.h"
+#include "mapper.h"
+#include "maps.h"
+#include "options.h"
+#include "pipeline.h"
+#include "projection.h"
+#include "reproject.h"
+
+// Magic constant
+const double PI = 3.141592653589793238462;
+
+/**
+ * Request headers larger than this are refused.
+ */
+static const std::size_t max_header_size = 16384;
+
+/**
+ * Keep-alive connections that send nothing for this many seconds are closed, so they do not hold on to a thread.
+ */
+static const int idle_timeout = 10;
+
+/**
+ * The latency percentiles are taken over this many of the latest requests.
+ */
+static const std::size_t latency_samples = 8192;
+
+/**
+ * Higher zoom levels would overflow the frame size.
+ */
+static const unsigned int max_zoom = 16;
+
+struct CacheCounters {
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> coalesced;
+};
+
+struct Server {
+    ServeOptions options;
+    LruCache<std::string> tiles;
+    LruCache<Image> sources;
+    CacheCounters tile_counters;
+    CacheCounters source_counters;
+
+    std::atomic<unsigned long long> requests;
+    std::mutex latency_mutex;
+    // A ring of the latest request latencies in milliseconds
+    std::vector<double> latencies;
+    std::size_t next_latency;
+
+    Server(const ServeOptions &options)
+        : options(options), tiles((std::size_t) options.tile_cache << 20), sources((std::size_t) options.source_cache << 20),
+          tile_counters(), source_counters(), requests(0), next_latency(0) {}
+};
+
+struct Response {
+    int status;
+    std::string content_type;
+    // Shared with the tile cache, so that cached tiles are not copied
+    std::shared_ptr<const std::string> body;
+};
+
+static void count(CacheCounters &counters, CacheResult result) {
+    if (result == CACHE_HIT) {
+        counters.hits++;
+    } else if (result == CACHE_MISS) {
+        counters.misses++;
+    } else {
+        counters.coalesced++;
+    }
+}
+
+static bool send_all(Socket socket, const char *data, std::size_t size) {
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    // A client that went away should not kill the server
+    flags = MSG_NOSIGNAL;
+#endif
+    while (size > 0) {
+        int sent = send(socket, data, (int) std::min<std::size_t>(size, 1 << 30), flags);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static const char *status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 431: return "Request Header Fields Too Large";
+        default: return "Internal Server Error";
+    }
+}
+
+static bool send_response(Socket socket, const Response &response, bool keep_alive) {
+    std::ostringstream header;
+    header << "HTTP/1.1 " << response.status << " " << status_text(response.status) << "\r\n"
+           << "Content-Type: " << response.content_type << "\r\n"
+           << "Content-Length: " << response.body->size() << "\r\n"
+           << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n";
+    if (response.status == 200 && response.content_type == "image/png") {
+        header << "Cache-Control: public, max-age=86400\r\n";
+    }
+    header << "\r\n";
+    std::string text = header.str();
+    return send_all(socket, text.data(), text.size()) && send_all(socket, response.body->data(), response.body->size());
+}
+
+static Response text_response(int status, const std::string &text) {
+    return {status, "text/plain", std::make_shared<const std::string>(text + "\n")};
+}
+
+static std::string url_decode(const std::string &text) {
+    std::string decoded;
+    for (std::size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size()) {
+            decoded.push_back((char) std::strtol(text.substr(i + 1, 2).c_str(), NULL, 16));
+            i += 2;
+        } else {
+            decoded.push_back(text[i]);
+        }
+    }
+    return decoded;
+}
+
+static bool parse_unsigned(const std::string &text, unsigned int &value) {
+    if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    value = std::strtoul(text.c_str(), NULL, 10);
+    return true;
+}
+
+/**
+ * Parse LON,LAT[,ROLL] in degrees.
+ */
+static bool parse_angles(const std::string &text, double angles[3]) {
+    const char *start = text.c_str();
+    char *end;
+    angles[2] = 0;
+    for (int i = 0; i < 3; i++) {
+        angles[i] = std::strtod(start, &end);
+        if (end == start) {
+            return false;
+        }
+        if (*end == '\0') {
+            return i >= 1;
+        }
+        if (*end != ',') {
+            return false;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+static std::shared_ptr<const Image> get_source(Server &server, const std::string &name, SphereMap *map) {
+    CacheResult result;
+    std::shared_ptr<const Image> image = server.sources.get_or_create(name, [map](std::size_t &cost) {
+        Image *image = new Image;
+        if (!load_map_image(*map, *image)) {
+            delete image;
+            return std::shared_ptr<const Image>();
+        }
+        cost = (std::size_t) image->width * image->height * image->channels;
+        return std::shared_ptr<const Image>(image, [](const Image *image) {
+            delete[] image->data;
+            delete image;
+        });
+    }, result);
+    count(server.source_counters, result);
+    return image;
+}
+
+static Response render_tile(Server &server, const std::vector<std::string> &parts) {
+    SphereMap *map = find_map(parts[0]);
+    if (!map) {
+        return text_response(404, "Unknown map: " + parts[0]);
+    }
+    Projection *output = find_projection(parts[1]);
+    if (!output) {
+        return text_response(404, "Unknown projection: " + parts[1]);
+    }
+    double angles[3];
+    if (!parse_angles(parts[2], angles)) {
+        return text_response(400, "Invalid rotation, expected LON,LAT[,ROLL]: " + parts[2]);
+    }
+
+    unsigned int z, x, y;
+    std::string last = parts[5];
+    if (last.size() < 4 || last.compare(last.size() - 4, 4, ".png") != 0 || !parse_unsigned(parts[3], z) || !parse_unsigned(parts[4], x) || !parse_unsigned(last.substr(0, last.size() - 4), y)) {
+        return text_response(400, "Invalid tile, expected Z/X/Y.png");
+    }
+
+    // The frame has the projection's aspect ratio and is 2^z tiles wide
+    unsigned int tile_size = server.options.tile_size;
+    unsigned int frame_width = tile_size << std::min(z, max_zoom);
+    unsigned int frame_height = std::max(1.0, frame_width * output->height / output->width + 0.5);
+    if (z > max_zoom || x >= (1u << z) || y >= (frame_height + tile_size - 1) / tile_size) {
+        return text_response(404, "No such tile");
+    }
+
+    // Rotations that print the same share a cache entry
+    char key[256];
+    std::snprintf(key, sizeof(key), "%s/%s/%.6g,%.6g,%.6g/%u/%u/%u", parts[0].c_str(), parts[1].c_str(), angles[0], angles[1], angles[2], z, x, y);
+
+    CacheResult result;
+    std::shared_ptr<const std::string> tile = server.tiles.get_or_create(key, [&](std::size_t &cost) {
+        std::shared_ptr<const Image> source = get_source(server, parts[0], map);
+        if (!source) {
+            return std::shared_ptr<const std::string>();
+        }
+
+        Reprojection reprojection = {
+            .source = map->source,
+            .output = output,
+            .rotation = {},
+            .zoom = 1,
+            .bilinear = server.options.bilinear
+        };
+        make_rotation(angles[0] * PI / 180, angles[1] * PI / 180, angles[2] * PI / 180, reprojection.rotation);
+
+        std::vector<unsigned char> pixels((std::size_t) tile_size * tile_size * 3);
+        Image image = {tile_size, tile_size, (unsigned char) (source->channels == 1 ? 1 : 3), pixels.data()};
+        reproject_region(reprojection, *source, image, frame_width, frame_height, x * tile_size, y * tile_size);
+
+        std::string *png = new std::string;
+        if (!encode_png(image, *png)) {
+            delete png;
+            return std::shared_ptr<const std::string>();
+        }
+        cost = png->size();
+        return std::shared_ptr<const std::string>(png);
+    }, result);
+    count(server.tile_counters, result);
+
+    if (!tile) {
+        return text_response(500, "Failed to render the tile");
+    }
+    return {200, "image/png", tile};
+}
+
+static void write_cache_stats(std::ostringstream &json, const char *name, LruCache<std::string> *strings, LruCache<Image> *images, CacheCounters &counters) {
+    std::size_t entries, bytes;
+    if (strings) {
+        strings->get_usage(entries, bytes);
+    } else {
+        images->get_usage(entries, bytes);
+    }
+    unsigned long long hits = counters.hits, misses = counters.misses, coalesced = counters.coalesced;
+    unsigned long long total = hits + misses + coalesced;
+    json << "\"" << name << "\": {\"hits\": " << hits << ", \"misses\": " << misses << ", \"coalesced\": " << coalesced
+         << ", \"hit_rate\": " << (total ? hits / (double) total : 0) << ", \"entries\": " << entries << ", \"bytes\": " << bytes << "}";
+}
+
+static Response stats(Server &server) {
+    std::vector<double> latencies;
+    {
+        std::lock_guard<std::mutex> lock(server.latency_mutex);
+        latencies = server.latencies;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, (std::size_t) (p * latencies.size()))];
+    };
+
+    std::ostringstream json;
+    json << "{";
+    json << "\"requests\": " << server.requests << ", ";
+    write_cache_stats(json, "tiles", &server.tiles, nullptr, server.tile_counters);
+    json << ", ";
+    write_cache_stats(json, "sources", nullptr, &server.sources, server.source_counters);
+    json << ", \"latency_ms\": {\"samples\": " << latencies.size() << ", \"p50\": " << percentile(0.5) << ", \"p90\": " << percentile(0.9)
+         << ", \"p99\": " << percentile(0.99) << ", \"max\": " << (latencies.empty() ? 0 : latencies.back()) << "}";
+    json << "}\n";
+    return {200, "application/json", std::make_shared<const std::string>(json.str())};
+}
+
+static Response handle_request(Server &server, const std::string &method, const std::string &target) {
+    if (method != "GET") {
+        return text_response(405, "Only GET is supported");
+    }
+
+    std::string path = url_decode(target.substr(0, target.find('?')));
+    if (path == "/stats") {
+        return stats(server);
+    }
+    if (path == "/") {
+        return text_response(200, "Tiles are at /SOURCE/PROJECTION/LON,LAT[,ROLL]/Z/X/Y.png, statistics at /stats");
+    }
+
+    std::vector<std::string> parts;
+    std::size_t start = 1;
+    while (start <= path.size()) {
+        std::size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        parts.push_back(path.substr(start, end - start));
+        start = end + 1;
+    }
+    if (parts.size() != 6) {
+        return text_response(404, "Not found");
+    }
+    return render_tile(server, parts);
+}
+
+static void record_latency(Server &server, double milliseconds) {
+    std::lock_guard<std::mutex> lock(server.latency_mutex);
+    if (server.latencies.size() < latency_samples) {
+        server.latencies.push_back(milliseconds);
+    } else {
+        server.latencies[server.next_latency] = milliseconds;
+        server.next_latency = (server.next_latency + 1) % latency_samples;
+    }
+}
+
+/**
+ * Answer requests on a connection until the client closes it, asks for it to be closed, or stays idle for too long.
+ */
+static void handle_connection(Server &server, Socket socket) {
+    std::string buffer;
+    char chunk[4096];
+    bool keep_alive = true;
+
+    while (keep_alive) {
+        std::size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (buffer.size() > max_header_size) {
+                send_response(socket, text_response(431, "Request header too large"), false);
+                return;
+            }
+            int received = recv(socket, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                return;
+            }
+            buffer.append(chunk, received);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::string header = buffer.substr(0, header_end);
+        // Requests have no bodies, anything after the header belongs to the next request
+        buffer.erase(0, header_end + 4);
+
+        std::istringstream lines(header);
+        std::string request_line;
+        std::getline(lines, request_line);
+        std::istringstream request(request_line);
+        std::string method, target, version;
+        request >> method >> target >> version;
+        if (version.compare(0, 5, "HTTP/") != 0) {
+            send_response(socket, text_response(400, "Bad request"), false);
+            return;
+        }
+
+        keep_alive = version == "HTTP/1.1";
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+            if (line.compare(0, 11, "connection:") == 0) {
+                keep_alive = line.find("close") == std::string::npos && (keep_alive || line.find("keep-alive") != std::string::npos);
+            }
+        }
+
+        Response response = handle_request(server, method, target);
+        if (!send_response(socket, response, keep_alive)) {
+            return;
+        }
+
+        server.requests++;
+        record_latency(server, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+static Socket open_listener(unsigned int port) {
+    Socket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        std::cerr << "Failed to create a socket" << std::endl;
+        return INVALID_SOCKET;
+    }
+
+    int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *) &enable, sizeof(enable));
+
+    // Only reachable from this machine
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (bind(listener, (sockaddr *) &address, sizeof(address)) != 0) {
+        std::cerr << "Failed to bind to 127.0.0.1:" << port << std::endl;
+        close_socket(listener);
+        return INVALID_SOCKET;
+    }
+    if (listen(listener, 64) != 0) {
+        std::cerr << "Failed to listen on 127.0.0.1:" << port << std::endl;
+        close_socket(listener);
+        return INVALID_SOCKET;
+    }
+    return listener;
+}
+
+int run_serve_command(int argc, char **argv) {
+    ServeOptions options;
+    if (!parse_serve_options(argc, argv, options)) {
+        print_serve_usage();
+        return 1;
+    }
+    if (!load_map_catalog(options.maps_file)) {
+        return 1;
+    }
+
+    // Tiles are rendered from many threads at once
+    if (!prepare_cpu_conversions()) {
+        return 1;
+    }
+
+#ifdef WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        std::cerr << "Failed to initialize Winsock" << std::endl;
+        return 1;
+    }
+#endif
+
+    Socket listener = open_listener(options.port);
+    if (listener == INVALID_SOCKET) {
+        return 1;
+    }
+
+    unsigned int threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    Server server(options);
+    // Connections wait here while all threads are busy, and past that in the listen backlog
+    BoundedQueue<Socket> connections(threads * 4);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            Socket socket;
+            while (connections.pop(socket)) {
+                handle_connection(server, socket);
+                close_socket(socket);
+            }
+        });
+    }
+
+    std::cout << "Serving tiles on http://127.0.0.1:" << options.port << "/ with " << threads << " threads" << std::endl;
+
+    while (true) {
+        Socket socket = accept(listener, NULL, NULL);
+        if (socket == INVALID_SOCKET) {
+            continue;
+        }
+
+#ifdef WIN32
+        DWORD timeout = idle_timeout * 1000;
+#else
+        timeval timeout = {idle_timeout, 0};
+#endif
+        setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof(timeout));
+        int enable = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char *) &enable, sizeof(enable));
+
+        if (!connections.push(socket)) {
+            close_socket(socket);
+            break;
+        }
+    }
+
+    connections.close();
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    close_socket(listener);
+    return 0;
+}
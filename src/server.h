@@ -0,0 +1,11 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/**
+ * Run the serve command, given the arguments starting from "serve".
+ * Serves reprojected map tiles over HTTP/1.1 on 127.0.0.1 until the process is stopped, rendering them on the CPU.
+ * Returns the exit code.
+ */
+int run_serve_command(int argc, char **argv);
+
+#endif
@@ -10,7 +10,12 @@
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include "glstate.h"
+#include "stats.h"
+#include "trace.h"
+
 bool read_shader(const std::string shadername, std::string &result) {
+    TRACE_ZONE("read_shader");
     std::string target = "res/shaders/" + shadername + ".glsl";
     std::ifstream file(target);
     if (file.fail()) {
@@ -27,6 +32,7 @@ bool read_shader(const std::string shadername, std::string &result) {
 }
 
 static bool compile_shader(const std::string &name, const std::string &code, GLuint shader_id) {
+    TRACE_ZONE("compile_shader");
     GLint result = GL_FALSE;
     int log_length;
 
@@ -51,6 +57,8 @@ static bool compile_shader(const std::string &name, const std::string &code, GLu
 }
 
 bool load_shader(const std::string &shadername, const std::string &vertex_shader_code, const std::string &fragment_shader_code, Shader &shader) {
+    TRACE_ZONE("load_shader");
+    double compile_start = get_stat_time();
     shader.vertex_id = glCreateShader(GL_VERTEX_SHADER);
     shader.fragment_id = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -61,11 +69,16 @@ bool load_shader(const std::string &shadername, const std::string &vertex_shader
     shader.program_id = glCreateProgram();
     glAttachShader(shader.program_id, shader.vertex_id);
     glAttachShader(shader.program_id, shader.fragment_id);
-    glLinkProgram(shader.program_id);
 
     GLint result; result = GL_FALSE;
+    {
+        // Drivers can put off linking until the status is asked for
+        TRACE_ZONE("link_shader");
+        glLinkProgram(shader.program_id);
+        glGetProgramiv(shader.program_id, GL_LINK_STATUS, &result);
+    }
+
     int log_length;
-    glGetProgramiv(shader.program_id, GL_LINK_STATUS, &result);
     glGetProgramiv(shader.program_id, GL_INFO_LOG_LENGTH, &log_length);
 
     if (result == GL_FALSE) {
@@ -82,6 +95,7 @@ bool load_shader(const std::string &shadername, const std::string &vertex_shader
         goto err;
     }
 
+    record_stat(STAT_SHADER_COMPILE, get_stat_time() - compile_start);
     return true;
 
 err:
@@ -101,6 +115,7 @@ bool load_shader(const std::string &shadername, Shader &shader) {
 }
 
 void free_shader(Shader &shader) {
+    forget_program(shader.program_id);
     glDeleteProgram(shader.program_id);
     glDeleteShader(shader.vertex_id);
     glDeleteShader(shader.fragment_id);
@@ -0,0 +1,243 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/**
+ * Histograms of microseconds with the same layout as HdrHistogram: values below 2 * sub_buckets have a bucket each,
+ * and every power of two above that is split into sub_buckets buckets, so that any value is known to within 3%.
+ */
+static const int sub_bucket_bits = 5;
+static const uint64_t sub_buckets = 1 << sub_bucket_bits;
+// Up to 2^40 microseconds, about 12 days
+static const int max_magnitude = 40;
+static const int bucket_count = 2 * sub_buckets + (max_magnitude - sub_bucket_bits - 1) * sub_buckets;
+
+struct Histogram {
+    uint64_t buckets[bucket_count];
+    uint64_t count;
+    uint64_t max;
+    double sum;
+};
+
+static const char *stat_names[STAT_COUNT] = {
+    "frame",
+    "gpu_draw",
+    "texture_upload",
+    "shader_compile",
+    "input_latency",
+    "latency_queue",
+    "latency_cpu",
+    "latency_gpu",
+    "latency_present"
+};
+
+static Histogram histograms[STAT_COUNT];
+
+bool stats_enabled = false;
+
+/**
+ * Pairs of timestamp queries around draws. Timestamps are used instead of GL_TIME_ELAPSED because dynamic resolution
+ * already keeps a GL_TIME_ELAPSED query running around the whole frame, and those cannot be nested.
+ */
+static const int gpu_timer_count = 8;
+static GLuint gpu_queries[gpu_timer_count][2];
+static bool gpu_pending[gpu_timer_count];
+static bool gpu_queries_created = false;
+static int gpu_next = 0;
+// The slot between begin_gpu_timer and end_gpu_timer, -1 if the draw is not measured
+static int gpu_active = -1;
+
+static int get_bucket(uint64_t value) {
+    if (value < 2 * sub_buckets) {
+        return value;
+    }
+    int magnitude = 63 - __builtin_clzll(value);
+    if (magnitude >= max_magnitude) {
+        return bucket_count - 1;
+    }
+    int shift = magnitude - sub_bucket_bits;
+    return 2 * sub_buckets + (magnitude - sub_bucket_bits - 1) * sub_buckets + (value >> shift) - sub_buckets;
+}
+
+/**
+ * The smallest value in the bucket and the width of the bucket, in microseconds.
+ */
+static void get_bucket_range(int bucket, uint64_t &low, uint64_t &width) {
+    if (bucket < (int) (2 * sub_buckets)) {
+        low = bucket;
+        width = 1;
+        return;
+    }
+    int k = bucket - 2 * sub_buckets;
+    int shift = k / sub_buckets + 1;
+    low = (sub_buckets + k % sub_buckets) << shift;
+    width = (uint64_t) 1 << shift;
+}
+
+/**
+ * The value below which a fraction of the recorded values are, in milliseconds.
+ */
+static double get_percentile(const Histogram &histogram, double fraction) {
+    if (histogram.count == 0) {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, (uint64_t) (fraction * histogram.count + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_count; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= target) {
+            uint64_t low, width;
+            get_bucket_range(i, low, width);
+            return std::min(low + width / 2, histogram.max) / 1000.0;
+        }
+    }
+    return histogram.max / 1000.0;
+}
+
+void set_stats_enabled(bool enabled) {
+    stats_enabled = enabled;
+    gpu_active = -1;
+}
+
+void reset_stats() {
+    for (Histogram &histogram : histograms) {
+        histogram = Histogram();
+    }
+}
+
+double get_stat_time() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record_stat(Stat stat, double milliseconds) {
+    if (!stats_enabled) {
+        return;
+    }
+    uint64_t value = (uint64_t) std::max(0.0, milliseconds * 1000 + 0.5);
+    Histogram &histogram = histograms[stat];
+    histogram.buckets[get_bucket(value)]++;
+    histogram.count++;
+    histogram.max = std::max(histogram.max, value);
+    histogram.sum += milliseconds;
+}
+
+/**
+ * Record every finished timer without waiting for the others.
+ */
+static void collect_gpu_timers() {
+    for (int i = 0; i < gpu_timer_count; i++) {
+        if (!gpu_pending[i]) {
+            continue;
+        }
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(gpu_queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 start, end;
+        glGetQueryObjectui64v(gpu_queries[i][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(gpu_queries[i][1], GL_QUERY_RESULT, &end);
+        gpu_pending[i] = false;
+        record_stat(STAT_GPU_DRAW, (end - start) / 1e6);
+    }
+}
+
+void begin_gpu_timer() {
+    gpu_active = -1;
+    if (!stats_enabled) {
+        return;
+    }
+    if (!gpu_queries_created) {
+        glGenQueries(2 * gpu_timer_count, &gpu_queries[0][0]);
+        gpu_queries_created = true;
+    }
+    collect_gpu_timers();
+    if (gpu_pending[gpu_next]) {
+        return;
+    }
+    gpu_active = gpu_next;
+    gpu_next = (gpu_next + 1) % gpu_timer_count;
+    glQueryCounter(gpu_queries[gpu_active][0], GL_TIMESTAMP);
+}
+
+void end_gpu_timer() {
+    if (gpu_active < 0) {
+        return;
+    }
+    glQueryCounter(gpu_queries[gpu_active][1], GL_TIMESTAMP);
+    gpu_pending[gpu_active] = true;
+    gpu_active = -1;
+}
+
+void print_stats() {
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram &histogram = histograms[i];
+        if (histogram.count == 0) {
+            continue;
+        }
+        std::cout << stat_names[i] << ": " << histogram.count << " times, mean " << histogram.sum / histogram.count
+                  << " ms, p50 " << get_percentile(histogram, 0.5) << " ms, p95 " << get_percentile(histogram, 0.95)
+                  << " ms, p99 " << get_percentile(histogram, 0.99) << " ms, max " << histogram.max / 1000.0 << " ms" << std::endl;
+    }
+
+    // Every event adds to all stages, so the means show where the latency goes
+    const Histogram &latency = histograms[STAT_INPUT_LATENCY];
+    if (latency.count > 0) {
+        int slowest = STAT_LATENCY_QUEUE;
+        for (int i = STAT_LATENCY_QUEUE; i <= STAT_LATENCY_PRESENT; i++) {
+            if (histograms[i].sum > histograms[slowest].sum) {
+                slowest = i;
+            }
+        }
+        std::cout << "Input latency is mostly " << stat_names[slowest] << ": " << histograms[slowest].sum / latency.count
+                  << " ms of " << latency.sum / latency.count << " ms on average" << std::endl;
+    }
+}
+
+bool dump_stats(const std::string &filename) {
+    std::ofstream file(filename);
+    if (file.fail()) {
+        std::cerr << "Failed to open " << filename << " for writing statistics" << std::endl;
+        return false;
+    }
+
+    // Times are in milliseconds, and every bucket is [lowest value, count]
+    file << "{\n";
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram &histogram = histograms[i];
+        file << "  \"" << stat_names[i] << "\": {\"count\": " << histogram.count
+             << ", \"mean\": " << (histogram.count ? histogram.sum / histogram.count : 0)
+             << ", \"p50\": " << get_percentile(histogram, 0.5)
+             << ", \"p95\": " << get_percentile(histogram, 0.95)
+             << ", \"p99\": " << get_percentile(histogram, 0.99)
+             << ", \"max\": " << histogram.max / 1000.0
+             << ", \"buckets\": [";
+        bool first = true;
+        for (int j = 0; j < bucket_count; j++) {
+            if (histogram.buckets[j] == 0) {
+                continue;
+            }
+            uint64_t low, width;
+            get_bucket_range(j, low, width);
+            file << (first ? "" : ", ") << "[" << low / 1000.0 << ", " << histogram.buckets[j] << "]";
+            first = false;
+        }
+        file << "]}" << (i + 1 < STAT_COUNT ? "," : "") << "\n";
+    }
+    file << "}\n";
+
+    if (file.fail()) {
+        std::cerr << "Failed to write statistics to " << filename << std::endl;
+        return false;
+    }
+    std::cout << "Wrote statistics to " << filename << std::endl;
+    return true;
+}
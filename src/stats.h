@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+
+/**
+ * Durations that are recorded into histograms while statistics are enabled.
+ */
+enum Stat {
+    // CPU time of a whole frame in the window, from start to swap
+    STAT_FRAME,
+    // GPU time of drawing the map once
+    STAT_GPU_DRAW,
+    STAT_TEXTURE_UPLOAD,
+    STAT_SHADER_COMPILE,
+    // From an input event reaching the window to the frame showing it, and the stages in between, see latency.h
+    STAT_INPUT_LATENCY,
+    STAT_LATENCY_QUEUE,
+    STAT_LATENCY_CPU,
+    STAT_LATENCY_GPU,
+    STAT_LATENCY_PRESENT,
+    STAT_COUNT
+};
+
+/**
+ * Recording costs a single check of this flag while it is off. Only the render thread may record or change it.
+ */
+extern bool stats_enabled;
+
+void set_stats_enabled(bool enabled);
+void reset_stats();
+
+/**
+ * A monotonic clock in milliseconds, for measuring what gets recorded.
+ */
+double get_stat_time();
+
+void record_stat(Stat stat, double milliseconds);
+
+/**
+ * Measure the GPU time of the draw calls in between with a pair of timestamp queries.
+ * The queries are kept in a ring and read back once the GPU has finished with them, so measuring never stalls, and a
+ * draw is skipped when every query in the ring is still in flight.
+ */
+void begin_gpu_timer();
+void end_gpu_timer();
+
+/**
+ * Print the count, mean, p50, p95, p99 and max of every histogram to the standard output.
+ */
+void print_stats();
+
+/**
+ * Write the same summary as print_stats to filename as JSON, along with every non-empty bucket of the histograms.
+ */
+bool dump_stats(const std::string &filename);
+
+#endif
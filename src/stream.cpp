@@ -0,0 +1,227 @@
+#include "stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "images.h"
+
+/**
+ * A window of consecutive rows of the cropped source image. Decoding only goes forwards,
+ * so moving the window back up means decoding the file again from the start.
+ */
+struct RowCache {
+    std::string filename;
+    ImageReader reader;
+    unsigned int crop_x, crop_y;
+    // Size of the cropped image
+    unsigned int width, height;
+    unsigned int capacity;
+
+    // Rows [first, first + count) are in rows
+    unsigned int first, count;
+    std::vector<unsigned char> rows;
+    std::vector<unsigned char> file_row;
+
+    unsigned long long rows_decoded;
+    unsigned int restarts;
+};
+
+static bool open_cache(const ReprojectInput &input, unsigned int capacity, RowCache &cache) {
+    cache.filename = input.filename;
+    if (!open_image_reader(cache.filename, cache.reader)) {
+        return false;
+    }
+
+    int w = input.w, h = input.h;
+    if (w <= 0) {
+        w = cache.reader.width + w - input.x;
+    }
+    if (h <= 0) {
+        h = cache.reader.height + h - input.y;
+    }
+    if (w <= 0 || h <= 0 || input.x + w > cache.reader.width || input.y + h > cache.reader.height) {
+        std::cerr << "Crop " << input.x << "," << input.y << "," << w << "," << h << " does not fit into " << cache.filename << std::endl;
+        close_image_reader(cache.reader);
+        return false;
+    }
+
+    cache.crop_x = input.x;
+    cache.crop_y = input.y;
+    cache.width = w;
+    cache.height = h;
+    // Bilinear sampling needs two rows to be in the cache at the same time
+    cache.capacity = std::max(2u, std::min(capacity, cache.height));
+    cache.first = 0;
+    cache.count = 0;
+    cache.rows.resize((std::size_t) cache.capacity * cache.width * cache.reader.channels);
+    cache.file_row.resize((std::size_t) cache.reader.width * cache.reader.channels);
+    cache.rows_decoded = 0;
+    cache.restarts = 0;
+    return true;
+}
+
+/**
+ * Make the cache hold rows [start, start + count), keeping rows that are already there.
+ */
+static bool load_rows(RowCache &cache, unsigned int start, unsigned int count) {
+    std::size_t stride = (std::size_t) cache.width * cache.reader.channels;
+
+    unsigned int kept = 0;
+    if (start >= cache.first && start < cache.first + cache.count) {
+        kept = std::min(cache.first + cache.count - start, count);
+        std::memmove(cache.rows.data(), cache.rows.data() + (start - cache.first) * stride, kept * stride);
+    }
+    cache.first = start;
+    cache.count = kept;
+
+    unsigned int file_row = cache.crop_y + start + kept;
+    if (cache.reader.rows_read > file_row) {
+        close_image_reader(cache.reader);
+        if (!open_image_reader(cache.filename, cache.reader)) {
+            cache.reader.state = nullptr;
+            return false;
+        }
+        cache.restarts++;
+    }
+
+    std::size_t offset = (std::size_t) cache.crop_x * cache.reader.channels;
+    while (cache.count < count) {
+        if (!read_image_rows(cache.reader, cache.file_row.data(), 1)) {
+            return false;
+        }
+        cache.rows_decoded++;
+        if (cache.reader.rows_read - 1 < file_row) {
+            continue;
+        }
+        std::memcpy(cache.rows.data() + cache.count * stride, cache.file_row.data() + offset, stride);
+        cache.count++;
+        file_row++;
+    }
+
+    return true;
+}
+
+/**
+ * Split rows [0, rows) evenly over threads and wait for all of them.
+ */
+template <typename F>
+static void parallel_rows(unsigned int threads, unsigned int rows, F work) {
+    threads = std::max(1u, std::min(threads, rows));
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < threads; t++) {
+        pool.emplace_back(work, t, rows * t / threads, rows * (t + 1) / threads);
+    }
+    work(0, 0, rows / threads);
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+}
+
+bool reproject_stream(const Reprojection &reprojection, const ReprojectInput &input, const std::string &output_filename,
+                      unsigned int width, unsigned int height, unsigned int band_rows, unsigned int cache_rows, unsigned int threads) {
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+    RowCache cache;
+    if (!open_cache(input, cache_rows, cache)) {
+        return false;
+    }
+
+    unsigned char channels = cache.reader.channels == 1 ? 1 : 3;
+    ImageWriter writer;
+    if (!open_image_writer(output_filename, width, height, channels, writer)) {
+        close_image_reader(cache.reader);
+        return false;
+    }
+
+    bool result = true;
+    // Source points of the band's pixels, with a negative x for pixels outside of the output projection
+    std::vector<double> points((std::size_t) band_rows * width * 2);
+    std::vector<unsigned char> band((std::size_t) band_rows * width * channels);
+    std::vector<unsigned int> min_rows(threads), max_rows(threads);
+    unsigned int step = cache.capacity - 1;
+    unsigned int passes = 0;
+
+    for (unsigned int band_start = 0; band_start < height && result; band_start += band_rows) {
+        unsigned int rows = std::min(band_rows, height - band_start);
+
+        std::fill(min_rows.begin(), min_rows.end(), cache.height);
+        std::fill(max_rows.begin(), max_rows.end(), 0);
+        parallel_rows(threads, rows, [&](unsigned int t, unsigned int first, unsigned int last) {
+            for (unsigned int row = first; row < last; row++) {
+                double *point = points.data() + (std::size_t) row * width * 2;
+                for (unsigned int col = 0; col < width; col++, point += 2) {
+                    double x, y, source_x, source_y;
+                    output_pixel_to_map(reprojection, width, height, col, band_start + row, x, y);
+                    if (!output_to_source(reprojection, x, y, source_x, source_y)) {
+                        point[0] = -1;
+                        continue;
+                    }
+                    point[0] = source_x;
+                    point[1] = source_y;
+
+                    unsigned int first_row, last_row;
+                    get_source_rows(reprojection, cache.height, point[1], first_row, last_row);
+                    min_rows[t] = std::min(min_rows[t], first_row);
+                    max_rows[t] = std::max(max_rows[t], last_row);
+                }
+            }
+        });
+        unsigned int min_row = *std::min_element(min_rows.begin(), min_rows.end());
+        unsigned int max_row = *std::max_element(max_rows.begin(), max_rows.end());
+
+        std::fill(band.begin(), band.end(), 0);
+
+        // Every pixel is sampled in the one pass whose first step rows contain its first source row,
+        // and the pass also holds the row after it because consecutive passes overlap by one row
+        for (unsigned int pass_start = min_row; pass_start <= max_row; pass_start += step) {
+            unsigned int count = std::min(cache.capacity, cache.height - pass_start);
+            if (!load_rows(cache, pass_start, count)) {
+                result = false;
+                break;
+            }
+            passes++;
+
+            Image window = {cache.width, count, cache.reader.channels, cache.rows.data()};
+            parallel_rows(threads, rows, [&](unsigned int, unsigned int first, unsigned int last) {
+                for (unsigned int row = first; row < last; row++) {
+                    const double *point = points.data() + (std::size_t) row * width * 2;
+                    unsigned char *pixel = band.data() + (std::size_t) row * width * channels;
+                    for (unsigned int col = 0; col < width; col++, point += 2, pixel += channels) {
+                        if (point[0] < 0) {
+                            continue;
+                        }
+                        unsigned int first_row, last_row;
+                        get_source_rows(reprojection, cache.height, point[1], first_row, last_row);
+                        if (first_row < pass_start || first_row >= pass_start + step) {
+                            continue;
+                        }
+                        double window_y = (point[1] * cache.height - pass_start) / count;
+                        sample_source(reprojection, window, point[0], window_y, pixel, channels);
+                    }
+                }
+            });
+        }
+
+        if (result) {
+            result = write_image_rows(writer, band.data(), rows);
+        }
+    }
+
+    result = close_image_writer(writer) && result;
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    std::size_t buffers = cache.rows.size() + cache.file_row.size() + points.size() * sizeof(double) + band.size();
+    std::cout << input.filename << " -> " << output_filename << ": " << elapsed << " s, decoded " << cache.rows_decoded
+              << " rows of " << cache.reader.height << " in " << passes << " passes with " << cache.restarts << " restarts, "
+              << buffers / (1024 * 1024) << " MiB of buffers" << std::endl;
+
+    // A failed restart leaves no reader to close
+    if (cache.reader.state) {
+        close_image_reader(cache.reader);
+    }
+    return result;
+}
@@ -0,0 +1,18 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <string>
+
+#include "options.h"
+#include "reproject.h"
+
+/**
+ * Reproject an image without ever having all of it in memory.
+ * The output is made in bands of band_rows rows. For every band only the source rows that it needs are decoded,
+ * through a cache of at most cache_rows rows, and the band is written out before moving on to the next one.
+ * Memory use therefore depends on the band and cache sizes and the image widths, but not on the image heights.
+ */
+bool reproject_stream(const Reprojection &reprojection, const ReprojectInput &input, const std::string &output_filename,
+                      unsigned int width, unsigned int height, unsigned int band_rows, unsigned int cache_rows, unsigned int threads);
+
+#endif
@@ -0,0 +1,110 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+/**
+ * Only its own thread writes to a buffer, the mutex below is only taken to add a new one.
+ */
+struct TraceBuffer {
+    unsigned int thread;
+    std::vector<TraceEvent> events;
+    std::size_t next;
+    bool wrapped;
+};
+
+// A power of two, about 1.5 MB per thread
+static const std::size_t buffer_size = 1 << 16;
+
+bool tracing_enabled = false;
+
+static std::string trace_file;
+static std::chrono::steady_clock::time_point trace_start;
+
+static std::mutex buffers_mutex;
+// Never freed, threads that have ended still have zones to write
+static std::vector<TraceBuffer *> buffers;
+static thread_local TraceBuffer *thread_buffer = nullptr;
+
+void start_tracing(const std::string &filename) {
+    if (tracing_enabled) {
+        return;
+    }
+    trace_file = filename;
+    trace_start = std::chrono::steady_clock::now();
+    tracing_enabled = true;
+    std::atexit(stop_tracing);
+}
+
+uint64_t get_trace_time() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_start).count();
+}
+
+void add_trace_zone(const char *name, uint64_t start) {
+    uint64_t end = get_trace_time();
+    if (!thread_buffer) {
+        TraceBuffer *buffer = new TraceBuffer();
+        buffer->events.resize(buffer_size);
+        buffer->next = 0;
+        buffer->wrapped = false;
+
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffer->thread = buffers.size() + 1;
+        buffers.push_back(buffer);
+        thread_buffer = buffer;
+    }
+
+    thread_buffer->events[thread_buffer->next] = {name, start, end - start};
+    thread_buffer->next = (thread_buffer->next + 1) & (buffer_size - 1);
+    if (thread_buffer->next == 0) {
+        thread_buffer->wrapped = true;
+    }
+}
+
+void stop_tracing() {
+    if (!tracing_enabled) {
+        return;
+    }
+    tracing_enabled = false;
+
+    std::ofstream file(trace_file);
+    if (file.fail()) {
+        std::cerr << "Failed to open " << trace_file << " for writing the trace" << std::endl;
+        return;
+    }
+
+    // Complete events with times in microseconds, see the Trace Event Format
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"MapProjection\"}}";
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    std::size_t count = 0;
+    for (const TraceBuffer *buffer : buffers) {
+        std::size_t first = buffer->wrapped ? buffer->next : 0;
+        std::size_t size = buffer->wrapped ? buffer_size : buffer->next;
+        for (std::size_t i = 0; i < size; i++) {
+            const TraceEvent &event = buffer->events[(first + i) & (buffer_size - 1)];
+            file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->thread
+                 << ", \"ts\": " << event.start / 1000.0 << ", \"dur\": " << event.duration / 1000.0 << "}";
+        }
+        count += size;
+    }
+    file << "\n]}\n";
+
+    if (file.fail()) {
+        std::cerr << "Failed to write the trace to " << trace_file << std::endl;
+        return;
+    }
+    std::cerr << "Wrote " << count << " trace zones to " << trace_file << std::endl;
+}
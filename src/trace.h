@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Set once by start_tracing before any other thread is started, and only read afterwards.
+ */
+extern bool tracing_enabled;
+
+/**
+ * Record trace zones from now on, and write them to filename as a Chrome trace when the program exits.
+ * The file can be opened in chrome://tracing or ui.perfetto.dev.
+ */
+void start_tracing(const std::string &filename);
+
+/**
+ * Write everything recorded so far and stop recording. Called at exit by start_tracing.
+ */
+void stop_tracing();
+
+/**
+ * Nanoseconds since tracing started.
+ */
+uint64_t get_trace_time();
+
+/**
+ * Add a zone that started at start and ends now to the calling thread's buffer.
+ * Every thread records into a ring buffer of its own, so recording never locks, and only the most recent zones of a
+ * thread are kept if it records more than fit.
+ */
+void add_trace_zone(const char *name, uint64_t start);
+
+/**
+ * Times the scope it is declared in. The name has to be a string literal, as only the pointer is kept.
+ */
+class TraceZone {
+public:
+    explicit TraceZone(const char *name) : name(tracing_enabled ? name : nullptr), start(tracing_enabled ? get_trace_time() : 0) {}
+
+    ~TraceZone() {
+        if (name) {
+            add_trace_zone(name, start);
+        }
+    }
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,342 @@
+#include "transform.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include "Windows.h"
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapper.h"
+#include "options.h"
+#include "points.h"
+
+// Magic constant
+const double PI = 3.141592653589793238462;
+
+/**
+ * Binary input is converted this many points at a time, which bounds the size of the output buffer.
+ */
+static const std::size_t binary_block_points = 1 << 20;
+
+/**
+ * CSV input is split into blocks of about this many bytes, and each block into one piece per thread.
+ */
+static const std::size_t csv_block_bytes = 16 << 20;
+
+/**
+ * A read-only memory mapping of a whole file, the input is converted straight from it without copying.
+ */
+struct MappedFile {
+    const char *data;
+    std::size_t size;
+#ifdef WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+static bool map_file(const std::string &filename, MappedFile &mapped) {
+    mapped.data = nullptr;
+    mapped.size = 0;
+#ifdef WIN32
+    mapped.mapping = NULL;
+    mapped.file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open " << filename << "!" << std::endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(mapped.file, &size);
+    mapped.size = size.QuadPart;
+    if (mapped.size == 0) {
+        return true;
+    }
+    mapped.mapping = CreateFileMappingA(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped.mapping) {
+        mapped.data = (const char *) MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!mapped.data) {
+        std::cerr << "Failed to map " << filename << " into memory" << std::endl;
+        if (mapped.mapping) {
+            CloseHandle(mapped.mapping);
+        }
+        CloseHandle(mapped.file);
+        return false;
+    }
+#else
+    mapped.fd = open(filename.c_str(), O_RDONLY);
+    if (mapped.fd < 0) {
+        std::cerr << "Failed to open " << filename << "!" << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(mapped.fd, &info) != 0) {
+        std::cerr << "Failed to get the size of " << filename << std::endl;
+        close(mapped.fd);
+        return false;
+    }
+    mapped.size = info.st_size;
+    if (mapped.size == 0) {
+        return true;
+    }
+    void *data = mmap(NULL, mapped.size, PROT_READ, MAP_PRIVATE, mapped.fd, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map " << filename << " into memory" << std::endl;
+        close(mapped.fd);
+        return false;
+    }
+    // The file is read front to back
+    madvise(data, mapped.size, MADV_SEQUENTIAL);
+    mapped.data = (const char *) data;
+#endif
+    return true;
+}
+
+static void unmap_file(MappedFile &mapped) {
+#ifdef WIN32
+    if (mapped.data) {
+        UnmapViewOfFile(mapped.data);
+        CloseHandle(mapped.mapping);
+    }
+    CloseHandle(mapped.file);
+#else
+    if (mapped.data) {
+        munmap((void *) mapped.data, mapped.size);
+    }
+    close(mapped.fd);
+#endif
+}
+
+/**
+ * Convert little-endian pairs of doubles, returning the number of points or -1 on failure.
+ */
+static long long transform_binary(const PointTransform &transform, bool inverse, const MappedFile &input, FILE *output, unsigned int threads, std::size_t &failed) {
+    if (input.size % (2 * sizeof(double)) != 0) {
+        std::cerr << "Binary input has to be pairs of doubles, but its size is not a multiple of " << 2 * sizeof(double) << std::endl;
+        return -1;
+    }
+
+    std::size_t count = input.size / (2 * sizeof(double));
+    const double *points = (const double *) input.data;
+    std::vector<double> buffer(2 * std::min(count, binary_block_points));
+
+    for (std::size_t first = 0; first < count; first += binary_block_points) {
+        std::size_t n = std::min(binary_block_points, count - first);
+        failed += transform_points(transform, inverse, points + 2 * first, buffer.data(), n, threads);
+        if (fwrite(buffer.data(), 2 * sizeof(double), n, output) != n) {
+            std::cerr << "Failed to write the output" << std::endl;
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * A piece of CSV input converted by one thread. Lines that do not start with two numbers, like headers, are copied as they are.
+ */
+struct CsvPiece {
+    const char *begin;
+    const char *end;
+    std::string text;
+    std::size_t points;
+    std::size_t failed;
+};
+
+static void append_number(std::string &text, double value) {
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    text.append(buffer, length);
+}
+
+static void transform_csv_piece(const PointTransform &transform, bool inverse, CsvPiece &piece) {
+    // Lines that are copied as they are, or nulls for the data lines
+    std::vector<std::pair<const char *, const char *>> lines;
+    std::vector<double> points;
+
+    const char *line = piece.begin;
+    while (line < piece.end) {
+        const char *line_end = std::find(line, piece.end, '\n');
+        const char *content_end = line_end > line && line_end[-1] == '\r' ? line_end - 1 : line_end;
+
+        double a, b;
+        std::from_chars_result first = std::from_chars(line, content_end, a);
+        const char *second_start = first.ptr;
+        while (second_start < content_end && (*second_start == ',' || *second_start == ' ' || *second_start == '\t' || *second_start == ';')) {
+            second_start++;
+        }
+        std::from_chars_result second = std::from_chars(second_start, content_end, b);
+
+        if (first.ec == std::errc() && second_start > first.ptr && second.ec == std::errc()) {
+            points.push_back(a);
+            points.push_back(b);
+            lines.push_back({nullptr, nullptr});
+        } else if (content_end > line) {
+            lines.push_back({line, content_end});
+        }
+        line = line_end + 1;
+    }
+
+    piece.points = points.size() / 2;
+    if (inverse) {
+        piece.failed = map_to_lonlat(transform, points.data(), points.data(), piece.points);
+    } else {
+        piece.failed = lonlat_to_map(transform, points.data(), points.data(), piece.points);
+    }
+
+    piece.text.reserve(piece.points * 36);
+    const double *point = points.data();
+    for (const std::pair<const char *, const char *> &copied : lines) {
+        if (copied.first) {
+            piece.text.append(copied.first, copied.second);
+        } else {
+            append_number(piece.text, point[0]);
+            piece.text.push_back(',');
+            append_number(piece.text, point[1]);
+            point += 2;
+        }
+        piece.text.push_back('\n');
+    }
+}
+
+/**
+ * Convert lines of comma separated pairs, returning the number of points or -1 on failure.
+ */
+static long long transform_csv(const PointTransform &transform, bool inverse, const MappedFile &input, FILE *output, unsigned int threads, std::size_t &failed) {
+    long long count = 0;
+    const char *end = input.data + input.size;
+    std::vector<CsvPiece> pieces(threads);
+
+    for (const char *block = input.data; block < end;) {
+        // Every piece ends after a newline, so that no line is split between threads
+        const char *block_end = block + std::min<std::size_t>(csv_block_bytes, end - block);
+        const char *start = block;
+        for (unsigned int i = 0; i < threads; i++) {
+            const char *piece_end = block + (block_end - block) * (i + 1) / threads;
+            piece_end = std::max(piece_end, start);
+            piece_end = std::find(piece_end, end, '\n');
+            piece_end = piece_end < end ? piece_end + 1 : end;
+            pieces[i].begin = start;
+            pieces[i].end = piece_end;
+            start = piece_end;
+        }
+
+        std::vector<std::thread> pool;
+        for (unsigned int i = 1; i < threads; i++) {
+            pool.emplace_back(transform_csv_piece, std::cref(transform), inverse, std::ref(pieces[i]));
+        }
+        transform_csv_piece(transform, inverse, pieces[0]);
+        for (std::thread &thread : pool) {
+            thread.join();
+        }
+
+        for (CsvPiece &piece : pieces) {
+            if (fwrite(piece.text.data(), 1, piece.text.size(), output) != piece.text.size()) {
+                std::cerr << "Failed to write the output" << std::endl;
+                return -1;
+            }
+            count += piece.points;
+            failed += piece.failed;
+            piece.text.clear();
+        }
+
+        block = start;
+    }
+
+    return count;
+}
+
+int run_transform_command(int argc, char **argv) {
+    TransformOptions options;
+    if (!parse_transform_options(argc, argv, options)) {
+        print_transform_usage();
+        return 1;
+    }
+
+    PointTransform transform;
+    transform.projection = find_projection(options.projection);
+    if (!transform.projection) {
+        std::cerr << "Unknown projection: " << options.projection << std::endl;
+        return 1;
+    }
+    transform.rotate = options.rotate;
+    transform.degrees = !options.radians;
+    if (options.has_matrix) {
+        std::copy(options.matrix, options.matrix + 9, transform.rotation);
+    } else {
+        float rotation[9];
+        set_rotation(options.longitude * PI / 180, options.latitude * PI / 180, options.roll * PI / 180);
+        get_rotation(rotation);
+        std::copy(rotation, rotation + 9, transform.rotation);
+    }
+
+    if (!prepare_cpu_conversions()) {
+        return 1;
+    }
+
+    unsigned int threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    MappedFile input;
+    if (!map_file(options.input, input)) {
+        return 1;
+    }
+
+    FILE *output = stdout;
+    if (!options.output.empty()) {
+        output = fopen(options.output.c_str(), "wb");
+        if (!output) {
+            std::cerr << "Failed to open " << options.output << " for writing!" << std::endl;
+            unmap_file(input);
+            return 1;
+        }
+    }
+#ifdef WIN32
+    else if (options.binary) {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::size_t failed = 0;
+    long long count;
+    if (options.binary) {
+        count = transform_binary(transform, options.inverse, input, output, threads, failed);
+    } else {
+        count = transform_csv(transform, options.inverse, input, output, threads, failed);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool result = count >= 0;
+    if (output != stdout) {
+        result = fclose(output) == 0 && result;
+    } else {
+        result = fflush(output) == 0 && result;
+    }
+    unmap_file(input);
+
+    if (result) {
+        std::cerr << "Transformed " << count << " points (" << failed << " outside of the projection) in " << elapsed << " s with "
+                  << threads << " threads, " << count / elapsed / 1e6 << " million points/s" << std::endl;
+    }
+
+    return result ? 0 : 1;
+}
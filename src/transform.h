@@ -0,0 +1,10 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+/**
+ * Run the transform command, given the arguments starting from "transform".
+ * The input file is memory mapped and converted in parallel with transform_points. Returns the exit code.
+ */
+int run_transform_command(int argc, char **argv);
+
+#endif